@@ -0,0 +1,427 @@
+#include "aabb_tree.h"
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <queue>
+#include <utility>
+
+namespace {
+	float surface_area(const glm::vec3& low, const glm::vec3& high) {
+		const auto size = high - low;
+		return 2.f * (size.x * size.y + size.y * size.z + size.z * size.x);
+	}
+
+	float union_area(const glm::vec3& lowA, const glm::vec3& highA, const glm::vec3& lowB, const glm::vec3& highB) {
+		return surface_area(glm::min(lowA, lowB), glm::max(highA, highB));
+	}
+
+	bool contains(const glm::vec3& low, const glm::vec3& high, const glm::vec3& innerLow, const glm::vec3& innerHigh) {
+		return low.x <= innerLow.x && low.y <= innerLow.y && low.z <= innerLow.z
+			&& innerHigh.x <= high.x && innerHigh.y <= high.y && innerHigh.z <= high.z;
+	}
+
+	float distance_squared(const glm::vec3& point, const glm::vec3& low, const glm::vec3& high) {
+		const auto offset = glm::max(glm::max(low - point, point - high), glm::vec3(0.f));
+		return glm::dot(offset, offset);
+	}
+
+	// Entry distance of the ray into the box, or infinity when it misses within maxDistance
+	float ray_entry(const glm::vec3& origin, const glm::vec3& inverse, const float maxDistance, const glm::vec3& low, const glm::vec3& high) {
+		auto enter = 0.f, leave = maxDistance;
+		for (auto axis = 0; axis < 3; axis++) {
+			auto t0 = (low[axis] - origin[axis]) * inverse[axis];
+			auto t1 = (high[axis] - origin[axis]) * inverse[axis];
+			if (t0 > t1) {
+				std::swap(t0, t1);
+			}
+			// NaN from 0 * infinity means the ray runs along the slab, which the max/min skip
+			enter = std::max(enter, t0);
+			leave = std::min(leave, t1);
+		}
+		return enter <= leave ? enter : std::numeric_limits<float>::infinity();
+	}
+}
+
+int32_t aabb_tree::allocate_node() {
+	if (m_iFree == NONE) {
+		m_vNodes.emplace_back();
+		return static_cast<int32_t>(m_vNodes.size() - 1);
+	}
+
+	const auto node = m_iFree;
+	m_iFree = m_vNodes[node].parent;
+	m_vNodes[node] = {};
+	return node;
+}
+
+void aabb_tree::free_node(const int32_t node) {
+	m_vNodes[node].parent = m_iFree;
+	m_vNodes[node].height = -1;
+	m_iFree = node;
+}
+
+void aabb_tree::refit(const int32_t node) {
+	auto& n = m_vNodes[node];
+	const auto& left = m_vNodes[n.left];
+	const auto& right = m_vNodes[n.right];
+	n.low = glm::min(left.low, right.low);
+	n.high = glm::max(left.high, right.high);
+	n.height = 1 + std::max(left.height, right.height);
+}
+
+void aabb_tree::insert_leaf(const int32_t leaf) {
+	if (m_iRoot == NONE) {
+		m_iRoot = leaf;
+		m_vNodes[leaf].parent = NONE;
+		return;
+	}
+
+	// Find the sibling that grows the tree's surface area the least
+	const auto low = m_vNodes[leaf].low, high = m_vNodes[leaf].high;
+	auto index = m_iRoot;
+	while (!m_vNodes[index].is_leaf()) {
+		const auto& node = m_vNodes[index];
+		const auto area = surface_area(node.low, node.high);
+		const auto combinedArea = union_area(node.low, node.high, low, high);
+
+		// Pairing with this node makes a new parent, descending makes every ancestor grow
+		const auto cost = 2.f * combinedArea;
+		const auto inheritance = 2.f * (combinedArea - area);
+
+		const auto child_cost = [&](const node_t& child) {
+			const auto grown = union_area(child.low, child.high, low, high);
+			return (child.is_leaf() ? grown : grown - surface_area(child.low, child.high)) + inheritance;
+		};
+		const auto leftCost = child_cost(m_vNodes[node.left]);
+		const auto rightCost = child_cost(m_vNodes[node.right]);
+
+		if (cost < leftCost && cost < rightCost) {
+			break;
+		}
+		index = leftCost < rightCost ? node.left : node.right;
+	}
+
+	const auto sibling = index;
+	const auto oldParent = m_vNodes[sibling].parent;
+	const auto newParent = allocate_node();
+	m_vNodes[newParent].parent = oldParent;
+	m_vNodes[newParent].left = sibling;
+	m_vNodes[newParent].right = leaf;
+	m_vNodes[sibling].parent = newParent;
+	m_vNodes[leaf].parent = newParent;
+
+	if (oldParent == NONE) {
+		m_iRoot = newParent;
+	}
+	else if (m_vNodes[oldParent].left == sibling) {
+		m_vNodes[oldParent].left = newParent;
+	}
+	else {
+		m_vNodes[oldParent].right = newParent;
+	}
+
+	// Walk back up fixing heights and bounds
+	for (index = newParent; index != NONE; index = m_vNodes[index].parent) {
+		index = balance(index);
+		refit(index);
+	}
+}
+
+void aabb_tree::remove_leaf(const int32_t leaf) {
+	if (leaf == m_iRoot) {
+		m_iRoot = NONE;
+		return;
+	}
+
+	const auto parent = m_vNodes[leaf].parent;
+	const auto grandParent = m_vNodes[parent].parent;
+	const auto sibling = m_vNodes[parent].left == leaf ? m_vNodes[parent].right : m_vNodes[parent].left;
+	free_node(parent);
+
+	// The sibling takes the parent's place
+	m_vNodes[sibling].parent = grandParent;
+	if (grandParent == NONE) {
+		m_iRoot = sibling;
+		return;
+	}
+
+	if (m_vNodes[grandParent].left == parent) {
+		m_vNodes[grandParent].left = sibling;
+	}
+	else {
+		m_vNodes[grandParent].right = sibling;
+	}
+
+	for (auto index = grandParent; index != NONE; index = m_vNodes[index].parent) {
+		index = balance(index);
+		refit(index);
+	}
+}
+
+int32_t aabb_tree::balance(const int32_t a) {
+	if (m_vNodes[a].is_leaf() || m_vNodes[a].height < 2) {
+		return a;
+	}
+
+	const auto b = m_vNodes[a].left, c = m_vNodes[a].right;
+	const auto difference = m_vNodes[c].height - m_vNodes[b].height;
+	if (difference >= -1 && difference <= 1) {
+		return a;
+	}
+
+	// up is the taller child, it takes a's place and a keeps up's shorter child
+	const auto up = difference > 1 ? c : b;
+	const auto upLeft = m_vNodes[up].left, upRight = m_vNodes[up].right;
+	const auto tall = m_vNodes[upLeft].height > m_vNodes[upRight].height ? upLeft : upRight;
+	const auto shortChild = tall == upLeft ? upRight : upLeft;
+
+	m_vNodes[up].parent = m_vNodes[a].parent;
+	m_vNodes[a].parent = up;
+	const auto parent = m_vNodes[up].parent;
+	if (parent == NONE) {
+		m_iRoot = up;
+	}
+	else if (m_vNodes[parent].left == a) {
+		m_vNodes[parent].left = up;
+	}
+	else {
+		m_vNodes[parent].right = up;
+	}
+
+	m_vNodes[up].left = a;
+	m_vNodes[up].right = tall;
+	if (up == c) {
+		m_vNodes[a].right = shortChild;
+	}
+	else {
+		m_vNodes[a].left = shortChild;
+	}
+	m_vNodes[shortChild].parent = a;
+
+	refit(a);
+	refit(up);
+	return up;
+}
+
+int32_t aabb_tree::insert(const aabb_t& bounds, const uint32_t user) {
+	const auto proxy = allocate_node();
+	auto& node = m_vNodes[proxy];
+	node.bounds = bounds;
+	node.low = bounds.center - bounds.extent - glm::vec3(m_fMargin);
+	node.high = bounds.center + bounds.extent + glm::vec3(m_fMargin);
+	node.user = user;
+	node.height = 0;
+
+	insert_leaf(proxy);
+	m_uLeaves++;
+	return proxy;
+}
+
+void aabb_tree::remove(const int32_t proxy) {
+	remove_leaf(proxy);
+	free_node(proxy);
+	m_uLeaves--;
+}
+
+bool aabb_tree::update(const int32_t proxy, const aabb_t& bounds) {
+	auto& node = m_vNodes[proxy];
+	node.bounds = bounds;
+	if (contains(node.low, node.high, bounds.center - bounds.extent, bounds.center + bounds.extent)) {
+		return false;
+	}
+
+	remove_leaf(proxy);
+	node.low = bounds.center - bounds.extent - glm::vec3(m_fMargin);
+	node.high = bounds.center + bounds.extent + glm::vec3(m_fMargin);
+	insert_leaf(proxy);
+	return true;
+}
+
+void aabb_tree::clear() {
+	m_vNodes.clear();
+	m_iRoot = NONE;
+	m_iFree = NONE;
+	m_uLeaves = 0;
+}
+
+void aabb_tree::query_frustum(const frustum_t& frustum, std::vector<uint32_t>& out) const {
+	if (m_iRoot == NONE) {
+		return;
+	}
+
+	// Each entry carries the planes its node still straddles, none left means everything below is visible
+	std::vector<std::pair<int32_t, uint8_t>> stack;
+	stack.reserve(64);
+	stack.emplace_back(m_iRoot, 0x3F);
+
+	while (!stack.empty()) {
+		auto [index, planes] = stack.back();
+		stack.pop_back();
+		const auto& node = m_vNodes[index];
+
+		// Leaves are tested with their exact box, fully inside fat bounds means the exact box is too
+		const auto center = node.is_leaf() ? node.bounds.center : (node.low + node.high) * 0.5f;
+		const auto extent = node.is_leaf() ? node.bounds.extent : (node.high - node.low) * 0.5f;
+
+		auto outside = false;
+		for (auto p = 0; p < 6 && planes; p++) {
+			if (!(planes & (1 << p))) {
+				continue;
+			}
+
+			const auto& plane = frustum.planes[p];
+			const auto distance = glm::dot(glm::vec3(plane), center) + plane.w;
+			const auto radius = glm::dot(glm::abs(glm::vec3(plane)), extent);
+			if (distance + radius < 0.f) {
+				outside = true;
+				break;
+			}
+			if (distance - radius >= 0.f) {
+				planes &= ~(1 << p);
+			}
+		}
+		if (outside) {
+			continue;
+		}
+
+		if (node.is_leaf()) {
+			out.push_back(node.user);
+			continue;
+		}
+		stack.emplace_back(node.right, planes);
+		stack.emplace_back(node.left, planes);
+	}
+}
+
+void aabb_tree::query_sphere(const glm::vec3& center, const float radius, std::vector<uint32_t>& out) const {
+	if (m_iRoot == NONE) {
+		return;
+	}
+
+	const auto radiusSquared = radius * radius;
+	std::vector<std::pair<int32_t, bool>> stack;
+	stack.reserve(64);
+	stack.emplace_back(m_iRoot, false);
+
+	while (!stack.empty()) {
+		const auto [index, inside] = stack.back();
+		stack.pop_back();
+		const auto& node = m_vNodes[index];
+
+		if (node.is_leaf()) {
+			if (inside || distance_squared(center, node.bounds.center - node.bounds.extent, node.bounds.center + node.bounds.extent) <= radiusSquared) {
+				out.push_back(node.user);
+			}
+			continue;
+		}
+
+		auto contained = inside;
+		if (!contained) {
+			if (distance_squared(center, node.low, node.high) > radiusSquared) {
+				continue;
+			}
+
+			// The farthest corner inside the sphere puts the whole subtree inside
+			const auto farthest = glm::max(glm::abs(node.low - center), glm::abs(node.high - center));
+			contained = glm::dot(farthest, farthest) <= radiusSquared;
+		}
+		stack.emplace_back(node.right, contained);
+		stack.emplace_back(node.left, contained);
+	}
+}
+
+bool aabb_tree::raycast(const glm::vec3& origin, const glm::vec3& direction, const float maxDistance, uint32_t& hit, float& distance) const {
+	if (m_iRoot == NONE) {
+		return false;
+	}
+
+	const auto inverse = 1.f / direction;
+	auto best = maxDistance;
+	auto found = false;
+
+	std::vector<std::pair<int32_t, float>> stack;
+	stack.reserve(64);
+	stack.emplace_back(m_iRoot, ray_entry(origin, inverse, best, m_vNodes[m_iRoot].low, m_vNodes[m_iRoot].high));
+
+	while (!stack.empty()) {
+		const auto [index, entry] = stack.back();
+		stack.pop_back();
+
+		// Something closer was hit since this node was pushed
+		if (entry > best) {
+			continue;
+		}
+
+		const auto& node = m_vNodes[index];
+		if (node.is_leaf()) {
+			const auto t = ray_entry(origin, inverse, best, node.bounds.center - node.bounds.extent, node.bounds.center + node.bounds.extent);
+			if (t < best || (t == best && !found)) {
+				best = t;
+				hit = node.user;
+				found = true;
+			}
+			continue;
+		}
+
+		// The nearer child goes on top so it is visited first
+		const auto left = ray_entry(origin, inverse, best, m_vNodes[node.left].low, m_vNodes[node.left].high);
+		const auto right = ray_entry(origin, inverse, best, m_vNodes[node.right].low, m_vNodes[node.right].high);
+		const auto nearLeft = left <= right;
+		const auto farChild = nearLeft ? std::pair{ node.right, right } : std::pair{ node.left, left };
+		const auto nearChild = nearLeft ? std::pair{ node.left, left } : std::pair{ node.right, right };
+		if (std::isfinite(farChild.second)) {
+			stack.push_back(farChild);
+		}
+		if (std::isfinite(nearChild.second)) {
+			stack.push_back(nearChild);
+		}
+	}
+
+	if (found) {
+		distance = best;
+	}
+	return found;
+}
+
+void aabb_tree::query_nearest(const glm::vec3& point, const size_t k, std::vector<uint32_t>& out) const {
+	if (m_iRoot == NONE || k == 0) {
+		return;
+	}
+
+	// Nodes by the distance to their bounds, closest first, and the best k so far, farthest on top
+	using entry_t = std::pair<float, int32_t>;
+	std::priority_queue<entry_t, std::vector<entry_t>, std::greater<>> open;
+	std::priority_queue<std::pair<float, uint32_t>> best;
+	open.emplace(distance_squared(point, m_vNodes[m_iRoot].low, m_vNodes[m_iRoot].high), m_iRoot);
+
+	while (!open.empty()) {
+		const auto [nodeDistance, index] = open.top();
+		open.pop();
+		if (best.size() == k && nodeDistance > best.top().first) {
+			break;
+		}
+
+		const auto& node = m_vNodes[index];
+		if (node.is_leaf()) {
+			const auto leafDistance = distance_squared(point, node.bounds.center - node.bounds.extent, node.bounds.center + node.bounds.extent);
+			if (best.size() < k) {
+				best.emplace(leafDistance, node.user);
+			}
+			else if (leafDistance < best.top().first) {
+				best.pop();
+				best.emplace(leafDistance, node.user);
+			}
+			continue;
+		}
+
+		open.emplace(distance_squared(point, m_vNodes[node.left].low, m_vNodes[node.left].high), node.left);
+		open.emplace(distance_squared(point, m_vNodes[node.right].low, m_vNodes[node.right].high), node.right);
+	}
+
+	const auto first = out.size();
+	out.resize(first + best.size());
+	for (auto i = out.size(); i > first; i--) {
+		out[i - 1] = best.top().second;
+		best.pop();
+	}
+}
@@ -0,0 +1,97 @@
+#ifndef AABB_TREE_H
+#define AABB_TREE_H
+#include <cstdint>
+#include <vector>
+#include "glm/glm.hpp"
+#include "culling.h"
+
+// Dynamic bounding volume tree over world space boxes, for scene queries that would
+// otherwise walk every object
+//
+// Leaves hold a fattened copy of their box so small moves leave the tree alone, and the
+// exact box for the final test, so query results are the same as a brute force scan.
+// Inserts descend by surface area cost and rebalance with rotations on the way back up
+class aabb_tree {
+public:
+	static constexpr int32_t NONE = -1;
+
+private:
+	struct node_t {
+		// What traversal reads comes first, to share a cache line
+		// Fat bounds for leaves, the union of the children otherwise
+		glm::vec3 low, high;
+		int32_t left = NONE;
+		int32_t right = NONE;
+		// Exact bounds, leaves only
+		aabb_t bounds;
+		// Next free node while unused
+		int32_t parent = NONE;
+		// 0 for leaves, -1 while unused
+		int32_t height = 0;
+		uint32_t user = 0;
+
+		[[nodiscard]]
+		bool is_leaf() const {
+			return left == NONE;
+		}
+	};
+
+	std::vector<node_t> m_vNodes;
+	int32_t m_iRoot = NONE;
+	int32_t m_iFree = NONE;
+	size_t m_uLeaves = 0;
+	float m_fMargin;
+
+	int32_t allocate_node();
+	void free_node(int32_t node);
+	void insert_leaf(int32_t leaf);
+	void remove_leaf(int32_t leaf);
+
+	// Rotate the taller grandchild up when the children's heights differ by more than one
+	int32_t balance(int32_t node);
+
+	// Bounds and height of an inner node from its children
+	void refit(int32_t node);
+
+public:
+	// margin is how far an object can move before it has to be reinserted
+	explicit aabb_tree(float margin = 0.1f) : m_fMargin(margin) {}
+
+	// Returns the proxy the object is known by from now on, user comes back from queries
+	int32_t insert(const aabb_t& bounds, uint32_t user);
+	void remove(int32_t proxy);
+
+	// Returns true when the object left its fat bounds and was reinserted
+	bool update(int32_t proxy, const aabb_t& bounds);
+
+	void clear();
+
+	[[nodiscard]]
+	uint32_t get_user(const int32_t proxy) const {
+		return m_vNodes[proxy].user;
+	}
+
+	[[nodiscard]]
+	size_t size() const {
+		return m_uLeaves;
+	}
+
+	[[nodiscard]]
+	int32_t height() const {
+		return m_iRoot == NONE ? 0 : m_vNodes[m_iRoot].height;
+	}
+
+	// Objects touching the frustum, planes a subtree is fully inside are not tested below it
+	void query_frustum(const frustum_t& frustum, std::vector<uint32_t>& out) const;
+
+	// Objects touching the sphere
+	void query_sphere(const glm::vec3& center, float radius, std::vector<uint32_t>& out) const;
+
+	// The closest object hit within maxDistance along a normalized direction
+	bool raycast(const glm::vec3& origin, const glm::vec3& direction, float maxDistance, uint32_t& hit, float& distance) const;
+
+	// Up to k objects closest to the point, nearest first, by distance to their box
+	void query_nearest(const glm::vec3& point, size_t k, std::vector<uint32_t>& out) const;
+};
+
+#endif // AABB_TREE_H
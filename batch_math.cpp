@@ -0,0 +1,597 @@
+#include "batch_math.h"
+#include "cpu_features.h"
+#include <cmath>
+
+#if defined(CPU_FEATURES_X86)
+#include <immintrin.h>
+#endif
+
+namespace {
+	batch_math::kernel selectedKernel = batch_math::kernel::automatic;
+
+	// glm::radians
+	constexpr float DEGREES_TO_RADIANS = 0.01745329251994329576923690768489f;
+
+	void compose_one(const glm::vec3& position, const glm::vec2& rotation, const glm::vec3& scale, glm::mat4& world, glm::mat3* normal) {
+		const auto pitch = rotation.x * DEGREES_TO_RADIANS, yaw = rotation.y * DEGREES_TO_RADIANS;
+		const auto sp = std::sin(pitch), cp = std::cos(pitch);
+		const auto sy = std::sin(yaw), cy = std::cos(yaw);
+
+		// Columns of yaw * pitch, what glm gets multiplying the two rotations
+		const glm::vec3 axes[3] = {
+			{ cy, 0.f, -sy },
+			{ sy * sp, cp, cy * sp },
+			{ sy * cp, -sp, cy * cp }
+		};
+
+		for (auto axis = 0; axis < 3; axis++) {
+			world[axis] = glm::vec4(axes[axis] * scale[axis], 0.f);
+			if (normal) {
+				(*normal)[axis] = axes[axis] / scale[axis];
+			}
+		}
+		world[3] = glm::vec4(position, 1.f);
+	}
+
+	void inverse_transpose_one(const glm::mat4& matrix, glm::mat3& out) {
+		const glm::vec3 a(matrix[0]), b(matrix[1]), c(matrix[2]);
+
+		// The inverse transpose's columns are the cross products of the other two over the determinant
+		const auto bc = glm::cross(b, c), ca = glm::cross(c, a), ab = glm::cross(a, b);
+		const auto inverse = 1.f / (a.x * bc.x + a.y * bc.y + a.z * bc.z);
+		out[0] = bc * inverse;
+		out[1] = ca * inverse;
+		out[2] = ab * inverse;
+	}
+
+	void store_bounds(const aabb_t& box, culling::bounds_t& out, const size_t slot) {
+		out.centerX[slot] = box.center.x;
+		out.centerY[slot] = box.center.y;
+		out.centerZ[slot] = box.center.z;
+		out.extentX[slot] = box.extent.x;
+		out.extentY[slot] = box.extent.y;
+		out.extentZ[slot] = box.extent.z;
+	}
+
+	void compose_scalar(const glm::vec3* positions, const glm::vec2* rotations, const glm::vec3* scales, const size_t count, glm::mat4* worlds, glm::mat3* normals) {
+		for (size_t i = 0; i < count; i++) {
+			compose_one(positions[i], rotations[i], scales[i], worlds[i], normals ? normals + i : nullptr);
+		}
+	}
+
+	void multiply_scalar(const glm::mat4* a, const glm::mat4* b, const size_t count, glm::mat4* out) {
+		for (size_t i = 0; i < count; i++) {
+			out[i] = a[i] * b[i];
+		}
+	}
+
+	void inverse_transpose_scalar(const glm::mat4* matrices, const size_t count, glm::mat3* out) {
+		for (size_t i = 0; i < count; i++) {
+			inverse_transpose_one(matrices[i], out[i]);
+		}
+	}
+
+	void transform_bounds_scalar(const aabb_t* boxes, const glm::mat4* matrices, const size_t count, culling::bounds_t& out, const size_t first) {
+		for (size_t i = 0; i < count; i++) {
+			store_bounds(culling::transform(boxes[i], matrices[i]), out, first + i);
+		}
+	}
+
+#if defined(CPU_FEATURES_X86)
+	// Tails go through the vector kernels too, padded with copies of the last object, so an object
+	// comes out with the same bits wherever the edge of a batch falls
+	template<size_t WIDTH, typename Kernel>
+	void compose_tail(Kernel kernel, const glm::vec3* positions, const glm::vec2* rotations, const glm::vec3* scales, const size_t count, glm::mat4* worlds, glm::mat3* normals) {
+		glm::vec3 p[WIDTH], s[WIDTH];
+		glm::vec2 r[WIDTH];
+		glm::mat4 w[WIDTH];
+		glm::mat3 n[WIDTH];
+		for (size_t k = 0; k < WIDTH; k++) {
+			const auto from = k < count ? k : count - 1;
+			p[k] = positions[from];
+			r[k] = rotations[from];
+			s[k] = scales[from];
+		}
+		kernel(p, r, s, WIDTH, w, normals ? n : nullptr);
+		for (size_t k = 0; k < count; k++) {
+			worlds[k] = w[k];
+			if (normals) {
+				normals[k] = n[k];
+			}
+		}
+	}
+
+	template<size_t WIDTH, typename Kernel>
+	void inverse_transpose_tail(Kernel kernel, const glm::mat4* matrices, const size_t count, glm::mat3* out) {
+		glm::mat4 m[WIDTH];
+		glm::mat3 o[WIDTH];
+		for (size_t k = 0; k < WIDTH; k++) {
+			m[k] = matrices[k < count ? k : count - 1];
+		}
+		kernel(m, WIDTH, o);
+		for (size_t k = 0; k < count; k++) {
+			out[k] = o[k];
+		}
+	}
+
+	// The bounds kernels write lanes through centers[3] and extents[3], starting at offset
+	template<size_t WIDTH, typename Kernel>
+	void transform_bounds_tail(Kernel kernel, const aabb_t* boxes, const glm::mat4* matrices, const size_t count, float* const* centers, float* const* extents, const size_t offset) {
+		aabb_t b[WIDTH];
+		glm::mat4 m[WIDTH];
+		float c[3][WIDTH], e[3][WIDTH];
+		for (size_t k = 0; k < WIDTH; k++) {
+			const auto from = k < count ? k : count - 1;
+			b[k] = boxes[from];
+			m[k] = matrices[from];
+		}
+		float* lanesC[3] = { c[0], c[1], c[2] };
+		float* lanesE[3] = { e[0], e[1], e[2] };
+		kernel(b, m, WIDTH, lanesC, lanesE, 0);
+		for (auto row = 0; row < 3; row++) {
+			for (size_t k = 0; k < count; k++) {
+				centers[row][offset + k] = c[row][k];
+				extents[row][offset + k] = e[row][k];
+			}
+		}
+	}
+
+	// Cephes single precision sine and cosine, good to a couple of ulp for angles up to a few thousand radians
+	constexpr float FOUR_OVER_PI = 1.27323954473516f;
+	constexpr float DP1 = 0.78515625f, DP2 = 2.4187564849853515625e-4f, DP3 = 3.77489497744594108e-8f;
+	constexpr float SIN_P0 = -1.9515295891e-4f, SIN_P1 = 8.3321608736e-3f, SIN_P2 = -1.6666654611e-1f;
+	constexpr float COS_P0 = 2.443315711809948e-5f, COS_P1 = -1.388731625493765e-3f, COS_P2 = 4.166664568298827e-2f;
+
+	TARGET_SSE41 void sincos_sse4(__m128 x, __m128& sine, __m128& cosine) {
+		const auto signMask = _mm_set1_ps(-0.f);
+		auto sinSign = _mm_and_ps(x, signMask);
+		x = _mm_andnot_ps(signMask, x);
+
+		// Octant, rounded up to even, and the angle reduced into [-pi/4, pi/4]
+		auto j = _mm_cvttps_epi32(_mm_mul_ps(x, _mm_set1_ps(FOUR_OVER_PI)));
+		j = _mm_and_si128(_mm_add_epi32(j, _mm_set1_epi32(1)), _mm_set1_epi32(~1));
+		const auto y = _mm_cvtepi32_ps(j);
+		x = _mm_sub_ps(_mm_sub_ps(_mm_sub_ps(x, _mm_mul_ps(y, _mm_set1_ps(DP1))), _mm_mul_ps(y, _mm_set1_ps(DP2))), _mm_mul_ps(y, _mm_set1_ps(DP3)));
+
+		sinSign = _mm_xor_ps(sinSign, _mm_castsi128_ps(_mm_slli_epi32(_mm_and_si128(j, _mm_set1_epi32(4)), 29)));
+		const auto cosSign = _mm_castsi128_ps(_mm_slli_epi32(_mm_andnot_si128(_mm_sub_epi32(j, _mm_set1_epi32(2)), _mm_set1_epi32(4)), 29));
+		const auto swap = _mm_castsi128_ps(_mm_cmpeq_epi32(_mm_and_si128(j, _mm_set1_epi32(2)), _mm_set1_epi32(2)));
+
+		const auto z = _mm_mul_ps(x, x);
+		auto c = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(COS_P0), z), _mm_set1_ps(COS_P1));
+		c = _mm_add_ps(_mm_mul_ps(c, z), _mm_set1_ps(COS_P2));
+		c = _mm_sub_ps(_mm_mul_ps(_mm_mul_ps(c, z), z), _mm_mul_ps(z, _mm_set1_ps(0.5f)));
+		c = _mm_add_ps(c, _mm_set1_ps(1.f));
+		auto s = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(SIN_P0), z), _mm_set1_ps(SIN_P1));
+		s = _mm_add_ps(_mm_mul_ps(s, z), _mm_set1_ps(SIN_P2));
+		s = _mm_add_ps(_mm_mul_ps(_mm_mul_ps(s, z), x), x);
+
+		// Octants 2 and 3 mod 4 swap the two polynomials
+		sine = _mm_xor_ps(_mm_blendv_ps(s, c, swap), sinSign);
+		cosine = _mm_xor_ps(_mm_blendv_ps(c, s, swap), cosSign);
+	}
+
+	// Element (column, row) of four matrices
+	TARGET_SSE41 __m128 gather_sse4(const glm::mat4* m, const int column, const int row) {
+		return _mm_setr_ps(m[0][column][row], m[1][column][row], m[2][column][row], m[3][column][row]);
+	}
+
+	TARGET_SSE41 void cross_sse4(const __m128 ux, const __m128 uy, const __m128 uz, const __m128 vx, const __m128 vy, const __m128 vz, __m128* result) {
+		result[0] = _mm_sub_ps(_mm_mul_ps(uy, vz), _mm_mul_ps(vy, uz));
+		result[1] = _mm_sub_ps(_mm_mul_ps(uz, vx), _mm_mul_ps(vz, ux));
+		result[2] = _mm_sub_ps(_mm_mul_ps(ux, vy), _mm_mul_ps(vx, uy));
+	}
+
+	TARGET_SSE41 void compose_sse4(const glm::vec3* positions, const glm::vec2* rotations, const glm::vec3* scales, const size_t count, glm::mat4* worlds, glm::mat3* normals) {
+		const auto zero = _mm_setzero_ps(), one = _mm_set1_ps(1.f), toRadians = _mm_set1_ps(DEGREES_TO_RADIANS);
+		const auto signMask = _mm_set1_ps(-0.f);
+
+		size_t i = 0;
+		for (; i + 4 <= count; i += 4) {
+			const auto* p = positions + i;
+			const auto* r = rotations + i;
+			const auto* sc = scales + i;
+			const auto px = _mm_setr_ps(p[0].x, p[1].x, p[2].x, p[3].x);
+			const auto py = _mm_setr_ps(p[0].y, p[1].y, p[2].y, p[3].y);
+			const auto pz = _mm_setr_ps(p[0].z, p[1].z, p[2].z, p[3].z);
+			const auto sx = _mm_setr_ps(sc[0].x, sc[1].x, sc[2].x, sc[3].x);
+			const auto sy = _mm_setr_ps(sc[0].y, sc[1].y, sc[2].y, sc[3].y);
+			const auto sz = _mm_setr_ps(sc[0].z, sc[1].z, sc[2].z, sc[3].z);
+
+			__m128 sinPitch, cosPitch, sinYaw, cosYaw;
+			sincos_sse4(_mm_mul_ps(_mm_setr_ps(r[0].x, r[1].x, r[2].x, r[3].x), toRadians), sinPitch, cosPitch);
+			sincos_sse4(_mm_mul_ps(_mm_setr_ps(r[0].y, r[1].y, r[2].y, r[3].y), toRadians), sinYaw, cosYaw);
+
+			// Same axes as compose_one, one lane per object
+			const __m128 axes[9] = {
+				cosYaw, zero, _mm_xor_ps(sinYaw, signMask),
+				_mm_mul_ps(sinYaw, sinPitch), cosPitch, _mm_mul_ps(cosYaw, sinPitch),
+				_mm_mul_ps(sinYaw, cosPitch), _mm_xor_ps(sinPitch, signMask), _mm_mul_ps(cosYaw, cosPitch)
+			};
+			const __m128 scale[3] = { sx, sy, sz };
+
+			for (auto column = 0; column < 3; column++) {
+				auto x = _mm_mul_ps(axes[column * 3], scale[column]);
+				auto y = _mm_mul_ps(axes[column * 3 + 1], scale[column]);
+				auto z = _mm_mul_ps(axes[column * 3 + 2], scale[column]);
+				auto w = zero;
+				_MM_TRANSPOSE4_PS(x, y, z, w);
+				_mm_storeu_ps(&worlds[i][column][0], x);
+				_mm_storeu_ps(&worlds[i + 1][column][0], y);
+				_mm_storeu_ps(&worlds[i + 2][column][0], z);
+				_mm_storeu_ps(&worlds[i + 3][column][0], w);
+			}
+			auto x = px, y = py, z = pz, w = one;
+			_MM_TRANSPOSE4_PS(x, y, z, w);
+			_mm_storeu_ps(&worlds[i][3][0], x);
+			_mm_storeu_ps(&worlds[i + 1][3][0], y);
+			_mm_storeu_ps(&worlds[i + 2][3][0], z);
+			_mm_storeu_ps(&worlds[i + 3][3][0], w);
+
+			if (normals) {
+				alignas(16) float lanes[9][4];
+				for (auto e = 0; e < 9; e++) {
+					_mm_store_ps(lanes[e], _mm_div_ps(axes[e], scale[e / 3]));
+				}
+				for (auto k = 0; k < 4; k++) {
+					auto* out = &normals[i + k][0][0];
+					for (auto e = 0; e < 9; e++) {
+						out[e] = lanes[e][k];
+					}
+				}
+			}
+		}
+		if (i < count) {
+			compose_tail<4>(compose_sse4, positions + i, rotations + i, scales + i, count - i, worlds + i, normals ? normals + i : nullptr);
+		}
+	}
+
+	TARGET_SSE41 void multiply_sse4(const glm::mat4* a, const glm::mat4* b, const size_t count, glm::mat4* out) {
+		for (size_t i = 0; i < count; i++) {
+			const auto a0 = _mm_loadu_ps(&a[i][0][0]), a1 = _mm_loadu_ps(&a[i][1][0]);
+			const auto a2 = _mm_loadu_ps(&a[i][2][0]), a3 = _mm_loadu_ps(&a[i][3][0]);
+			__m128 columns[4];
+			for (auto j = 0; j < 4; j++) {
+				const auto column = _mm_loadu_ps(&b[i][j][0]);
+				columns[j] = _mm_add_ps(_mm_add_ps(_mm_add_ps(
+					_mm_mul_ps(a0, _mm_shuffle_ps(column, column, 0x00)),
+					_mm_mul_ps(a1, _mm_shuffle_ps(column, column, 0x55))),
+					_mm_mul_ps(a2, _mm_shuffle_ps(column, column, 0xAA))),
+					_mm_mul_ps(a3, _mm_shuffle_ps(column, column, 0xFF)));
+			}
+			for (auto j = 0; j < 4; j++) {
+				_mm_storeu_ps(&out[i][j][0], columns[j]);
+			}
+		}
+	}
+
+	TARGET_SSE41 void inverse_transpose_sse4(const glm::mat4* matrices, const size_t count, glm::mat3* out) {
+		size_t i = 0;
+		for (; i + 4 <= count; i += 4) {
+			const auto* m = matrices + i;
+			const auto ax = gather_sse4(m, 0, 0), ay = gather_sse4(m, 0, 1), az = gather_sse4(m, 0, 2);
+			const auto bx = gather_sse4(m, 1, 0), by = gather_sse4(m, 1, 1), bz = gather_sse4(m, 1, 2);
+			const auto cx = gather_sse4(m, 2, 0), cy = gather_sse4(m, 2, 1), cz = gather_sse4(m, 2, 2);
+
+			__m128 columns[9];
+			cross_sse4(bx, by, bz, cx, cy, cz, columns);
+			cross_sse4(cx, cy, cz, ax, ay, az, columns + 3);
+			cross_sse4(ax, ay, az, bx, by, bz, columns + 6);
+
+			const auto determinant = _mm_add_ps(_mm_add_ps(_mm_mul_ps(ax, columns[0]), _mm_mul_ps(ay, columns[1])), _mm_mul_ps(az, columns[2]));
+			const auto inverse = _mm_div_ps(_mm_set1_ps(1.f), determinant);
+
+			alignas(16) float lanes[9][4];
+			for (auto e = 0; e < 9; e++) {
+				_mm_store_ps(lanes[e], _mm_mul_ps(columns[e], inverse));
+			}
+			for (auto k = 0; k < 4; k++) {
+				auto* o = &out[i + k][0][0];
+				for (auto e = 0; e < 9; e++) {
+					o[e] = lanes[e][k];
+				}
+			}
+		}
+		if (i < count) {
+			inverse_transpose_tail<4>(inverse_transpose_sse4, matrices + i, count - i, out + i);
+		}
+	}
+
+	TARGET_SSE41 void bounds_sse4(const aabb_t* boxes, const glm::mat4* matrices, const size_t count, float* const* centers, float* const* extents, const size_t first) {
+		const auto signMask = _mm_set1_ps(-0.f);
+
+		size_t i = 0;
+		for (; i + 4 <= count; i += 4) {
+			const auto* m = matrices + i;
+			const auto* b = boxes + i;
+			const __m128 center[3] = {
+				_mm_setr_ps(b[0].center.x, b[1].center.x, b[2].center.x, b[3].center.x),
+				_mm_setr_ps(b[0].center.y, b[1].center.y, b[2].center.y, b[3].center.y),
+				_mm_setr_ps(b[0].center.z, b[1].center.z, b[2].center.z, b[3].center.z)
+			};
+			const __m128 extent[3] = {
+				_mm_setr_ps(b[0].extent.x, b[1].extent.x, b[2].extent.x, b[3].extent.x),
+				_mm_setr_ps(b[0].extent.y, b[1].extent.y, b[2].extent.y, b[3].extent.y),
+				_mm_setr_ps(b[0].extent.z, b[1].extent.z, b[2].extent.z, b[3].extent.z)
+			};
+
+			for (auto row = 0; row < 3; row++) {
+				const auto m0 = gather_sse4(m, 0, row), m1 = gather_sse4(m, 1, row), m2 = gather_sse4(m, 2, row), m3 = gather_sse4(m, 3, row);
+
+				// Grouped the way glm's matrix * vector products add up
+				const auto c = _mm_add_ps(_mm_add_ps(_mm_mul_ps(m0, center[0]), _mm_mul_ps(m1, center[1])), _mm_add_ps(_mm_mul_ps(m2, center[2]), m3));
+				const auto e = _mm_add_ps(_mm_add_ps(_mm_mul_ps(_mm_andnot_ps(signMask, m0), extent[0]), _mm_mul_ps(_mm_andnot_ps(signMask, m1), extent[1])),
+					_mm_mul_ps(_mm_andnot_ps(signMask, m2), extent[2]));
+				_mm_storeu_ps(centers[row] + first + i, c);
+				_mm_storeu_ps(extents[row] + first + i, e);
+			}
+		}
+		if (i < count) {
+			transform_bounds_tail<4>(bounds_sse4, boxes + i, matrices + i, count - i, centers, extents, first + i);
+		}
+	}
+
+	TARGET_SSE41 void transform_bounds_sse4(const aabb_t* boxes, const glm::mat4* matrices, const size_t count, culling::bounds_t& out, const size_t first) {
+		float* const centers[3] = { out.centerX.data(), out.centerY.data(), out.centerZ.data() };
+		float* const extents[3] = { out.extentX.data(), out.extentY.data(), out.extentZ.data() };
+		bounds_sse4(boxes, matrices, count, centers, extents, first);
+	}
+
+	TARGET_AVX2_FMA void sincos_avx2(__m256 x, __m256& sine, __m256& cosine) {
+		const auto signMask = _mm256_set1_ps(-0.f);
+		auto sinSign = _mm256_and_ps(x, signMask);
+		x = _mm256_andnot_ps(signMask, x);
+
+		auto j = _mm256_cvttps_epi32(_mm256_mul_ps(x, _mm256_set1_ps(FOUR_OVER_PI)));
+		j = _mm256_and_si256(_mm256_add_epi32(j, _mm256_set1_epi32(1)), _mm256_set1_epi32(~1));
+		const auto y = _mm256_cvtepi32_ps(j);
+		x = _mm256_fnmadd_ps(y, _mm256_set1_ps(DP3), _mm256_fnmadd_ps(y, _mm256_set1_ps(DP2), _mm256_fnmadd_ps(y, _mm256_set1_ps(DP1), x)));
+
+		sinSign = _mm256_xor_ps(sinSign, _mm256_castsi256_ps(_mm256_slli_epi32(_mm256_and_si256(j, _mm256_set1_epi32(4)), 29)));
+		const auto cosSign = _mm256_castsi256_ps(_mm256_slli_epi32(_mm256_andnot_si256(_mm256_sub_epi32(j, _mm256_set1_epi32(2)), _mm256_set1_epi32(4)), 29));
+		const auto swap = _mm256_castsi256_ps(_mm256_cmpeq_epi32(_mm256_and_si256(j, _mm256_set1_epi32(2)), _mm256_set1_epi32(2)));
+
+		const auto z = _mm256_mul_ps(x, x);
+		auto c = _mm256_fmadd_ps(_mm256_set1_ps(COS_P0), z, _mm256_set1_ps(COS_P1));
+		c = _mm256_fmadd_ps(c, z, _mm256_set1_ps(COS_P2));
+		c = _mm256_fmsub_ps(_mm256_mul_ps(c, z), z, _mm256_mul_ps(z, _mm256_set1_ps(0.5f)));
+		c = _mm256_add_ps(c, _mm256_set1_ps(1.f));
+		auto s = _mm256_fmadd_ps(_mm256_set1_ps(SIN_P0), z, _mm256_set1_ps(SIN_P1));
+		s = _mm256_fmadd_ps(s, z, _mm256_set1_ps(SIN_P2));
+		s = _mm256_fmadd_ps(_mm256_mul_ps(s, z), x, x);
+
+		sine = _mm256_xor_ps(_mm256_blendv_ps(s, c, swap), sinSign);
+		cosine = _mm256_xor_ps(_mm256_blendv_ps(c, s, swap), cosSign);
+	}
+
+	// Rows become columns, so eight lanes of eight elements become eight objects' floats in a row
+	TARGET_AVX2_FMA void transpose8(__m256* r) {
+		const auto t0 = _mm256_unpacklo_ps(r[0], r[1]), t1 = _mm256_unpackhi_ps(r[0], r[1]);
+		const auto t2 = _mm256_unpacklo_ps(r[2], r[3]), t3 = _mm256_unpackhi_ps(r[2], r[3]);
+		const auto t4 = _mm256_unpacklo_ps(r[4], r[5]), t5 = _mm256_unpackhi_ps(r[4], r[5]);
+		const auto t6 = _mm256_unpacklo_ps(r[6], r[7]), t7 = _mm256_unpackhi_ps(r[6], r[7]);
+		const auto u0 = _mm256_shuffle_ps(t0, t2, 0x44), u1 = _mm256_shuffle_ps(t0, t2, 0xEE);
+		const auto u2 = _mm256_shuffle_ps(t1, t3, 0x44), u3 = _mm256_shuffle_ps(t1, t3, 0xEE);
+		const auto u4 = _mm256_shuffle_ps(t4, t6, 0x44), u5 = _mm256_shuffle_ps(t4, t6, 0xEE);
+		const auto u6 = _mm256_shuffle_ps(t5, t7, 0x44), u7 = _mm256_shuffle_ps(t5, t7, 0xEE);
+		r[0] = _mm256_permute2f128_ps(u0, u4, 0x20);
+		r[1] = _mm256_permute2f128_ps(u1, u5, 0x20);
+		r[2] = _mm256_permute2f128_ps(u2, u6, 0x20);
+		r[3] = _mm256_permute2f128_ps(u3, u7, 0x20);
+		r[4] = _mm256_permute2f128_ps(u0, u4, 0x31);
+		r[5] = _mm256_permute2f128_ps(u1, u5, 0x31);
+		r[6] = _mm256_permute2f128_ps(u2, u6, 0x31);
+		r[7] = _mm256_permute2f128_ps(u3, u7, 0x31);
+	}
+
+	TARGET_AVX2_FMA void cross_avx2(const __m256 ux, const __m256 uy, const __m256 uz, const __m256 vx, const __m256 vy, const __m256 vz, __m256* result) {
+		result[0] = _mm256_fmsub_ps(uy, vz, _mm256_mul_ps(vy, uz));
+		result[1] = _mm256_fmsub_ps(uz, vx, _mm256_mul_ps(vz, ux));
+		result[2] = _mm256_fmsub_ps(ux, vy, _mm256_mul_ps(vx, uy));
+	}
+
+	// Two columns of a * b, with a's columns in both halves
+	TARGET_AVX2_FMA __m256 product_avx2(const __m256* a, const __m256 columns) {
+		auto result = _mm256_mul_ps(a[0], _mm256_permute_ps(columns, 0x00));
+		result = _mm256_fmadd_ps(a[1], _mm256_permute_ps(columns, 0x55), result);
+		result = _mm256_fmadd_ps(a[2], _mm256_permute_ps(columns, 0xAA), result);
+		return _mm256_fmadd_ps(a[3], _mm256_permute_ps(columns, 0xFF), result);
+	}
+
+	TARGET_AVX2_FMA void compose_avx2(const glm::vec3* positions, const glm::vec2* rotations, const glm::vec3* scales, const size_t count, glm::mat4* worlds, glm::mat3* normals) {
+		const auto zero = _mm256_setzero_ps(), one = _mm256_set1_ps(1.f), toRadians = _mm256_set1_ps(DEGREES_TO_RADIANS);
+		const auto signMask = _mm256_set1_ps(-0.f);
+		const auto stride3 = _mm256_setr_epi32(0, 3, 6, 9, 12, 15, 18, 21);
+		const auto stride2 = _mm256_setr_epi32(0, 2, 4, 6, 8, 10, 12, 14);
+
+		size_t i = 0;
+		for (; i + 8 <= count; i += 8) {
+			const auto* p = &positions[i].x;
+			const auto* r = &rotations[i].x;
+			const auto* sc = &scales[i].x;
+			const __m256 scale[3] = { _mm256_i32gather_ps(sc, stride3, 4), _mm256_i32gather_ps(sc + 1, stride3, 4), _mm256_i32gather_ps(sc + 2, stride3, 4) };
+
+			__m256 sinPitch, cosPitch, sinYaw, cosYaw;
+			sincos_avx2(_mm256_mul_ps(_mm256_i32gather_ps(r, stride2, 4), toRadians), sinPitch, cosPitch);
+			sincos_avx2(_mm256_mul_ps(_mm256_i32gather_ps(r + 1, stride2, 4), toRadians), sinYaw, cosYaw);
+
+			const __m256 axes[9] = {
+				cosYaw, zero, _mm256_xor_ps(sinYaw, signMask),
+				_mm256_mul_ps(sinYaw, sinPitch), cosPitch, _mm256_mul_ps(cosYaw, sinPitch),
+				_mm256_mul_ps(sinYaw, cosPitch), _mm256_xor_ps(sinPitch, signMask), _mm256_mul_ps(cosYaw, cosPitch)
+			};
+
+			// Sixteen elements, column major, then each half transposed into eight objects' floats
+			__m256 elements[16];
+			for (auto column = 0; column < 3; column++) {
+				for (auto row = 0; row < 3; row++) {
+					elements[column * 4 + row] = _mm256_mul_ps(axes[column * 3 + row], scale[column]);
+				}
+				elements[column * 4 + 3] = zero;
+			}
+			elements[12] = _mm256_i32gather_ps(p, stride3, 4);
+			elements[13] = _mm256_i32gather_ps(p + 1, stride3, 4);
+			elements[14] = _mm256_i32gather_ps(p + 2, stride3, 4);
+			elements[15] = one;
+
+			transpose8(elements);
+			transpose8(elements + 8);
+			for (auto k = 0; k < 8; k++) {
+				_mm256_storeu_ps(&worlds[i + k][0][0], elements[k]);
+				_mm256_storeu_ps(&worlds[i + k][2][0], elements[k + 8]);
+			}
+
+			if (normals) {
+				alignas(32) float lanes[9][8];
+				for (auto e = 0; e < 9; e++) {
+					_mm256_store_ps(lanes[e], _mm256_div_ps(axes[e], scale[e / 3]));
+				}
+				for (auto k = 0; k < 8; k++) {
+					auto* out = &normals[i + k][0][0];
+					for (auto e = 0; e < 9; e++) {
+						out[e] = lanes[e][k];
+					}
+				}
+			}
+		}
+		if (i < count) {
+			compose_tail<8>(compose_avx2, positions + i, rotations + i, scales + i, count - i, worlds + i, normals ? normals + i : nullptr);
+		}
+	}
+
+	TARGET_AVX2_FMA void multiply_avx2(const glm::mat4* a, const glm::mat4* b, const size_t count, glm::mat4* out) {
+		for (size_t i = 0; i < count; i++) {
+			const __m256 columns[4] = {
+				_mm256_broadcast_ps(reinterpret_cast<const __m128*>(&a[i][0][0])),
+				_mm256_broadcast_ps(reinterpret_cast<const __m128*>(&a[i][1][0])),
+				_mm256_broadcast_ps(reinterpret_cast<const __m128*>(&a[i][2][0])),
+				_mm256_broadcast_ps(reinterpret_cast<const __m128*>(&a[i][3][0]))
+			};
+			const auto out01 = product_avx2(columns, _mm256_loadu_ps(&b[i][0][0]));
+			const auto out23 = product_avx2(columns, _mm256_loadu_ps(&b[i][2][0]));
+			_mm256_storeu_ps(&out[i][0][0], out01);
+			_mm256_storeu_ps(&out[i][2][0], out23);
+		}
+	}
+
+	TARGET_AVX2_FMA void inverse_transpose_avx2(const glm::mat4* matrices, const size_t count, glm::mat3* out) {
+		const auto stride16 = _mm256_setr_epi32(0, 16, 32, 48, 64, 80, 96, 112);
+
+		size_t i = 0;
+		for (; i + 8 <= count; i += 8) {
+			// Element (column, row) of eight matrices is m[column * 4 + row + 16 * lane]
+			const auto* m = &matrices[i][0][0];
+			const auto ax = _mm256_i32gather_ps(m, stride16, 4), ay = _mm256_i32gather_ps(m + 1, stride16, 4), az = _mm256_i32gather_ps(m + 2, stride16, 4);
+			const auto bx = _mm256_i32gather_ps(m + 4, stride16, 4), by = _mm256_i32gather_ps(m + 5, stride16, 4), bz = _mm256_i32gather_ps(m + 6, stride16, 4);
+			const auto cx = _mm256_i32gather_ps(m + 8, stride16, 4), cy = _mm256_i32gather_ps(m + 9, stride16, 4), cz = _mm256_i32gather_ps(m + 10, stride16, 4);
+
+			__m256 columns[9];
+			cross_avx2(bx, by, bz, cx, cy, cz, columns);
+			cross_avx2(cx, cy, cz, ax, ay, az, columns + 3);
+			cross_avx2(ax, ay, az, bx, by, bz, columns + 6);
+
+			const auto determinant = _mm256_fmadd_ps(az, columns[2], _mm256_fmadd_ps(ay, columns[1], _mm256_mul_ps(ax, columns[0])));
+			const auto inverse = _mm256_div_ps(_mm256_set1_ps(1.f), determinant);
+
+			alignas(32) float lanes[9][8];
+			for (auto e = 0; e < 9; e++) {
+				_mm256_store_ps(lanes[e], _mm256_mul_ps(columns[e], inverse));
+			}
+			for (auto k = 0; k < 8; k++) {
+				auto* o = &out[i + k][0][0];
+				for (auto e = 0; e < 9; e++) {
+					o[e] = lanes[e][k];
+				}
+			}
+		}
+		if (i < count) {
+			inverse_transpose_tail<8>(inverse_transpose_avx2, matrices + i, count - i, out + i);
+		}
+	}
+
+	TARGET_AVX2_FMA void bounds_avx2(const aabb_t* boxes, const glm::mat4* matrices, const size_t count, float* const* centers, float* const* extents, const size_t first) {
+		const auto signMask = _mm256_set1_ps(-0.f);
+		const auto stride16 = _mm256_setr_epi32(0, 16, 32, 48, 64, 80, 96, 112);
+		const auto stride6 = _mm256_setr_epi32(0, 6, 12, 18, 24, 30, 36, 42);
+
+		size_t i = 0;
+		for (; i + 8 <= count; i += 8) {
+			const auto* m = &matrices[i][0][0];
+			const auto* b = &boxes[i].center.x;
+			const __m256 center[3] = { _mm256_i32gather_ps(b, stride6, 4), _mm256_i32gather_ps(b + 1, stride6, 4), _mm256_i32gather_ps(b + 2, stride6, 4) };
+			const __m256 extent[3] = { _mm256_i32gather_ps(b + 3, stride6, 4), _mm256_i32gather_ps(b + 4, stride6, 4), _mm256_i32gather_ps(b + 5, stride6, 4) };
+
+			for (auto row = 0; row < 3; row++) {
+				const auto m0 = _mm256_i32gather_ps(m + row, stride16, 4), m1 = _mm256_i32gather_ps(m + 4 + row, stride16, 4);
+				const auto m2 = _mm256_i32gather_ps(m + 8 + row, stride16, 4), m3 = _mm256_i32gather_ps(m + 12 + row, stride16, 4);
+
+				const auto c = _mm256_fmadd_ps(m2, center[2], _mm256_fmadd_ps(m1, center[1], _mm256_fmadd_ps(m0, center[0], m3)));
+				const auto e = _mm256_fmadd_ps(_mm256_andnot_ps(signMask, m2), extent[2],
+					_mm256_fmadd_ps(_mm256_andnot_ps(signMask, m1), extent[1], _mm256_mul_ps(_mm256_andnot_ps(signMask, m0), extent[0])));
+				_mm256_storeu_ps(centers[row] + first + i, c);
+				_mm256_storeu_ps(extents[row] + first + i, e);
+			}
+		}
+		if (i < count) {
+			transform_bounds_tail<8>(bounds_avx2, boxes + i, matrices + i, count - i, centers, extents, first + i);
+		}
+	}
+
+	TARGET_AVX2_FMA void transform_bounds_avx2(const aabb_t* boxes, const glm::mat4* matrices, const size_t count, culling::bounds_t& out, const size_t first) {
+		float* const centers[3] = { out.centerX.data(), out.centerY.data(), out.centerZ.data() };
+		float* const extents[3] = { out.extentX.data(), out.extentY.data(), out.extentZ.data() };
+		bounds_avx2(boxes, matrices, count, centers, extents, first);
+	}
+#endif
+
+	struct kernels_t {
+		batch_math::kernel name;
+		void (*compose)(const glm::vec3*, const glm::vec2*, const glm::vec3*, size_t, glm::mat4*, glm::mat3*);
+		void (*multiply)(const glm::mat4*, const glm::mat4*, size_t, glm::mat4*);
+		void (*inverse_transpose)(const glm::mat4*, size_t, glm::mat3*);
+		void (*transform_bounds)(const aabb_t*, const glm::mat4*, size_t, culling::bounds_t&, size_t);
+	};
+
+	const kernels_t& pick() {
+		static const kernels_t scalar{ batch_math::kernel::scalar, compose_scalar, multiply_scalar, inverse_transpose_scalar, transform_bounds_scalar };
+#if defined(CPU_FEATURES_X86)
+		static const kernels_t sse4{ batch_math::kernel::sse4, compose_sse4, multiply_sse4, inverse_transpose_sse4, transform_bounds_sse4 };
+		static const kernels_t avx2{ batch_math::kernel::avx2, compose_avx2, multiply_avx2, inverse_transpose_avx2, transform_bounds_avx2 };
+
+		const auto wanted = selectedKernel;
+		if ((wanted == batch_math::kernel::automatic || wanted == batch_math::kernel::avx2) && cpu_features::has_avx2() && cpu_features::has_fma()) {
+			return avx2;
+		}
+		if (wanted != batch_math::kernel::scalar && cpu_features::has_sse41()) {
+			return sse4;
+		}
+#endif
+		return scalar;
+	}
+}
+
+namespace batch_math {
+	void set_kernel(const kernel selected) {
+		selectedKernel = selected;
+	}
+
+	kernel get_kernel() {
+		return pick().name;
+	}
+
+	void compose_trs(const glm::vec3* positions, const glm::vec2* rotations, const glm::vec3* scales, const size_t count, glm::mat4* worlds, glm::mat3* normals) {
+		pick().compose(positions, rotations, scales, count, worlds, normals);
+	}
+
+	void multiply(const glm::mat4* a, const glm::mat4* b, const size_t count, glm::mat4* out) {
+		pick().multiply(a, b, count, out);
+	}
+
+	void inverse_transpose(const glm::mat4* matrices, const size_t count, glm::mat3* out) {
+		pick().inverse_transpose(matrices, count, out);
+	}
+
+	void transform_bounds(const aabb_t* boxes, const glm::mat4* matrices, const size_t count, culling::bounds_t& out, const size_t first) {
+		pick().transform_bounds(boxes, matrices, count, out, first);
+	}
+}
@@ -0,0 +1,46 @@
+#ifndef BATCH_MATH_H
+#define BATCH_MATH_H
+#include <cstddef>
+#include "glm/glm.hpp"
+#include "culling.h"
+
+// Transform math over arrays of objects at once
+//
+// Each function has a scalar, an SSE4.1 and an AVX2 with FMA kernel, picked at runtime from
+// what the CPU supports. The rotations are written out instead of multiplied, and the vector
+// kernels evaluate sine and cosine with a polynomial and the AVX2 one fuses multiply-adds,
+// so results can differ from glm's in the last bits (bench/batch_math_bench checks how much)
+namespace batch_math {
+	enum class kernel {
+		// The widest the CPU supports
+		automatic,
+		scalar,
+		sse4,
+		avx2
+	};
+
+	// Mostly for benchmarks, an unsupported kernel falls back to the next narrower one
+	void set_kernel(kernel selected);
+
+	// The kernel the functions below currently run
+	[[nodiscard]]
+	kernel get_kernel();
+
+	// World matrices built like model::get_transform, scale then pitch about x, yaw about y,
+	// then translation. Rotations are pitch and yaw in degrees
+	// normals gets the matching normal matrices when it is not null, rotation over scale
+	void compose_trs(const glm::vec3* positions, const glm::vec2* rotations, const glm::vec3* scales, size_t count,
+		glm::mat4* worlds, glm::mat3* normals);
+
+	// out[i] = a[i] * b[i], out may alias either input
+	void multiply(const glm::mat4* a, const glm::mat4* b, size_t count, glm::mat4* out);
+
+	// Inverse transpose of the upper 3x3 of affine matrices
+	void inverse_transpose(const glm::mat4* matrices, size_t count, glm::mat3* out);
+
+	// The boxes around transformed boxes, like culling::transform, written to out from slot first on
+	// out must already hold first + count boxes
+	void transform_bounds(const aabb_t* boxes, const glm::mat4* matrices, size_t count, culling::bounds_t& out, size_t first);
+}
+
+#endif // BATCH_MATH_H
@@ -0,0 +1,160 @@
+// Batch transform math against per object glm calls
+// Usage: batch_math_bench [iterations] [objects]
+//
+// Every kernel the CPU supports is timed and compared with glm, results have to stay within
+// a relative error of 1e-5 (a few ulp at these magnitudes), matrices relative to their largest element
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <vector>
+
+#include "batch_math.h"
+#include "cpu_features.h"
+#include "glm/gtc/matrix_inverse.hpp"
+#include "glm/gtx/transform.hpp"
+
+namespace {
+	using clock_type = std::chrono::steady_clock;
+
+	constexpr float TOLERANCE = 1e-5f;
+
+	// Average milliseconds per call
+	template<typename F>
+	double measure(const int iterations, F&& work) {
+		work();
+		const auto start = clock_type::now();
+		for (auto i = 0; i < iterations; i++) {
+			work();
+		}
+		return std::chrono::duration<double, std::milli>(clock_type::now() - start).count() / iterations;
+	}
+
+	float error(const float value, const float expected) {
+		return std::abs(value - expected) / std::max(1.f, std::abs(expected));
+	}
+
+	// Relative to the largest element, products that cancel lose digits no matter the kernel
+	template<int N, typename M>
+	float error(const M& value, const M& expected) {
+		auto largest = 1.f, worst = 0.f;
+		for (auto c = 0; c < N; c++) {
+			for (auto r = 0; r < N; r++) {
+				largest = std::max(largest, std::abs(expected[c][r]));
+				worst = std::max(worst, std::abs(value[c][r] - expected[c][r]));
+			}
+		}
+		return worst / largest;
+	}
+
+	glm::mat4 glm_transform(const glm::vec3& position, const glm::vec2& rotation, const glm::vec3& scale) {
+		const auto identity = glm::mat4(1.f);
+		const auto rotate = glm::rotate(identity, glm::radians(rotation.y), glm::vec3{ 0.f, 1.f, 0.f })
+			* glm::rotate(identity, glm::radians(rotation.x), glm::vec3{ 1.f, 0.f, 0.f });
+		return glm::translate(identity, position) * rotate * glm::scale(identity, scale);
+	}
+
+	const char* name(const batch_math::kernel kernel) {
+		switch (kernel) {
+		case batch_math::kernel::sse4:
+			return "sse4";
+		case batch_math::kernel::avx2:
+			return "avx2";
+		default:
+			return "scalar";
+		}
+	}
+}
+
+int main(int argc, char** argv) {
+	const int iterations = argc > 1 ? std::max(1, std::atoi(argv[1])) : 20;
+	const size_t count = argc > 2 ? std::max(1, std::atoi(argv[2])) : 1 << 18;
+
+	std::mt19937 rng{ 42 };
+	std::uniform_real_distribution<float> position{ -500.f, 500.f };
+	std::uniform_real_distribution<float> angle{ -720.f, 720.f };
+	std::uniform_real_distribution<float> size{ 0.25f, 4.f };
+
+	std::vector<glm::vec3> positions(count), scales(count);
+	std::vector<glm::vec2> rotations(count);
+	std::vector<aabb_t> boxes(count);
+	for (size_t i = 0; i < count; i++) {
+		positions[i] = { position(rng), position(rng), position(rng) };
+		rotations[i] = { angle(rng), angle(rng) };
+		scales[i] = { size(rng), size(rng), size(rng) };
+		boxes[i] = { { size(rng), size(rng), size(rng) }, { size(rng), size(rng), size(rng) } };
+	}
+
+	// glm one object at a time, what model::get_transform and inverseTranspose cost
+	std::vector<glm::mat4> expectedWorlds(count), expectedProducts(count);
+	std::vector<glm::mat3> expectedNormals(count);
+	std::vector<aabb_t> expectedBounds(count);
+	const auto glmMs = measure(iterations, [&] {
+		for (size_t i = 0; i < count; i++) {
+			expectedWorlds[i] = glm_transform(positions[i], rotations[i], scales[i]);
+			expectedNormals[i] = glm::inverseTranspose(glm::mat3(expectedWorlds[i]));
+		}
+	});
+	for (size_t i = 0; i < count; i++) {
+		expectedProducts[i] = expectedWorlds[i] * expectedWorlds[count - 1 - i];
+		expectedBounds[i] = culling::transform(boxes[i], expectedWorlds[i]);
+	}
+
+	printf("%zu objects, SSE4.1 %s, AVX2 %s, FMA %s, %d iteration(s)\n", count,
+		cpu_features::has_sse41() ? "yes" : "no", cpu_features::has_avx2() ? "yes" : "no", cpu_features::has_fma() ? "yes" : "no", iterations);
+	printf("%-8s %12s %12s %12s %12s %12s\n", "kernel", "trs+normal", "multiply", "inv.transp", "bounds", "max error");
+	printf("%-8s %12.3f %12s %12s %12s %12s\n", "glm", glmMs, "", "", "", "");
+
+	std::vector<glm::mat4> worlds(count), products(count);
+	std::vector<glm::mat3> normals(count), inverses(count);
+	std::vector<glm::mat4> reversed(expectedWorlds.rbegin(), expectedWorlds.rend());
+	culling::bounds_t bounds;
+	bounds.reserve(count);
+	for (size_t i = 0; i < count; i++) {
+		bounds.push({});
+	}
+
+	auto ok = true;
+	for (const auto kernel : { batch_math::kernel::scalar, batch_math::kernel::sse4, batch_math::kernel::avx2 }) {
+		batch_math::set_kernel(kernel);
+		if (batch_math::get_kernel() != kernel) {
+			continue;
+		}
+
+		const auto composeMs = measure(iterations, [&] {
+			batch_math::compose_trs(positions.data(), rotations.data(), scales.data(), count, worlds.data(), normals.data());
+		});
+		const auto multiplyMs = measure(iterations, [&] {
+			batch_math::multiply(expectedWorlds.data(), reversed.data(), count, products.data());
+		});
+		const auto inverseMs = measure(iterations, [&] {
+			batch_math::inverse_transpose(expectedWorlds.data(), count, inverses.data());
+		});
+		const auto boundsMs = measure(iterations, [&] {
+			batch_math::transform_bounds(boxes.data(), expectedWorlds.data(), count, bounds, 0);
+		});
+
+		auto worst = 0.f;
+		for (size_t i = 0; i < count; i++) {
+			worst = std::max(worst, error<4>(worlds[i], expectedWorlds[i]));
+			worst = std::max(worst, error<3>(normals[i], expectedNormals[i]));
+			worst = std::max(worst, error<4>(products[i], expectedProducts[i]));
+			worst = std::max(worst, error<3>(inverses[i], expectedNormals[i]));
+			for (auto axis = 0; axis < 3; axis++) {
+				const float center[3] = { bounds.centerX[i], bounds.centerY[i], bounds.centerZ[i] };
+				const float extent[3] = { bounds.extentX[i], bounds.extentY[i], bounds.extentZ[i] };
+				worst = std::max(worst, error(center[axis], expectedBounds[i].center[axis]));
+				worst = std::max(worst, error(extent[axis], expectedBounds[i].extent[axis]));
+			}
+		}
+
+		printf("%-8s %12.3f %12.3f %12.3f %12.3f %12.2e %s\n", name(kernel), composeMs, multiplyMs, inverseMs, boundsMs, worst,
+			worst <= TOLERANCE ? "ok" : "MISMATCH");
+		ok &= worst <= TOLERANCE;
+	}
+
+	return ok ? 0 : 1;
+}
@@ -0,0 +1,81 @@
+// Frustum culling throughput over N world space boxes
+// Usage: culling_bench [iterations] [boxes]
+//
+// Boxes are scattered through a cube around a camera that sees roughly a quarter of it.
+// Every kernel and thread count is checked against the single threaded scalar result
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <thread>
+#include <vector>
+
+#include "culling.h"
+#include "cpu_features.h"
+#include "glm/ext/matrix_transform.hpp"
+#include "glm/ext/matrix_clip_space.hpp"
+
+namespace {
+	// Average milliseconds per cull
+	double measure(const frustum_t& frustum, const culling::bounds_t& bounds, std::vector<uint32_t>& visible, const int iterations) {
+		culling::cull(frustum, bounds, visible);
+
+		const auto start = std::chrono::steady_clock::now();
+		for (auto i = 0; i < iterations; i++) {
+			culling::cull(frustum, bounds, visible);
+		}
+		return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count() / iterations;
+	}
+}
+
+int main(int argc, char** argv) {
+	const int iterations = argc > 1 ? std::max(1, std::atoi(argv[1])) : 20;
+	const size_t count = argc > 2 ? std::max(1, std::atoi(argv[2])) : 1000000;
+
+	culling::bounds_t bounds;
+	bounds.reserve(count);
+	std::mt19937 rng{ 42 };
+	std::uniform_real_distribution<float> position{ -500.f, 500.f };
+	std::uniform_real_distribution<float> size{ 0.1f, 2.f };
+	for (size_t i = 0; i < count; i++) {
+		bounds.push({ { position(rng), position(rng), position(rng) }, { size(rng), size(rng), size(rng) } });
+	}
+
+	const auto view = glm::lookAt(glm::vec3(0.f), glm::vec3(0.f, 0.f, -1.f), glm::vec3(0.f, 1.f, 0.f));
+	const auto projection = glm::perspective(glm::radians(90.f), 16.f / 9.f, 0.1f, 1000.f);
+	const auto frustum = culling::extract_frustum(projection * view);
+
+	// Reference result
+	std::vector<uint32_t> expected, visible;
+	culling::set_kernel(culling::kernel::scalar);
+	culling::set_max_threads(1);
+	culling::cull(frustum, bounds, expected);
+
+	const auto hardware = std::max(1u, std::thread::hardware_concurrency());
+	printf("%zu boxes, %zu visible, AVX2 %s, %u hardware thread(s), %d iteration(s)\n",
+		count, expected.size(), cpu_features::has_avx2() ? "available" : "not available", hardware, iterations);
+	printf("%-8s %8s %12s %12s %8s\n", "kernel", "threads", "ms/cull", "ns/box", "result");
+
+	const auto run = [&](const char* name, const culling::kernel kernel, const unsigned int threads) {
+		culling::set_kernel(kernel);
+		culling::set_max_threads(threads);
+		const auto ms = measure(frustum, bounds, visible, iterations);
+		printf("%-8s %8u %12.3f %12.3f %8s\n", name, threads, ms, ms * 1e6 / count, visible == expected ? "ok" : "MISMATCH");
+		return visible == expected;
+	};
+
+	auto ok = true;
+	for (const auto threads : { 1u, hardware }) {
+		ok &= run("scalar", culling::kernel::scalar, threads);
+		if (cpu_features::has_avx2()) {
+			ok &= run("avx2", culling::kernel::avx2, threads);
+		}
+		if (hardware == 1) {
+			break;
+		}
+	}
+
+	return ok ? 0 : 1;
+}
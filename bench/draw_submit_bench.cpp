@@ -0,0 +1,209 @@
+// CPU cost of submitting and flushing N distinct mesh draws through the render queue
+// Usage: draw_submit_bench [frames]
+//
+// Every draw uses its own mesh so nothing is merged by instancing. Three paths are measured:
+//   uniform   - a shader without instance attributes, one uniform upload and draw call per mesh
+//   loop      - instanced shader, one glDrawElementsInstancedBaseVertex per mesh (GL 3.3)
+//   indirect  - instanced shader, one glMultiDrawElementsIndirect for all of them (GL 4.3)
+//   record xN - instanced shader, draws recorded into command buffers on N threads and replayed
+//               into the queue, with the fastest of the two paths above
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <memory>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "window.h"
+#include "shader.h"
+#include "mesh.h"
+#include "model.h"
+#include "render_queue.h"
+#include "command_buffer.h"
+#include "gl_extensions.h"
+#include "frame_data.h"
+#include "object_data.h"
+
+namespace {
+	const char* INSTANCED_VERTEX = R"(#version 330 core
+layout (location = 0) in vec3 aPos;
+layout (location = 5) in uint objectId;
+uniform samplerBuffer objectData;
+out vec4 color;
+void main() {
+    int base = int(objectId) * 8;
+    mat4 model = mat4(texelFetch(objectData, base), texelFetch(objectData, base + 1),
+                      texelFetch(objectData, base + 2), texelFetch(objectData, base + 3));
+    color = texelFetch(objectData, base + 7);
+    gl_Position = model * vec4(aPos, 1.0);
+}
+)";
+
+	const char* UNIFORM_VERTEX = R"(#version 330 core
+layout (location = 0) in vec3 aPos;
+uniform mat4 model;
+uniform vec3 objectColor;
+out vec4 color;
+void main() {
+    color = vec4(objectColor, 1.0);
+    gl_Position = model * vec4(aPos, 1.0);
+}
+)";
+
+	const char* FRAGMENT = R"(#version 330 core
+in vec4 color;
+out vec4 FragColor;
+void main() {
+    FragColor = color;
+}
+)";
+
+	constexpr unsigned int DRAW_COUNTS[] = { 1000, 10000, 100000 };
+
+	// A tiny cube, each copy is its own mesh in the pool
+	std::shared_ptr<mesh> make_cube() {
+		std::vector<mesh_vertex_t> vertices;
+		for (auto i = 0; i < 8; i++) {
+			mesh_vertex_t vertex{};
+			vertex.x = i & 1 ? 0.01f : -0.01f;
+			vertex.y = i & 2 ? 0.01f : -0.01f;
+			vertex.z = i & 4 ? 0.01f : -0.01f;
+			vertices.push_back(vertex);
+		}
+
+		const std::vector<unsigned> indices{
+			0, 1, 3, 0, 3, 2, 4, 6, 7, 4, 7, 5, 0, 4, 5, 0, 5, 1,
+			2, 3, 7, 2, 7, 6, 0, 2, 6, 0, 6, 4, 1, 5, 7, 1, 7, 3
+		};
+		return std::make_shared<mesh>(vertices, indices);
+	}
+
+	// Average milliseconds per frame to submit and flush count draws
+	double measure(render_queue& queue, const std::vector<std::unique_ptr<model>>& models, const unsigned int count, const int frames) {
+		double total = 0;
+		for (auto frame = -1; frame < frames; frame++) {
+			frame_data::begin_frame();
+			object_data::begin_frame();
+
+			const auto start = std::chrono::steady_clock::now();
+			for (auto i = 0u; i < count; i++) {
+				models[i]->submit(queue, glm::vec3(0));
+			}
+			queue.flush();
+			const auto elapsed = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+			// Keep the GPU from falling behind, and leave the first frame out of the average
+			glFinish();
+			if (frame >= 0) {
+				total += elapsed;
+			}
+		}
+		return total / frames;
+	}
+
+	// The same with the submissions recorded on up to threads threads first
+	double measure_recorded(render_queue& queue, const std::vector<std::unique_ptr<model>>& models, const unsigned int count, const int frames,
+		const unsigned int threads) {
+		std::vector<command_buffer> buffers;
+		double total = 0;
+		for (auto frame = -1; frame < frames; frame++) {
+			frame_data::begin_frame();
+			object_data::begin_frame();
+
+			const auto start = std::chrono::steady_clock::now();
+			command_buffer::record(buffers, count, queue.get_far_plane(), [&models](command_buffer& buffer, const uint32_t first, const uint32_t end) {
+				for (auto i = first; i < end; i++) {
+					models[i]->submit(buffer, glm::vec3(0));
+				}
+			}, threads);
+			for (const auto& buffer : buffers) {
+				queue.submit(buffer);
+			}
+			queue.flush();
+			const auto elapsed = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+			glFinish();
+			if (frame >= 0) {
+				total += elapsed;
+			}
+		}
+		return total / frames;
+	}
+}
+
+int main(int argc, char** argv) {
+	const int frames = argc > 1 ? std::max(1, std::atoi(argv[1])) : 20;
+
+	glfwInit();
+	glfwWindowHint(GLFW_VISIBLE, GLFW_FALSE);
+
+	// Ask for 4.3 so the indirect path can run, settle for the 3.3 the game uses
+	auto* window = init_window({ .glContextMajor = 4, .glContextMinor = 3, .glMSAASamples = 0, .width = 64, .height = 64, .vsync = false, .msaa = false, .title = "draw_submit_bench" });
+	if (!window) {
+		glfwInit();
+		glfwWindowHint(GLFW_VISIBLE, GLFW_FALSE);
+		window = init_window({ .glContextMajor = 3, .glContextMinor = 3, .glMSAASamples = 0, .width = 64, .height = 64, .vsync = false, .msaa = false, .title = "draw_submit_bench" });
+	}
+	if (!window) {
+		return 1;
+	}
+	glfwSwapInterval(0);
+
+	auto instanced = std::make_shared<shader>(INSTANCED_VERTEX, FRAGMENT);
+	auto uniform = std::make_shared<shader>(UNIFORM_VERTEX, FRAGMENT);
+	instanced->finish();
+	uniform->finish();
+	if (instanced->error || uniform->error) {
+		fprintf(stderr, "Failed to build the benchmark shaders\n");
+		return 1;
+	}
+
+	const auto maxDraws = *std::max_element(std::begin(DRAW_COUNTS), std::end(DRAW_COUNTS));
+	std::vector<std::unique_ptr<model>> instancedModels, uniformModels;
+	std::mt19937 rng{ 42 };
+	std::uniform_real_distribution<float> position{ -1.f, 1.f };
+	for (auto i = 0u; i < maxDraws; i++) {
+		auto cube = make_cube();
+		auto p = glm::vec3(position(rng), position(rng), 0.f);
+
+		instancedModels.push_back(std::make_unique<model>(std::shared_ptr(cube), std::shared_ptr(instanced)));
+		instancedModels.back()->set_position(p);
+		uniformModels.push_back(std::make_unique<model>(std::move(cube), std::shared_ptr(uniform)));
+		uniformModels.back()->set_position(p);
+	}
+
+	const auto indirect = gl_extensions::supports_multi_draw_indirect();
+	printf("GL %s, multi draw indirect %s, %d frame(s)\n", glGetString(GL_VERSION), indirect ? "available" : "not available", frames);
+	printf("%8s %-10s %12s %12s\n", "draws", "path", "ms/frame", "ns/draw");
+
+	render_queue queue;
+	for (const auto count : DRAW_COUNTS) {
+		const auto report = [&](const char* path, const double ms) {
+			printf("%8u %-10s %12.3f %12.1f\n", count, path, ms, ms * 1e6 / count);
+		};
+
+		report("uniform", measure(queue, uniformModels, count, frames));
+
+		queue.set_multi_draw_indirect(false);
+		report("loop", measure(queue, instancedModels, count, frames));
+
+		if (indirect) {
+			queue.set_multi_draw_indirect(true);
+			report("indirect", measure(queue, instancedModels, count, frames));
+		}
+
+		const auto hardware = std::max(1u, std::thread::hardware_concurrency());
+		for (auto threads = 1u; threads <= hardware; threads *= 2) {
+			const auto path = "record x" + std::to_string(threads);
+			report(path.c_str(), measure_recorded(queue, instancedModels, count, frames, threads));
+		}
+	}
+
+	glfwTerminate();
+	return 0;
+}
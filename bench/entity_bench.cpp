@@ -0,0 +1,249 @@
+// Transform update, culling and draw list building over N entities
+// Usage: entity_bench [iterations] [entities]
+//
+// The entity store is compared with objects laid out like model, each allocated on its own
+// with shared handles and recomputing its matrices with glm every frame. Matrices and draws
+// are checked against that reference
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <memory>
+#include <random>
+#include <thread>
+#include <vector>
+
+#include "entity_store.h"
+#include "glm/ext/matrix_transform.hpp"
+#include "glm/ext/matrix_clip_space.hpp"
+#include "glm/gtc/matrix_inverse.hpp"
+#include "glm/gtx/transform.hpp"
+
+namespace {
+	using clock_type = std::chrono::steady_clock;
+
+	double elapsed_ms(const clock_type::time_point start) {
+		return std::chrono::duration<double, std::milli>(clock_type::now() - start).count();
+	}
+
+	// Laid out like model, the way the scene was stored before the entity store
+	struct object_t {
+		std::shared_ptr<int> mesh, shader, material;
+		glm::vec3 position{ 0 };
+		glm::vec4 color{ 1 };
+		glm::vec3 scale{ 1 };
+		float pitch = 0, yaw = 0;
+		glm::mat4 world{ 1.f };
+		glm::mat3 normal{ 1.f };
+		aabb_t bounds;
+
+		void update(const aabb_t& local) {
+			const auto identity = glm::mat4(1.f);
+			const auto rotation = glm::rotate(identity, glm::radians(yaw), glm::vec3{ 0.f, 1.f, 0.f })
+				* glm::rotate(identity, glm::radians(pitch), glm::vec3{ 1.f, 0.f, 0.f });
+			world = glm::translate(identity, position) * rotation * glm::scale(identity, scale);
+			normal = glm::inverseTranspose(glm::mat3(world));
+			bounds = culling::transform(local, world);
+		}
+	};
+
+	bool close(const glm::mat4& a, const glm::mat4& b) {
+		for (auto c = 0; c < 4; c++) {
+			for (auto r = 0; r < 4; r++) {
+				if (std::abs(a[c][r] - b[c][r]) > 1e-3f * std::max(1.f, std::abs(b[c][r]))) {
+					return false;
+				}
+			}
+		}
+		return true;
+	}
+
+	bool close(const glm::mat3& a, const glm::mat3& b) {
+		return close(glm::mat4(a), glm::mat4(b));
+	}
+}
+
+int main(int argc, char** argv) {
+	const int iterations = argc > 1 ? std::max(1, std::atoi(argv[1])) : 10;
+	const size_t count = argc > 2 ? std::max(1, std::atoi(argv[2])) : 1000000;
+	const auto hardware = std::max(1u, std::thread::hardware_concurrency());
+
+	std::mt19937 rng{ 42 };
+	std::uniform_real_distribution<float> position{ -500.f, 500.f };
+	std::uniform_real_distribution<float> angle{ 0.f, 360.f };
+	std::uniform_real_distribution<float> size{ 0.5f, 2.f };
+	const aabb_t local{ glm::vec3(0.f), glm::vec3(0.5f) };
+
+	// Stands in for the model the entities draw, only its address is used
+	const auto* source = reinterpret_cast<const model*>(&local);
+
+	auto start = clock_type::now();
+	entity_store store;
+	std::vector<entity_t> entities(count);
+	for (auto& entity : entities) {
+		entity = store.create(source, local);
+	}
+	const auto createStore = elapsed_ms(start);
+
+	start = clock_type::now();
+	std::vector<std::shared_ptr<object_t>> objects(count);
+	const auto mesh = std::make_shared<int>(0), shader = std::make_shared<int>(0), material = std::make_shared<int>(0);
+	for (auto& object : objects) {
+		object = std::make_shared<object_t>();
+		object->mesh = mesh;
+		object->shader = shader;
+		object->material = material;
+	}
+	const auto createObjects = elapsed_ms(start);
+
+	for (size_t i = 0; i < count; i++) {
+		const glm::vec3 p{ position(rng), position(rng), position(rng) };
+		const auto pitch = angle(rng), yaw = angle(rng);
+		const glm::vec3 s{ size(rng), size(rng), size(rng) };
+		store.set_position(entities[i], p);
+		store.set_rotation(entities[i], pitch, yaw);
+		store.set_scale(entities[i], s);
+		objects[i]->position = p;
+		objects[i]->pitch = pitch;
+		objects[i]->yaw = yaw;
+		objects[i]->scale = s;
+	}
+
+	printf("%zu entities, %u hardware thread(s), %d iteration(s)\n", count, hardware, iterations);
+	printf("  %-28s %12s\n", "", "ms");
+	printf("  %-28s %12.3f\n", "create, store", createStore);
+	printf("  %-28s %12.3f\n", "create, model layout", createObjects);
+
+	// Everything moved
+	auto ok = true;
+	for (const auto threads : { 1u, hardware }) {
+		store.set_max_threads(threads);
+		auto total = 0.0;
+		for (auto i = 0; i < iterations; i++) {
+			for (const auto entity : entities) {
+				store.set_rotation(entity, 0.f, static_cast<float>(i));
+			}
+			start = clock_type::now();
+			ok &= store.update_transforms() == count;
+			total += elapsed_ms(start);
+		}
+		printf("  %-20s %7u %12.3f\n", "update all, store", threads, total / iterations);
+		if (hardware == 1) {
+			break;
+		}
+	}
+
+	start = clock_type::now();
+	for (auto i = 0; i < iterations; i++) {
+		for (auto& object : objects) {
+			object->yaw = static_cast<float>(i);
+			object->pitch = 0.f;
+			object->update(local);
+		}
+	}
+	printf("  %-28s %12.3f\n", "update all, model layout", elapsed_ms(start) / iterations);
+
+	// A tenth moved
+	auto total = 0.0;
+	for (auto i = 0; i < iterations; i++) {
+		for (size_t e = 0; e < count; e += 10) {
+			store.set_position(entities[e], objects[e]->position + glm::vec3(0.f, 0.01f * i, 0.f));
+		}
+		start = clock_type::now();
+		ok &= store.update_transforms() == (count + 9) / 10;
+		total += elapsed_ms(start);
+	}
+	printf("  %-28s %12.3f\n", "update a tenth, store", total / iterations);
+
+	start = clock_type::now();
+	for (auto i = 0; i < iterations; i++) {
+		ok &= store.update_transforms() == 0;
+	}
+	printf("  %-28s %12.3f\n", "update nothing, store", elapsed_ms(start) / iterations);
+
+	// Put the tenth back and check the store against glm
+	for (size_t e = 0; e < count; e += 10) {
+		store.set_position(entities[e], objects[e]->position);
+	}
+	store.update_transforms();
+	auto matching = true;
+	for (size_t i = 0; i < count; i += 97) {
+		const auto slot = store.get_slot(entities[i]);
+		matching &= close(store.get_world(slot), objects[i]->world) && close(store.get_normal(slot), objects[i]->normal);
+	}
+
+	// Worlds set whole are kept, normals and bounds follow them
+	for (size_t i = 0; i < count; i += 97) {
+		store.set_world(entities[i], objects[i]->world);
+		matching &= store.get_current_world(entities[i]) == objects[i]->world
+			&& glm::distance(store.get_position(entities[i]), objects[i]->position) < 1e-3f;
+	}
+	ok &= store.update_transforms() == (count + 96) / 97;
+	for (size_t i = 0; i < count; i += 97) {
+		const auto slot = store.get_slot(entities[i]);
+		const auto bounds = store.get_world_bounds(slot);
+		matching &= store.get_world(slot) == objects[i]->world && close(store.get_normal(slot), objects[i]->normal)
+			&& glm::distance(bounds.center, objects[i]->bounds.center) < 1e-2f;
+	}
+	printf("  matrices %s\n", matching ? "match glm" : "MISMATCH");
+	ok &= matching;
+
+	// Culling and the draw list for a camera at the center
+	const auto view = glm::lookAt(glm::vec3(0.f), glm::vec3(0.f, 0.f, -1.f), glm::vec3(0.f, 1.f, 0.f));
+	const auto frustum = culling::extract_frustum(glm::perspective(glm::radians(90.f), 16.f / 9.f, 0.1f, 1000.f) * view);
+	std::vector<uint32_t> visible;
+	std::vector<entity_store::draw_t> draws;
+
+	start = clock_type::now();
+	for (auto i = 0; i < iterations; i++) {
+		store.cull(frustum, visible);
+	}
+	printf("  %-28s %12.3f\n", "cull, store", elapsed_ms(start) / iterations);
+
+	std::vector<const object_t*> objectDraws;
+	start = clock_type::now();
+	for (auto i = 0; i < iterations; i++) {
+		objectDraws.clear();
+		for (const auto& object : objects) {
+			const auto& box = object->bounds;
+			auto inside = true;
+			for (const auto& plane : frustum.planes) {
+				const auto distance = glm::dot(glm::vec3(plane), box.center) + plane.w;
+				const auto radius = glm::dot(glm::abs(glm::vec3(plane)), box.extent);
+				if (distance + radius < 0.f) {
+					inside = false;
+					break;
+				}
+			}
+			if (inside) {
+				objectDraws.push_back(object.get());
+			}
+		}
+	}
+	printf("  %-28s %12.3f\n", "cull, model layout", elapsed_ms(start) / iterations);
+
+	for (const auto threads : { 1u, hardware }) {
+		store.set_max_threads(threads);
+		start = clock_type::now();
+		for (auto i = 0; i < iterations; i++) {
+			draws.clear();
+			store.build_draw_list(visible, glm::vec3(0.f), draws);
+		}
+		printf("  %-20s %7u %12.3f\n", "draw list, store", threads, elapsed_ms(start) / iterations);
+		if (hardware == 1) {
+			break;
+		}
+	}
+	printf("  %zu visible, %zu with the model layout\n", draws.size(), objectDraws.size());
+	ok &= draws.size() == visible.size() && std::abs(static_cast<double>(draws.size()) - objectDraws.size()) <= count / 1000;
+
+	// Handles of destroyed entities stop working, live ones keep theirs
+	store.destroy(entities[0]);
+	const auto replacement = store.create(source, local);
+	ok &= !store.alive(entities[0]) && store.alive(replacement) && store.alive(entities[1])
+		&& replacement.index == entities[0].index && store.get_entity(store.get_slot(entities[1])) == entities[1];
+
+	return ok ? 0 : 1;
+}
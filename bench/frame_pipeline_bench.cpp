@@ -0,0 +1,119 @@
+// Frame time with the simulation and GL stages one after the other and pipelined
+// Usage: frame_pipeline_bench [frames] [simulate ms] [gl ms] [workers]
+//
+// Both stages are busy loops over the packet: the simulation writes every value in it and the
+// GL stage reads them all back, checking that it sees one whole frame, the frames in order and
+// never more than one frame behind. Pipelined, a frame should take about as long as the slower
+// stage when there is a core for each
+// The GL stage also waits on a parallel_for the way the occlusion pass does, with workers around
+// that wait must never end up running the simulation itself
+// The exit code says whether every packet checked out
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <thread>
+#include <vector>
+
+#include "frame_pipeline.h"
+
+namespace {
+	using clock_type = std::chrono::steady_clock;
+
+	struct packet_t {
+		uint32_t frame = 0;
+		std::vector<uint32_t> values;
+		std::thread::id simulatedOn;
+	};
+
+	double elapsed_ms(const clock_type::time_point start) {
+		return std::chrono::duration<double, std::milli>(clock_type::now() - start).count();
+	}
+
+	// Rewrites the packet for a frame until ms have passed
+	void simulate(packet_t& packet, const uint32_t frame, const double ms) {
+		const auto start = clock_type::now();
+		packet.frame = frame;
+		packet.simulatedOn = std::this_thread::get_id();
+		packet.values.resize(4096);
+		do {
+			for (auto& value : packet.values) {
+				value = frame;
+			}
+		} while (elapsed_ms(start) < ms);
+	}
+
+	// Reads the packet back until ms have passed, false if any of it belongs to another frame
+	bool draw(const packet_t& packet, const double ms) {
+		const auto start = clock_type::now();
+		std::atomic<uint32_t> counted{ 0 };
+		job_system::parallel_for(static_cast<uint32_t>(packet.values.size()), 256, [&](const uint32_t first, const uint32_t end) {
+			counted.fetch_add(end - first, std::memory_order_relaxed);
+		});
+		auto whole = counted.load() == packet.values.size();
+		do {
+			for (const auto value : packet.values) {
+				whole &= value == packet.frame;
+			}
+		} while (elapsed_ms(start) < ms);
+		return whole;
+	}
+}
+
+int main(int argc, char** argv) {
+	const auto frames = argc > 1 ? std::max(1, std::atoi(argv[1])) : 200;
+	const auto simulateMs = argc > 2 ? std::atof(argv[2]) : 4.0;
+	const auto drawMs = argc > 3 ? std::atof(argv[3]) : 4.0;
+	const auto workers = argc > 4 ? static_cast<unsigned int>(std::max(0, std::atoi(argv[4]))) : 0u;
+	job_system::init(workers);
+	printf("%u thread(s), %d frames, simulate %.1f ms, gl %.1f ms\n", job_system::thread_count(), frames, simulateMs, drawMs);
+
+	auto ok = true;
+
+	// One stage after the other, what the frame loop did before
+	{
+		packet_t packet;
+		const auto start = clock_type::now();
+		for (auto frame = 1u; frame <= static_cast<uint32_t>(frames); frame++) {
+			simulate(packet, frame, simulateMs);
+			ok &= draw(packet, drawMs);
+		}
+		printf("  %-12s %8.3f ms/frame\n", "sequential", elapsed_ms(start) / frames);
+	}
+
+	// Pipelined, frame N drawn while N + 1 is simulated
+	{
+		frame_pipeline<packet_t> pipeline;
+		pipeline.start([](packet_t& packet) { simulate(packet, 1, 0.0); });
+		pipeline.finish();
+
+		auto waitMs = 0.0;
+		const auto start = clock_type::now();
+		for (auto frame = 1u; frame <= static_cast<uint32_t>(frames); frame++) {
+			const auto next = frame + 1;
+			pipeline.start([next, simulateMs](packet_t& packet) { simulate(packet, next, simulateMs); });
+
+			// The packet drawn is the last one finished, one behind the one being simulated
+			const auto& packet = pipeline.current();
+			ok &= packet.frame == frame;
+			if (job_system::thread_count() > 1 && packet.simulatedOn == std::this_thread::get_id()) {
+				printf("  frame %u was simulated on the gl thread\n", frame);
+				ok = false;
+			}
+			ok &= draw(packet, drawMs);
+
+			pipeline.finish();
+			waitMs += pipeline.get_stats().waitMs;
+		}
+		char extra[64];
+		snprintf(extra, sizeof(extra), "waited %.3f ms/frame", waitMs / frames);
+		printf("  %-12s %8.3f ms/frame %s\n", "pipelined", elapsed_ms(start) / frames, extra);
+	}
+
+	printf("  packets %s\n", ok ? "ok" : "WRONG");
+
+	job_system::shutdown();
+	return ok ? 0 : 1;
+}
@@ -0,0 +1,102 @@
+// Decode every image under a directory N times with each registered backend
+// Usage: image_decode_bench [iterations] [directory]
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <filesystem>
+#include <map>
+#include <string>
+#include <vector>
+
+#include "image_decoder.h"
+
+struct bench_file_t {
+	std::string path;
+	image_format format;
+	std::vector<unsigned char> bytes;
+};
+
+struct bench_result_t {
+	uint64_t images{ 0 };
+	uint64_t bytes_in{ 0 };
+	uint64_t bytes_out{ 0 };
+	double seconds{ 0 };
+};
+
+int main(int argc, char** argv) {
+	const int iterations = argc > 1 ? std::max(1, std::atoi(argv[1])) : 10;
+	const std::string directory = argc > 2 ? argv[2] : "textures";
+
+	// Load everything up front so the file system is not part of the measurement
+	std::vector<bench_file_t> files;
+	std::error_code ec;
+	for (const auto& entry : std::filesystem::recursive_directory_iterator(directory, ec)) {
+		if (!entry.is_regular_file()) {
+			continue;
+		}
+
+		auto bytes = image_decoders::read_file(entry.path().string());
+		image_info_t info{};
+		if (bytes.empty() || !image_decoders::get_info(bytes, info)) {
+			continue;
+		}
+
+		const auto format = image_decoders::detect_format(bytes);
+		files.push_back({ entry.path().string(), format, std::move(bytes) });
+	}
+
+	if (files.empty()) {
+		fprintf(stderr, "No decodable images found under %s\n", directory.c_str());
+		return 1;
+	}
+
+	// Every distinct backend registered for some format, stb always included
+	std::vector<std::shared_ptr<image_decoder>> backends{ image_decoders::get_stb_backend() };
+	for (auto i = 0; i < static_cast<int>(image_format::count); i++) {
+		auto backend = image_decoders::get_backend(static_cast<image_format>(i));
+		if (std::find(backends.begin(), backends.end(), backend) == backends.end()) {
+			backends.push_back(std::move(backend));
+		}
+	}
+
+	printf("%zu image(s), %d iteration(s)\n", files.size(), iterations);
+	printf("%-12s %-8s %8s %12s %12s %12s\n", "backend", "format", "images", "ms", "MB/s in", "MB/s out");
+
+	for (const auto& backend : backends) {
+		std::map<image_format, bench_result_t> results;
+
+		for (const auto& file : files) {
+			auto& result = results[file.format];
+
+			for (auto i = 0; i < iterations; i++) {
+				decoded_image_t img;
+				const auto start = std::chrono::steady_clock::now();
+				const auto ok = backend->decode(file.bytes, img, 0, false);
+				const auto elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+				if (!ok) {
+					fprintf(stderr, "%s failed to decode %s\n", backend->name(), file.path.c_str());
+					break;
+				}
+
+				result.images++;
+				result.bytes_in += file.bytes.size();
+				result.bytes_out += img.size();
+				result.seconds += elapsed;
+			}
+		}
+
+		for (const auto& [format, result] : results) {
+			const auto mb = 1024.0 * 1024.0;
+			printf("%-12s %-8s %8llu %12.2f %12.1f %12.1f\n",
+				backend->name(), image_decoders::format_name(format),
+				static_cast<unsigned long long>(result.images), result.seconds * 1000.0,
+				result.seconds > 0 ? result.bytes_in / mb / result.seconds : 0.0,
+				result.seconds > 0 ? result.bytes_out / mb / result.seconds : 0.0);
+		}
+	}
+
+	return 0;
+}
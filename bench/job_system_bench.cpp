@@ -0,0 +1,276 @@
+// Job system overheads and scaling
+// Usage: job_system_bench [iterations] [workers]
+//
+//   fork-join   - parallel_for over a large array, against one loop and a thread per core
+//   fine        - a million tiny jobs on one counter, and recursive fork-join (fibonacci)
+//   contention  - one thread handing out every job, threads outside the system submitting
+//                 through the shared queue, and chains of jobs held back on counters
+// Every section checks its results and the exit code says whether they all held
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <thread>
+#include <vector>
+
+#include "job_system.h"
+
+namespace {
+	using clock_type = std::chrono::steady_clock;
+
+	// Average milliseconds per call
+	template<typename F>
+	double measure(const int iterations, F&& work) {
+		work();
+		const auto start = clock_type::now();
+		for (auto i = 0; i < iterations; i++) {
+			work();
+		}
+		return std::chrono::duration<double, std::milli>(clock_type::now() - start).count() / iterations;
+	}
+
+	void report(const char* section, const char* name, const double ms, const char* extra = "") {
+		printf("  %-11s %-26s %10.3f ms %s\n", section, name, ms, extra);
+	}
+
+	// Some arithmetic per element so the loop is not purely memory bound
+	float element(const float x) {
+		return std::sqrt(x) * 0.5f + std::sin(x) * 0.25f;
+	}
+
+	// Sums are taken in blocks so every version adds in the same order
+	constexpr uint32_t BLOCK = 4096;
+
+	double block_sum(const std::vector<float>& values, const uint32_t block) {
+		const auto first = block * BLOCK;
+		const auto end = std::min(static_cast<uint32_t>(values.size()), first + BLOCK);
+		auto sum = 0.0;
+		for (auto i = first; i < end; i++) {
+			sum += element(values[i]);
+		}
+		return sum;
+	}
+
+	uint64_t fibonacci(const uint32_t n) {
+		if (n < 2) {
+			return n;
+		}
+		if (n < 16) {
+			return fibonacci(n - 1) + fibonacci(n - 2);
+		}
+
+		uint64_t left = 0;
+		job_counter counter;
+		job_system::run([&left, n] { left = fibonacci(n - 1); }, &counter);
+		const auto right = fibonacci(n - 2);
+		job_system::wait(counter);
+		return left + right;
+	}
+}
+
+int main(int argc, char** argv) {
+	const int iterations = argc > 1 ? std::max(1, std::atoi(argv[1])) : 10;
+	const auto workers = argc > 2 ? static_cast<unsigned int>(std::max(0, std::atoi(argv[2]))) : 0u;
+	job_system::init(workers);
+	const auto threads = job_system::thread_count();
+	printf("%u thread(s), %d iteration(s)\n", threads, iterations);
+
+	auto ok = true;
+
+	// Fork-join
+	{
+		constexpr uint32_t COUNT = 1 << 24;
+		std::vector<float> values(COUNT);
+		for (auto i = 0u; i < COUNT; i++) {
+			values[i] = static_cast<float>(i % 1000);
+		}
+		const auto blocks = (COUNT + BLOCK - 1) / BLOCK;
+		std::vector<double> sums(blocks);
+		const auto total = [&sums] {
+			auto sum = 0.0;
+			for (const auto s : sums) {
+				sum += s;
+			}
+			return sum;
+		};
+
+		const auto serialMs = measure(iterations, [&] {
+			for (auto b = 0u; b < blocks; b++) {
+				sums[b] = block_sum(values, b);
+			}
+		});
+		const auto expected = total();
+		report("fork-join", "one loop", serialMs);
+
+		// What the engine did before the job system, a thread per core started for every call
+		const auto spawnMs = measure(iterations, [&] {
+			const auto slice = (blocks + threads - 1) / threads;
+			std::vector<std::thread> pool;
+			for (auto t = 1u; t < threads; t++) {
+				pool.emplace_back([&, t] {
+					for (auto b = t * slice; b < std::min(blocks, (t + 1) * slice); b++) {
+						sums[b] = block_sum(values, b);
+					}
+				});
+			}
+			for (auto b = 0u; b < std::min(blocks, slice); b++) {
+				sums[b] = block_sum(values, b);
+			}
+			for (auto& thread : pool) {
+				thread.join();
+			}
+		});
+		ok &= total() == expected;
+		report("fork-join", "thread per core", spawnMs);
+
+		char speedup[64];
+		const auto jobsMs = measure(iterations, [&] {
+			job_system::parallel_for(blocks, 1, [&](const uint32_t first, const uint32_t end) {
+				for (auto b = first; b < end; b++) {
+					sums[b] = block_sum(values, b);
+				}
+			});
+		});
+		ok &= total() == expected;
+		snprintf(speedup, sizeof(speedup), "%.2fx one loop", serialMs / jobsMs);
+		report("fork-join", "parallel_for", jobsMs, speedup);
+
+		// Tiny bodies, where the grain has to grow for splitting to pay off
+		std::vector<uint32_t> small(1 << 20);
+		const auto smallMs = measure(iterations, [&] {
+			job_system::parallel_for(static_cast<uint32_t>(small.size()), 1, [&small](const uint32_t first, const uint32_t end) {
+				for (auto i = first; i < end; i++) {
+					small[i] = i * 3;
+				}
+			});
+		});
+		for (auto i = 0u; i < small.size(); i++) {
+			ok &= small[i] == i * 3;
+		}
+		report("fork-join", "parallel_for, 1M writes", smallMs);
+	}
+
+	// Fine grained
+	{
+		constexpr uint32_t JOBS = 1000000;
+		std::atomic<uint32_t> ran{ 0 };
+		const auto manyMs = measure(iterations, [&] {
+			ran.store(0, std::memory_order_relaxed);
+			job_counter counter;
+			for (auto i = 0u; i < JOBS; i++) {
+				job_system::run([&ran] { ran.fetch_add(1, std::memory_order_relaxed); }, &counter);
+			}
+			job_system::wait(counter);
+		});
+		ok &= ran.load() == JOBS;
+		char perJob[64];
+		snprintf(perJob, sizeof(perJob), "%.1f ns/job", manyMs * 1e6 / JOBS);
+		report("fine", "1M jobs, one counter", manyMs, perJob);
+
+		uint64_t result = 0;
+		const auto fibMs = measure(iterations, [&] {
+			result = fibonacci(32);
+		});
+		ok &= result == 2178309;
+		report("fine", "fibonacci(32), nested", fibMs);
+	}
+
+	// Contention
+	{
+		// Every job comes from the main thread, the others only get work by stealing
+		constexpr uint32_t JOBS = 200000;
+		std::atomic<uint32_t> ran{ 0 };
+		const auto before = job_system::get_stats();
+		const auto stealMs = measure(iterations, [&] {
+			ran.store(0, std::memory_order_relaxed);
+			job_counter counter;
+			for (auto i = 0u; i < JOBS; i++) {
+				job_system::run([&ran] {
+					auto x = 1.f;
+					for (auto k = 0; k < 64; k++) {
+						x = x * 1.0001f + 0.5f;
+					}
+					ran.fetch_add(x > 0.f ? 1 : 0, std::memory_order_relaxed);
+				}, &counter);
+			}
+			job_system::wait(counter);
+		});
+		ok &= ran.load() == JOBS;
+		char steals[64];
+		snprintf(steals, sizeof(steals), "%llu steals",
+			static_cast<unsigned long long>(job_system::get_stats().steals - before.steals));
+		report("contention", "one producer, all steal", stealMs, steals);
+
+		// Threads outside the system submit through the shared queue
+		constexpr uint32_t PRODUCERS = 4, PER_PRODUCER = 50000;
+		const auto sharedMs = measure(iterations, [&] {
+			ran.store(0, std::memory_order_relaxed);
+			job_counter counter;
+			std::vector<std::thread> producers;
+			for (auto p = 0u; p < PRODUCERS; p++) {
+				producers.emplace_back([&] {
+					for (auto i = 0u; i < PER_PRODUCER; i++) {
+						job_system::run([&ran] { ran.fetch_add(1, std::memory_order_relaxed); }, &counter);
+					}
+				});
+			}
+			for (auto& producer : producers) {
+				producer.join();
+			}
+			job_system::wait(counter);
+		});
+		ok &= ran.load() == PRODUCERS * PER_PRODUCER;
+		report("contention", "4 outside producers", sharedMs);
+
+		// Stages held back on the previous stage's counter, each checks the last one finished
+		static constexpr uint32_t STAGES = 64, WIDTH = 256;
+		std::atomic<uint32_t> finished[STAGES];
+		std::atomic<bool> ordered{ true };
+		const auto chainMs = measure(iterations, [&] {
+			std::vector<job_counter> counters(STAGES);
+			for (auto& f : finished) {
+				f.store(0, std::memory_order_relaxed);
+			}
+			for (auto s = 0u; s < STAGES; s++) {
+				for (auto i = 0u; i < WIDTH; i++) {
+					job_system::run([&finished, &ordered, s] {
+						if (s > 0 && finished[s - 1].load(std::memory_order_acquire) != WIDTH) {
+							ordered.store(false);
+						}
+						finished[s].fetch_add(1, std::memory_order_acq_rel);
+					}, &counters[s], s > 0 ? &counters[s - 1] : nullptr);
+				}
+			}
+			job_system::wait(counters[STAGES - 1]);
+
+			// Earlier stages are done by now, settle them before the counters go
+			for (auto& counter : counters) {
+				job_system::wait(counter);
+			}
+		});
+		ok &= ordered.load();
+		report("contention", "64 dependent stages", chainMs);
+
+		// Main thread jobs only run on the thread that started the system
+		const auto mainThread = std::this_thread::get_id();
+		std::atomic<bool> onMain{ true };
+		job_counter decoded, uploaded;
+		for (auto i = 0; i < 16; i++) {
+			job_system::run([] {}, &decoded);
+		}
+		job_system::run_on_main([&onMain, mainThread] { onMain = std::this_thread::get_id() == mainThread; }, &uploaded, &decoded);
+		job_system::wait(uploaded);
+		ok &= onMain.load();
+	}
+
+	const auto stats = job_system::get_stats();
+	printf("  %llu jobs, %llu steals, %llu parks\n", static_cast<unsigned long long>(stats.jobs),
+		static_cast<unsigned long long>(stats.steals), static_cast<unsigned long long>(stats.parks));
+	printf("  results %s\n", ok ? "ok" : "WRONG");
+
+	job_system::shutdown();
+	return ok ? 0 : 1;
+}
@@ -0,0 +1,138 @@
+// Occlusion rasterizer throughput and determinism
+// Usage: occlusion_bench [iterations] [occluders]
+//
+// A wall and a fixed set of boxes, scattered with a fixed seed, are rasterized with every
+// kernel. The depth buffer, the max depth level and the answer for a fixed set of test
+// boxes have to be bit for bit the same as the scalar kernel's, the exit code says whether
+// they were
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <random>
+#include <vector>
+
+#include "occlusion.h"
+#include "cpu_features.h"
+#include "job_system.h"
+#include "glm/ext/matrix_transform.hpp"
+#include "glm/ext/matrix_clip_space.hpp"
+
+namespace {
+	struct placed_t {
+		occluder_t occluder;
+		glm::mat4 transform;
+	};
+
+	struct result_t {
+		std::vector<float> depth;
+		std::vector<float> hiZ;
+		std::vector<bool> occluded;
+		unsigned int triangles = 0;
+	};
+
+	void fill(occlusion_buffer& buffer, const glm::mat4& viewProjection, const std::vector<placed_t>& occluders) {
+		buffer.begin(viewProjection);
+		for (const auto& placed : occluders) {
+			buffer.add_occluder(placed.occluder, placed.transform);
+		}
+		buffer.rasterize();
+	}
+
+	// Average milliseconds per frame of occluders, the buffer is left with the last one
+	double measure(occlusion_buffer& buffer, const glm::mat4& viewProjection, const std::vector<placed_t>& occluders, const int iterations) {
+		fill(buffer, viewProjection, occluders);
+
+		const auto start = std::chrono::steady_clock::now();
+		for (auto i = 0; i < iterations; i++) {
+			fill(buffer, viewProjection, occluders);
+		}
+		return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count() / iterations;
+	}
+
+	result_t collect(const occlusion_buffer& buffer, const std::vector<aabb_t>& tests) {
+		result_t result{ buffer.get_depth(), buffer.get_hi_z(), {}, buffer.get_stats().triangles };
+		for (const auto& box : tests) {
+			result.occluded.push_back(buffer.is_occluded(box));
+		}
+		return result;
+	}
+
+	// Compares the bits, so a -0 against a 0 or a different NaN counts as a difference
+	bool identical(const std::vector<float>& a, const std::vector<float>& b) {
+		return a.size() == b.size() && std::memcmp(a.data(), b.data(), a.size() * sizeof(float)) == 0;
+	}
+
+	bool identical(const result_t& a, const result_t& b) {
+		return identical(a.depth, b.depth) && identical(a.hiZ, b.hiZ) && a.occluded == b.occluded && a.triangles == b.triangles;
+	}
+}
+
+int main(int argc, char** argv) {
+	const int iterations = argc > 1 ? std::max(1, std::atoi(argv[1])) : 50;
+	const auto count = argc > 2 ? std::max(1, std::atoi(argv[2])) : 500;
+
+	const auto view = glm::lookAt(glm::vec3(0.f), glm::vec3(0.f, 0.f, -1.f), glm::vec3(0.f, 1.f, 0.f));
+	const auto projection = glm::perspective(glm::radians(60.f), 2.f, 0.1f, 100.f);
+	const auto viewProjection = projection * view;
+
+	// A wall across the middle and boxes in front of, behind and around it, some crossing the near plane
+	std::vector<placed_t> occluders;
+	occluders.push_back({ occlusion::make_box({ { 0.f, 0.f, -10.f }, { 6.f, 4.f, 0.5f } }), glm::mat4(1.f) });
+	std::mt19937 rng{ 7 };
+	std::uniform_real_distribution<float> spread{ -20.f, 20.f }, depth{ -60.f, 1.f }, size{ 0.2f, 2.f }, angle{ 0.f, 360.f };
+	for (auto i = 0; i < count; i++) {
+		const auto box = occlusion::make_box({ glm::vec3(0.f), { size(rng), size(rng), size(rng) } });
+		auto transform = glm::translate(glm::mat4(1.f), { spread(rng), spread(rng), depth(rng) });
+		transform = glm::rotate(transform, glm::radians(angle(rng)), glm::normalize(glm::vec3(spread(rng), spread(rng), 1.f)));
+		occluders.push_back({ box, transform });
+	}
+
+	// Boxes to test, behind the wall, in front of it, beside it, and a spread of others
+	std::vector<aabb_t> tests = {
+		{ { 0.f, 0.f, -30.f }, { 1.f, 1.f, 1.f } },
+		{ { 0.f, 0.f, -6.f }, { 1.f, 1.f, 1.f } },
+		{ { 40.f, 0.f, -30.f }, { 1.f, 1.f, 1.f } },
+		{ { 0.f, 0.f, -0.05f }, { 1.f, 1.f, 1.f } }
+	};
+	for (auto i = 0; i < 1000; i++) {
+		tests.push_back({ { spread(rng), spread(rng), depth(rng) - 40.f }, { size(rng), size(rng), size(rng) } });
+	}
+
+	printf("%zu occluders, %zu test boxes, AVX2 %s, %u thread(s), %d iteration(s)\n", occluders.size(), tests.size(),
+		cpu_features::has_avx2() ? "available" : "not available", job_system::thread_count(), iterations);
+	printf("%-8s %12s %10s %10s %8s\n", "kernel", "ms/frame", "triangles", "occluded", "result");
+
+	occlusion_buffer reference;
+	reference.set_kernel(culling::kernel::scalar);
+	const auto scalarMs = measure(reference, viewProjection, occluders, iterations);
+	const auto expected = collect(reference, tests);
+	const auto occluded = static_cast<unsigned int>(std::count(expected.occluded.begin(), expected.occluded.end(), true));
+	printf("%-8s %12.3f %10u %10u %8s\n", "scalar", scalarMs, expected.triangles, occluded, "-");
+
+	// The wall has to hide what is straight behind it and nothing in front of or beside it
+	auto ok = expected.occluded[0] && !expected.occluded[1] && !expected.occluded[2] && !expected.occluded[3];
+
+	if (cpu_features::has_avx2()) {
+		occlusion_buffer vector;
+		vector.set_kernel(culling::kernel::avx2);
+		const auto ms = measure(vector, viewProjection, occluders, iterations);
+		const auto result = collect(vector, tests);
+		const auto same = identical(result, expected);
+		printf("%-8s %12.3f %10u %10u %8s\n", "avx2", ms, result.triangles,
+			static_cast<unsigned int>(std::count(result.occluded.begin(), result.occluded.end(), true)), same ? "ok" : "MISMATCH");
+		ok &= same;
+	}
+
+	// A buffer filled again from scratch has to come out the same
+	occlusion_buffer again;
+	again.set_kernel(culling::kernel::scalar);
+	fill(again, viewProjection, occluders);
+	ok &= identical(collect(again, tests), expected);
+
+	printf("  results %s\n", ok ? "ok" : "WRONG");
+	job_system::shutdown();
+	return ok ? 0 : 1;
+}
@@ -0,0 +1,252 @@
+// Spatial index against brute force scans over N world space boxes
+// Usage: spatial_index_bench [queries] [objects...]
+//
+// Boxes are scattered through a cube, every frame a tenth of them drift a little and a
+// hundredth jump somewhere else. Each query is checked against the scan's answer
+// Defaults to 10k, 100k and 1M objects
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <limits>
+#include <random>
+#include <vector>
+
+#include "aabb_tree.h"
+#include "culling.h"
+#include "glm/ext/matrix_transform.hpp"
+#include "glm/ext/matrix_clip_space.hpp"
+
+namespace {
+	using clock_type = std::chrono::steady_clock;
+
+	double elapsed_ms(const clock_type::time_point start) {
+		return std::chrono::duration<double, std::milli>(clock_type::now() - start).count();
+	}
+
+	float distance_squared(const glm::vec3& point, const aabb_t& box) {
+		const auto offset = glm::max(glm::max(box.center - box.extent - point, point - (box.center + box.extent)), glm::vec3(0.f));
+		return glm::dot(offset, offset);
+	}
+
+	float ray_entry(const glm::vec3& origin, const glm::vec3& inverse, const float maxDistance, const aabb_t& box) {
+		auto enter = 0.f, leave = maxDistance;
+		for (auto axis = 0; axis < 3; axis++) {
+			auto t0 = (box.center[axis] - box.extent[axis] - origin[axis]) * inverse[axis];
+			auto t1 = (box.center[axis] + box.extent[axis] - origin[axis]) * inverse[axis];
+			if (t0 > t1) {
+				std::swap(t0, t1);
+			}
+			enter = std::max(enter, t0);
+			leave = std::min(leave, t1);
+		}
+		return enter <= leave ? enter : std::numeric_limits<float>::infinity();
+	}
+
+	void print(const char* name, const double tree, const double brute, const bool ok) {
+		printf("  %-10s %12.3f %12.3f %8.1fx %8s\n", name, tree, brute, brute / tree, ok ? "ok" : "MISMATCH");
+	}
+
+	bool run(const size_t count, const int queries) {
+		std::mt19937 rng{ 42 };
+		std::uniform_real_distribution<float> position{ -500.f, 500.f };
+		std::uniform_real_distribution<float> size{ 0.1f, 2.f };
+		std::uniform_real_distribution<float> drift{ -0.05f, 0.05f };
+		std::uniform_real_distribution<float> unit{ -1.f, 1.f };
+
+		std::vector<aabb_t> boxes(count);
+		for (auto& box : boxes) {
+			box = { { position(rng), position(rng), position(rng) }, { size(rng), size(rng), size(rng) } };
+		}
+
+		printf("%zu objects, %d queries of each kind\n", count, queries);
+		printf("  %-10s %12s %12s %9s %8s\n", "", "tree ms", "scan ms", "speedup", "result");
+		auto ok = true;
+
+		// Building, the scan only has to store the boxes
+		aabb_tree tree;
+		std::vector<int32_t> proxies(count);
+		auto start = clock_type::now();
+		for (size_t i = 0; i < count; i++) {
+			proxies[i] = tree.insert(boxes[i], static_cast<uint32_t>(i));
+		}
+		const auto insertTree = elapsed_ms(start);
+
+		culling::bounds_t bounds;
+		start = clock_type::now();
+		for (const auto& box : boxes) {
+			bounds.push(box);
+		}
+		const auto insertScan = elapsed_ms(start);
+		print("insert", insertTree, insertScan, tree.size() == count);
+
+		// One frame of movement
+		std::vector<std::pair<size_t, aabb_t>> moves;
+		for (size_t i = 0; i < count; i += 10) {
+			auto box = boxes[i];
+			if (i % 100 == 0) {
+				box.center = { position(rng), position(rng), position(rng) };
+			}
+			else {
+				box.center += glm::vec3(drift(rng), drift(rng), drift(rng));
+			}
+			moves.emplace_back(i, box);
+		}
+
+		size_t reinserted = 0;
+		start = clock_type::now();
+		for (const auto& [index, box] : moves) {
+			reinserted += tree.update(proxies[index], box);
+		}
+		const auto updateTree = elapsed_ms(start);
+
+		start = clock_type::now();
+		for (const auto& [index, box] : moves) {
+			boxes[index] = box;
+			bounds.centerX[index] = box.center.x;
+			bounds.centerY[index] = box.center.y;
+			bounds.centerZ[index] = box.center.z;
+		}
+		const auto updateScan = elapsed_ms(start);
+		print("update", updateTree, updateScan, true);
+		printf("  %zu of %zu moves reinserted, height %d\n", reinserted, moves.size(), tree.height());
+
+		// Frustum, a camera that sees about 100 units ahead
+		std::vector<glm::vec3> eyes(queries), directions(queries);
+		for (auto q = 0; q < queries; q++) {
+			eyes[q] = { position(rng), position(rng), position(rng) };
+			directions[q] = glm::normalize(glm::vec3(unit(rng), unit(rng), unit(rng)) + glm::vec3(0.f, 0.f, 1e-3f));
+		}
+
+		std::vector<uint32_t> treeResult, scanResult;
+		const auto projection = glm::perspective(glm::radians(60.f), 16.f / 9.f, 0.1f, 100.f);
+		std::vector<frustum_t> frustums(queries);
+		for (auto q = 0; q < queries; q++) {
+			const auto up = std::abs(directions[q].y) > 0.99f ? glm::vec3(1.f, 0.f, 0.f) : glm::vec3(0.f, 1.f, 0.f);
+			frustums[q] = culling::extract_frustum(projection * glm::lookAt(eyes[q], eyes[q] + directions[q], up));
+		}
+
+		auto treeMs = 0.0, scanMs = 0.0;
+		auto same = true;
+		for (auto q = 0; q < queries; q++) {
+			treeResult.clear();
+			start = clock_type::now();
+			tree.query_frustum(frustums[q], treeResult);
+			treeMs += elapsed_ms(start);
+
+			start = clock_type::now();
+			culling::cull(frustums[q], bounds, scanResult);
+			scanMs += elapsed_ms(start);
+
+			std::sort(treeResult.begin(), treeResult.end());
+			same &= treeResult == scanResult;
+		}
+		print("frustum", treeMs / queries, scanMs / queries, same);
+		ok &= same;
+
+		// Sphere
+		treeMs = scanMs = 0.0;
+		same = true;
+		for (auto q = 0; q < queries; q++) {
+			constexpr auto radius = 25.f;
+			treeResult.clear();
+			start = clock_type::now();
+			tree.query_sphere(eyes[q], radius, treeResult);
+			treeMs += elapsed_ms(start);
+
+			scanResult.clear();
+			start = clock_type::now();
+			for (size_t i = 0; i < count; i++) {
+				if (distance_squared(eyes[q], boxes[i]) <= radius * radius) {
+					scanResult.push_back(static_cast<uint32_t>(i));
+				}
+			}
+			scanMs += elapsed_ms(start);
+
+			std::sort(treeResult.begin(), treeResult.end());
+			same &= treeResult == scanResult;
+		}
+		print("sphere", treeMs / queries, scanMs / queries, same);
+		ok &= same;
+
+		// Ray, compared by distance since boxes can overlap
+		treeMs = scanMs = 0.0;
+		same = true;
+		for (auto q = 0; q < queries; q++) {
+			constexpr auto reach = 1000.f;
+			uint32_t hit = 0;
+			auto treeDistance = std::numeric_limits<float>::infinity();
+			start = clock_type::now();
+			if (!tree.raycast(eyes[q], directions[q], reach, hit, treeDistance)) {
+				treeDistance = std::numeric_limits<float>::infinity();
+			}
+			treeMs += elapsed_ms(start);
+
+			auto scanDistance = std::numeric_limits<float>::infinity();
+			start = clock_type::now();
+			const auto inverse = 1.f / directions[q];
+			for (const auto& box : boxes) {
+				scanDistance = std::min(scanDistance, ray_entry(eyes[q], inverse, reach, box));
+			}
+			scanMs += elapsed_ms(start);
+
+			same &= treeDistance == scanDistance;
+		}
+		print("ray", treeMs / queries, scanMs / queries, same);
+		ok &= same;
+
+		// Nearest, compared by distance since ties can pick different objects
+		treeMs = scanMs = 0.0;
+		same = true;
+		std::vector<std::pair<float, uint32_t>> scanNearest(count);
+		for (auto q = 0; q < queries; q++) {
+			constexpr size_t k = 16;
+			treeResult.clear();
+			start = clock_type::now();
+			tree.query_nearest(eyes[q], k, treeResult);
+			treeMs += elapsed_ms(start);
+
+			start = clock_type::now();
+			for (size_t i = 0; i < count; i++) {
+				scanNearest[i] = { distance_squared(eyes[q], boxes[i]), static_cast<uint32_t>(i) };
+			}
+			const auto found = std::min(k, count);
+			std::partial_sort(scanNearest.begin(), scanNearest.begin() + found, scanNearest.end());
+			scanMs += elapsed_ms(start);
+
+			same &= treeResult.size() == found;
+			for (size_t i = 0; same && i < found; i++) {
+				same &= distance_squared(eyes[q], boxes[treeResult[i]]) == scanNearest[i].first;
+			}
+		}
+		print("nearest", treeMs / queries, scanMs / queries, same);
+		ok &= same;
+
+		// Take everything out again, the tree must end up empty
+		for (const auto proxy : proxies) {
+			tree.remove(proxy);
+		}
+		ok &= tree.size() == 0 && tree.height() == 0;
+		return ok;
+	}
+}
+
+int main(int argc, char** argv) {
+	const int queries = argc > 1 ? std::max(1, std::atoi(argv[1])) : 100;
+
+	std::vector<size_t> counts;
+	for (auto i = 2; i < argc; i++) {
+		counts.push_back(std::max(1, std::atoi(argv[i])));
+	}
+	if (counts.empty()) {
+		counts = { 10000, 100000, 1000000 };
+	}
+
+	auto ok = true;
+	for (const auto count : counts) {
+		ok &= run(count, queries);
+	}
+	return ok ? 0 : 1;
+}
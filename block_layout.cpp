@@ -0,0 +1,108 @@
+#include "block_layout.h"
+#include "glad/glad.h"
+#include <algorithm>
+#include <iostream>
+#include <string>
+#include <vector>
+
+namespace {
+	// A mat3 is 36 bytes in C++ and 48 in a block, the check has to catch it
+	struct mat3_block_t {
+		glm::mat3 normal;
+	};
+
+	// Floats in a std140 array are a vec4 apart, std430 packs them
+	struct float_array_block_t {
+		float weights[4];
+	};
+
+	// vec3 array elements are a vec4 apart in either packing
+	struct vec3_array_block_t {
+		glm::vec3 points[4];
+	};
+}
+
+template <> struct block_members<mat3_block_t> {
+	static constexpr block_member_t value[] = {
+		BLOCK_MEMBER(mat3_block_t, normal),
+	};
+};
+
+template <> struct block_members<float_array_block_t> {
+	static constexpr block_member_t value[] = {
+		BLOCK_MEMBER(float_array_block_t, weights),
+	};
+};
+
+template <> struct block_members<vec3_array_block_t> {
+	static constexpr block_member_t value[] = {
+		BLOCK_MEMBER(vec3_array_block_t, points),
+	};
+};
+
+static_assert(!block_layout::matches<mat3_block_t>(block_packing::std140), "a mat3 member does not match a std140 block");
+static_assert(!block_layout::matches<mat3_block_t>(block_packing::std430), "a mat3 member does not match a std430 block");
+static_assert(!block_layout::matches<float_array_block_t>(block_packing::std140), "a float array does not match a std140 block");
+static_assert(block_layout::matches<float_array_block_t>(block_packing::std430), "a float array matches a std430 block");
+static_assert(!block_layout::matches<vec3_array_block_t>(block_packing::std140), "a vec3 array does not match a std140 block");
+static_assert(!block_layout::matches<vec3_array_block_t>(block_packing::std430), "a vec3 array does not match a std430 block");
+
+namespace block_layout {
+	bool validate(const unsigned int program, const char* block, std::span<const block_member_t> members, const size_t size) {
+		const auto index = glGetUniformBlockIndex(program, block);
+		if (index == GL_INVALID_INDEX) {
+			return true;
+		}
+
+		auto ok = true;
+		GLint dataSize = 0, count = 0;
+		glGetActiveUniformBlockiv(program, index, GL_UNIFORM_BLOCK_DATA_SIZE, &dataSize);
+		glGetActiveUniformBlockiv(program, index, GL_UNIFORM_BLOCK_ACTIVE_UNIFORMS, &count);
+		if (static_cast<size_t>(dataSize) > size) {
+			std::cerr << "Block " << block << " is " << dataSize << " bytes, the struct only " << size << std::endl;
+			ok = false;
+		}
+
+		std::vector<GLint> indices(count);
+		glGetActiveUniformBlockiv(program, index, GL_UNIFORM_BLOCK_ACTIVE_UNIFORM_INDICES, indices.data());
+
+		std::vector<GLuint> uniforms(indices.begin(), indices.end());
+		std::vector<GLint> offsets(count), strides(count);
+		glGetActiveUniformsiv(program, count, uniforms.data(), GL_UNIFORM_OFFSET, offsets.data());
+		glGetActiveUniformsiv(program, count, uniforms.data(), GL_UNIFORM_ARRAY_STRIDE, strides.data());
+
+		for (auto i = 0; i < count; i++) {
+			char buffer[256];
+			glGetActiveUniformName(program, uniforms[i], sizeof(buffer), nullptr, buffer);
+
+			// Blocks with an instance name prefix their members, arrays report "name[0]"
+			std::string name = buffer;
+			if (const auto dot = name.rfind('.'); dot != std::string::npos) {
+				name = name.substr(dot + 1);
+			}
+			if (const auto bracket = name.find('['); bracket != std::string::npos) {
+				name = name.substr(0, bracket);
+			}
+
+			const auto member = std::find_if(members.begin(), members.end(), [&](const block_member_t& m) {
+				return name == m.name;
+			});
+			if (member == members.end()) {
+				std::cerr << "Block " << block << " member " << name << " is missing from the struct" << std::endl;
+				ok = false;
+			}
+			else if (member->offset != static_cast<size_t>(offsets[i])) {
+				std::cerr << "Block " << block << " member " << name << " is at offset " << offsets[i]
+					<< ", the struct has it at " << member->offset << std::endl;
+				ok = false;
+			}
+			else if (member->count > 0 && member->stride != static_cast<size_t>(strides[i])) {
+				std::cerr << "Block " << block << " member " << name << " has an array stride of " << strides[i]
+					<< ", the struct " << member->stride << std::endl;
+				ok = false;
+			}
+		}
+
+		return ok;
+	}
+}
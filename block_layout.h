@@ -0,0 +1,164 @@
+#ifndef BLOCK_LAYOUT_H
+#define BLOCK_LAYOUT_H
+#include <cstddef>
+#include <span>
+#include "glm/glm.hpp"
+
+// Mirrors C++ structs onto GLSL buffer blocks
+// A struct lists its members with BLOCK_MEMBER in a block_members specialization,
+// the std140/std430 offsets are then computed at compile time and checked against
+// the struct, and at link time against what the driver reflected for the block
+//
+//	template <> struct block_members<camera_data_t> {
+//		static constexpr block_member_t value[] = {
+//			BLOCK_MEMBER(camera_data_t, view),
+//			BLOCK_MEMBER(camera_data_t, position),
+//		};
+//	};
+//	static_assert(block_layout::matches<camera_data_t>(block_packing::std140));
+
+enum class block_packing : unsigned char {
+	std140,
+	std430
+};
+
+enum class glsl_type : unsigned char {
+	float1,
+	int1,
+	uint1,
+	vec2,
+	vec3,
+	vec4,
+	mat3,
+	mat4
+};
+
+template <typename T> struct glsl_type_of;
+template <> struct glsl_type_of<float> { static constexpr auto value = glsl_type::float1; };
+template <> struct glsl_type_of<int> { static constexpr auto value = glsl_type::int1; };
+template <> struct glsl_type_of<unsigned int> { static constexpr auto value = glsl_type::uint1; };
+template <> struct glsl_type_of<glm::vec2> { static constexpr auto value = glsl_type::vec2; };
+template <> struct glsl_type_of<glm::vec3> { static constexpr auto value = glsl_type::vec3; };
+template <> struct glsl_type_of<glm::vec4> { static constexpr auto value = glsl_type::vec4; };
+template <> struct glsl_type_of<glm::mat3> { static constexpr auto value = glsl_type::mat3; };
+template <> struct glsl_type_of<glm::mat4> { static constexpr auto value = glsl_type::mat4; };
+template <typename T, size_t N> struct glsl_type_of<T[N]> : glsl_type_of<T> {};
+
+// Array length, 0 for anything that is not an array
+template <typename T> struct glsl_count { static constexpr size_t value = 0; };
+template <typename T, size_t N> struct glsl_count<T[N]> { static constexpr size_t value = N; };
+
+// Bytes from one array element to the next, 0 for anything that is not an array
+template <typename T> struct glsl_stride { static constexpr size_t value = 0; };
+template <typename T, size_t N> struct glsl_stride<T[N]> { static constexpr size_t value = sizeof(T); };
+
+struct block_member_t {
+	const char* name;
+	// Where the member sits in the C++ struct
+	size_t offset;
+	glsl_type type;
+	size_t count;
+	// sizeof the C++ member, and of one element for arrays
+	size_t size;
+	size_t stride;
+};
+
+#define BLOCK_MEMBER(type, member) block_member_t{ #member, offsetof(type, member), \
+	glsl_type_of<decltype(type::member)>::value, glsl_count<decltype(type::member)>::value, \
+	sizeof(decltype(type::member)), glsl_stride<decltype(type::member)>::value }
+
+// Specialize with a static constexpr block_member_t value[], in declaration order
+template <typename T> struct block_members;
+
+namespace block_layout {
+	constexpr size_t round_up(const size_t value, const size_t alignment) {
+		return (value + alignment - 1) / alignment * alignment;
+	}
+
+	// Base alignment of a single value, matrices are columns padded to a vec4
+	constexpr size_t base_alignment(const glsl_type type) {
+		switch (type) {
+		case glsl_type::vec2: return 8;
+		case glsl_type::vec3:
+		case glsl_type::vec4:
+		case glsl_type::mat3:
+		case glsl_type::mat4: return 16;
+		default: return 4;
+		}
+	}
+
+	constexpr size_t base_size(const glsl_type type) {
+		switch (type) {
+		case glsl_type::vec2: return 8;
+		case glsl_type::vec3: return 12;
+		case glsl_type::vec4: return 16;
+		case glsl_type::mat3: return 48;
+		case glsl_type::mat4: return 64;
+		default: return 4;
+		}
+	}
+
+	// std140 rounds array elements up to a vec4, std430 does not
+	constexpr size_t alignment(const block_packing packing, const block_member_t& member) {
+		const auto alignment = base_alignment(member.type);
+		return packing == block_packing::std140 && member.count > 0 ? round_up(alignment, 16) : alignment;
+	}
+
+	constexpr size_t array_stride(const block_packing packing, const block_member_t& member) {
+		return round_up(base_size(member.type), alignment(packing, member));
+	}
+
+	constexpr size_t size(const block_packing packing, const block_member_t& member) {
+		return member.count == 0 ? base_size(member.type) : array_stride(packing, member) * member.count;
+	}
+
+	// Offset the GLSL compiler gives members[index]
+	constexpr size_t offset(const block_packing packing, std::span<const block_member_t> members, const size_t index) {
+		size_t offset = 0;
+		for (size_t i = 0; i < index; i++) {
+			offset = round_up(offset, alignment(packing, members[i])) + size(packing, members[i]);
+		}
+		return round_up(offset, alignment(packing, members[index]));
+	}
+
+	// Bytes the block needs, padded to a vec4 like drivers report it
+	constexpr size_t size(const block_packing packing, std::span<const block_member_t> members) {
+		if (members.empty()) {
+			return 0;
+		}
+
+		const auto last = members.size() - 1;
+		return round_up(offset(packing, members, last) + size(packing, members[last]), 16);
+	}
+
+	// Whether the C++ member takes the bytes the block gives it, a glm::mat3 is three vec3 where
+	// the block has three vec4 columns, and std140 arrays of floats and vec3 step a vec4 at a time
+	constexpr bool fits(const block_packing packing, const block_member_t& member) {
+		if (member.count == 0) {
+			return member.size == base_size(member.type);
+		}
+		return member.stride == array_stride(packing, member) && member.size == size(packing, member);
+	}
+
+	constexpr bool matches(const block_packing packing, std::span<const block_member_t> members, const size_t structSize) {
+		for (size_t i = 0; i < members.size(); i++) {
+			if (members[i].offset != offset(packing, members, i) || !fits(packing, members[i])) {
+				return false;
+			}
+		}
+		return structSize >= size(packing, members);
+	}
+
+	// True when every member of T sits where the block expects it, is laid out the way the
+	// block lays it out, and T is big enough to be copied over the whole block
+	template <typename T>
+	constexpr bool matches(const block_packing packing) {
+		return matches(packing, block_members<T>::value, sizeof(T));
+	}
+
+	// Compares the members against the offsets reflected for a uniform block of a
+	// linked program, differences are reported on stderr
+	bool validate(unsigned int program, const char* block, std::span<const block_member_t> members, size_t size);
+}
+
+#endif // BLOCK_LAYOUT_H
@@ -1,4 +1,5 @@
 #include "glm/glm.hpp"
+#include "culling.h"
 
 class camera {
 	glm::vec3 m_vCameraPos;
@@ -6,6 +7,10 @@ class camera {
 	float m_fPitch, m_fRoll, m_fYaw;
 	bool ortho = false;
 	float m_fFov = 90.f;
+
+	// Planes of the current view and projection, extracted again after either changed
+	mutable frustum_t m_sFrustum;
+	mutable bool m_bFrustumDirty = true;
 	
 	auto update_front() {
 		// calculate the new Front vector
@@ -14,6 +19,7 @@ class camera {
 		front.y = sin(glm::radians(m_fPitch));
 		front.z = sin(glm::radians(m_fYaw)) * cos(glm::radians(m_fPitch));
 		m_vCameraFront = glm::normalize(front);
+		m_bFrustumDirty = true;
 	}
 
 public:
@@ -42,14 +48,25 @@ public:
 		return glm::ortho(0, 1600, 0, 900);
 	}
 
+	[[nodiscard]]
+	auto get_frustum() const -> const frustum_t& {
+		if (m_bFrustumDirty) {
+			m_sFrustum = culling::extract_frustum(get_projection_matrix() * get_view_matrix());
+			m_bFrustumDirty = false;
+		}
+		return m_sFrustum;
+	}
+
 	auto look_at(const glm::vec3& pos) -> void {
 		m_vCameraFront = glm::normalize(pos - m_vCameraPos);
 		m_fPitch = glm::degrees(asin(-m_vCameraFront.y));
 		m_fYaw = glm::degrees(atan2(m_vCameraFront.x, m_vCameraFront.z));
+		m_bFrustumDirty = true;
 	}
 
 	auto set_position(const glm::vec3&& pos) {
 		m_vCameraPos = pos;
+		m_bFrustumDirty = true;
 	}
 
 	[[nodiscard]]
@@ -84,26 +101,32 @@ public:
 
 	auto move_right(const float amount) {
 		m_vCameraPos += right() * amount;
+		m_bFrustumDirty = true;
 	}
 
 	auto move_left(const float amount) {
 		m_vCameraPos -= right() * amount;
+		m_bFrustumDirty = true;
 	}
 
 	auto move_forward(const float amount) {
 		m_vCameraPos += m_vCameraFront * amount;
+		m_bFrustumDirty = true;
 	}
 
 	auto move_backward(const float amount) {
 		m_vCameraPos -= m_vCameraFront * amount;
+		m_bFrustumDirty = true;
 	}
 
 	auto move_up(const float amount) {
 		m_vCameraPos += glm::vec3(0.f, 1.f, 0.f) * amount;
+		m_bFrustumDirty = true;
 	}
 
 	auto move_down(const float amount) {
 		m_vCameraPos -= glm::vec3(0.f, 1.f, 0.f) * amount;
+		m_bFrustumDirty = true;
 	}
 
 	auto adjust_fov(const float amount) {
@@ -113,6 +136,7 @@ public:
 		} else if (m_fFov > 120.f) {
 			m_fFov = 120.f;
 		}
+		m_bFrustumDirty = true;
 	}
 
 	camera(glm::vec3&& pos) : m_vCameraPos{ pos } {}
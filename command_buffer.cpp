@@ -0,0 +1,71 @@
+#include "command_buffer.h"
+#include "model.h"
+#include "mesh.h"
+#include "material.h"
+#include "job_system.h"
+#include <algorithm>
+#include "glm/gtc/matrix_inverse.hpp"
+
+namespace {
+	// Below this a job costs more to hand out than recording saves
+	constexpr uint32_t MIN_DRAWS_PER_BUFFER = 4096;
+
+	uint64_t make_key(const render_pass pass, const model& source, const float depth, const float farPlane) {
+		const auto& material = source.get_material();
+		return render_queue::make_key(pass, source.get_shader()->get_id(), material ? material->get_id() : 0,
+			source.get_mesh()->get_id(), depth, farPlane);
+	}
+}
+
+void command_buffer::reset(const float farPlane) {
+	m_vBytes.clear();
+	m_uCommands = 0;
+	m_fFarPlane = farPlane;
+}
+
+void command_buffer::draw(const render_pass pass, const model& source, const glm::mat4& transform, const float depth) {
+	// Only instanced shaders read the normal matrix, the inverse is the costly part of a draw
+	if (source.get_shader()->uses_instancing()) {
+		draw(pass, source, transform, glm::inverseTranspose(glm::mat3(transform)), depth);
+		return;
+	}
+
+	write(opcode::draw);
+	write(make_key(pass, source, depth, m_fFarPlane));
+	write(&source);
+	write(transform);
+	m_uCommands++;
+}
+
+void command_buffer::draw(const render_pass pass, const model& source, const glm::mat4& transform, const glm::mat3& normal, const float depth) {
+	const auto instanced = source.get_shader()->uses_instancing();
+	write(instanced ? opcode::draw_instanced : opcode::draw);
+	write(make_key(pass, source, depth, m_fFarPlane));
+	write(&source);
+	write(transform);
+	if (instanced) {
+		write(normal);
+	}
+	m_uCommands++;
+}
+
+void command_buffer::record(std::vector<command_buffer>& buffers, const uint32_t count, const float farPlane,
+	const std::function<void(command_buffer&, uint32_t, uint32_t)>& record, const unsigned int maxThreads) {
+	const auto threads = maxThreads ? maxThreads : job_system::thread_count();
+	const auto ranges = std::clamp(count / MIN_DRAWS_PER_BUFFER, 1u, threads);
+	const auto slice = (count + ranges - 1) / ranges;
+
+	if (buffers.size() < ranges) {
+		buffers.resize(ranges);
+	}
+	for (auto& buffer : buffers) {
+		buffer.reset(farPlane);
+	}
+
+	job_system::parallel_for(ranges, 1, [&](const uint32_t begin, const uint32_t end) {
+		for (auto r = begin; r < end; r++) {
+			const auto first = std::min(count, r * slice);
+			record(buffers[r], first, std::min(count, first + slice));
+		}
+	});
+}
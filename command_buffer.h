@@ -0,0 +1,98 @@
+#ifndef COMMAND_BUFFER_H
+#define COMMAND_BUFFER_H
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <vector>
+#include "glm/glm.hpp"
+#include "render_queue.h"
+
+class model;
+
+// Draws recorded away from the GL thread, replayed into a render_queue on it
+//
+// Commands are packed back to back in one byte array, an opcode followed by its operands:
+//   draw            key, model, transform
+//   draw_instanced  key, model, transform, normal matrix
+// Recording only reads the models, so any number of threads can fill their own buffers
+// at once. The sort key and the normal matrix of instanced draws are worked out while
+// recording, the GL thread only copies the draws into the queue
+class command_buffer {
+public:
+	enum class opcode : unsigned char {
+		draw,
+		draw_instanced
+	};
+
+private:
+	std::vector<unsigned char> m_vBytes;
+	uint32_t m_uCommands = 0;
+	float m_fFarPlane = 100.f;
+
+	template<typename T>
+	void write(const T& value) {
+		const auto offset = m_vBytes.size();
+		m_vBytes.resize(offset + sizeof(T));
+		std::memcpy(m_vBytes.data() + offset, &value, sizeof(T));
+	}
+
+	template<typename T>
+	static T read(const unsigned char*& cursor) {
+		T value;
+		std::memcpy(&value, cursor, sizeof(T));
+		cursor += sizeof(T);
+		return value;
+	}
+
+public:
+	// Empty the buffer, keeping its memory. Depths of the draws recorded next are quantized over
+	// [0, far plane], which has to match the queue the buffer is replayed into
+	void reset(float farPlane);
+
+	void draw(render_pass pass, const model& source, const glm::mat4& transform, float depth);
+
+	// With the normal matrix already at hand, like the ones a scene graph caches
+	void draw(render_pass pass, const model& source, const glm::mat4& transform, const glm::mat3& normal, float depth);
+
+	// Commands recorded since the last reset
+	[[nodiscard]]
+	uint32_t size() const {
+		return m_uCommands;
+	}
+
+	[[nodiscard]]
+	size_t bytes() const {
+		return m_vBytes.size();
+	}
+
+	// Calls draw(key, source, transform, normal) for every command in recording order
+	// The normal matrix is only meaningful for instanced draws
+	template<typename F>
+	void replay(F&& draw) const {
+		static const glm::mat3 IDENTITY{ 1.f };
+		const auto* cursor = m_vBytes.data();
+		const auto* end = cursor + m_vBytes.size();
+		while (cursor < end) {
+			const auto op = read<opcode>(cursor);
+			const auto key = read<uint64_t>(cursor);
+			const auto* source = read<const model*>(cursor);
+			const auto transform = read<glm::mat4>(cursor);
+			if (op == opcode::draw_instanced) {
+				draw(key, *source, transform, read<glm::mat3>(cursor));
+			}
+			else {
+				draw(key, *source, transform, IDENTITY);
+			}
+		}
+	}
+
+	// Record count draws split over buffers, one job each, record(buffer, first, end) fills a
+	// buffer with draws [first, end). Below a few thousand draws everything goes in the first buffer
+	// Buffers come back in range order, so replaying them in order queues the same draws as
+	// recording them all on one thread. buffers only grows, the ones not used are left empty
+	// maxThreads caps the buffers used, 0 gives one per job system thread
+	static void record(std::vector<command_buffer>& buffers, uint32_t count, float farPlane,
+		const std::function<void(command_buffer&, uint32_t, uint32_t)>& record, unsigned int maxThreads = 0);
+};
+
+#endif // COMMAND_BUFFER_H
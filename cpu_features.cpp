@@ -0,0 +1,80 @@
+#include "cpu_features.h"
+
+#if defined(CPU_FEATURES_X86) && defined(_MSC_VER)
+#include <intrin.h>
+#include <immintrin.h>
+#endif
+
+namespace {
+#if defined(CPU_FEATURES_X86) && defined(_MSC_VER)
+	// AVX itself, and an OS that saves the YMM registers
+	bool os_supports_avx() {
+		int info[4];
+		__cpuid(info, 1);
+		const auto osxsave = (info[2] & (1 << 27)) != 0;
+		const auto avx = (info[2] & (1 << 28)) != 0;
+		return osxsave && avx && (_xgetbv(0) & 6) == 6;
+	}
+#endif
+
+	bool detect_avx2() {
+#if !defined(CPU_FEATURES_X86)
+		return false;
+#elif defined(_MSC_VER)
+		int info[4];
+		__cpuid(info, 0);
+		if (info[0] < 7 || !os_supports_avx()) {
+			return false;
+		}
+
+		__cpuidex(info, 7, 0);
+		return (info[1] & (1 << 5)) != 0;
+#else
+		__builtin_cpu_init();
+		return __builtin_cpu_supports("avx2");
+#endif
+	}
+
+	bool detect_fma() {
+#if !defined(CPU_FEATURES_X86)
+		return false;
+#elif defined(_MSC_VER)
+		int info[4];
+		__cpuid(info, 1);
+		return (info[2] & (1 << 12)) != 0 && os_supports_avx();
+#else
+		__builtin_cpu_init();
+		return __builtin_cpu_supports("fma");
+#endif
+	}
+
+	bool detect_sse41() {
+#if !defined(CPU_FEATURES_X86)
+		return false;
+#elif defined(_MSC_VER)
+		int info[4];
+		__cpuid(info, 1);
+		return (info[2] & (1 << 19)) != 0;
+#else
+		__builtin_cpu_init();
+		return __builtin_cpu_supports("sse4.1");
+#endif
+	}
+}
+
+namespace cpu_features {
+	bool has_avx2() {
+		static const bool avx2 = detect_avx2();
+		return avx2;
+	}
+
+	bool has_fma() {
+		static const bool fma = detect_fma();
+		return fma;
+	}
+
+	bool has_sse41() {
+		static const bool sse41 = detect_sse41();
+		return sse41;
+	}
+}
@@ -0,0 +1,33 @@
+#ifndef CPU_FEATURES_H
+#define CPU_FEATURES_H
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+#define CPU_FEATURES_X86 1
+#endif
+
+// Functions marked TARGET_AVX2 are compiled for AVX2 next to their scalar versions,
+// they may only be called when cpu_features::has_avx2() says so, and likewise for the others
+// MSVC accepts the intrinsics anywhere, GCC and Clang need the attribute
+#if defined(CPU_FEATURES_X86) && (defined(__GNUC__) || defined(__clang__))
+#define TARGET_AVX2 __attribute__((target("avx2")))
+#define TARGET_AVX2_FMA __attribute__((target("avx2,fma")))
+#define TARGET_SSE41 __attribute__((target("sse4.1")))
+#else
+#define TARGET_AVX2
+#define TARGET_AVX2_FMA
+#define TARGET_SSE41
+#endif
+
+// What the CPU we run on supports, detected once
+namespace cpu_features {
+	[[nodiscard]]
+	bool has_avx2();
+
+	[[nodiscard]]
+	bool has_fma();
+
+	[[nodiscard]]
+	bool has_sse41();
+}
+
+#endif // CPU_FEATURES_H
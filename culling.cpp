@@ -0,0 +1,189 @@
+#include "culling.h"
+#include "cpu_features.h"
+#include "job_system.h"
+#include <algorithm>
+#include <bit>
+#include <cmath>
+#include <cstring>
+
+#if defined(CPU_FEATURES_X86)
+#include <immintrin.h>
+#endif
+
+namespace {
+	using kernel_fn = size_t(*)(const frustum_t&, const culling::bounds_t&, uint32_t, uint32_t, uint32_t*);
+
+	// Below this a job costs more to hand out than it saves
+	constexpr uint32_t MIN_BOXES_PER_JOB = 1 << 16;
+
+	culling::kernel selectedKernel = culling::kernel::automatic;
+	unsigned int maxThreads = 0;
+
+	// Writes the index of every visible box in [first, end) to out, returns how many
+	size_t cull_scalar(const frustum_t& frustum, const culling::bounds_t& bounds, const uint32_t first, const uint32_t end, uint32_t* out) {
+		size_t count = 0;
+		for (auto i = first; i < end; i++) {
+			auto visible = true;
+			for (const auto& plane : frustum.planes) {
+				// Distance of the center, and how far the box reaches towards the plane
+				const auto distance = plane.x * bounds.centerX[i] + plane.y * bounds.centerY[i] + plane.z * bounds.centerZ[i] + plane.w;
+				const auto radius = std::abs(plane.x) * bounds.extentX[i] + std::abs(plane.y) * bounds.extentY[i] + std::abs(plane.z) * bounds.extentZ[i];
+				if (distance + radius < 0.f) {
+					visible = false;
+					break;
+				}
+			}
+
+			// Always write, only keep it when visible
+			out[count] = i;
+			count += visible;
+		}
+		return count;
+	}
+
+#if defined(CPU_FEATURES_X86)
+	// Same test for 8 boxes at a time, the tail goes through the scalar kernel
+	TARGET_AVX2 size_t cull_avx2(const frustum_t& frustum, const culling::bounds_t& bounds, const uint32_t first, const uint32_t end, uint32_t* out) {
+		__m256 nx[6], ny[6], nz[6], nw[6], ax[6], ay[6], az[6];
+		for (auto p = 0; p < 6; p++) {
+			const auto& plane = frustum.planes[p];
+			nx[p] = _mm256_set1_ps(plane.x);
+			ny[p] = _mm256_set1_ps(plane.y);
+			nz[p] = _mm256_set1_ps(plane.z);
+			nw[p] = _mm256_set1_ps(plane.w);
+			ax[p] = _mm256_set1_ps(std::abs(plane.x));
+			ay[p] = _mm256_set1_ps(std::abs(plane.y));
+			az[p] = _mm256_set1_ps(std::abs(plane.z));
+		}
+		const auto zero = _mm256_setzero_ps();
+
+		size_t count = 0;
+		auto i = first;
+		for (; i + 8 <= end; i += 8) {
+			const auto cx = _mm256_loadu_ps(&bounds.centerX[i]);
+			const auto cy = _mm256_loadu_ps(&bounds.centerY[i]);
+			const auto cz = _mm256_loadu_ps(&bounds.centerZ[i]);
+			const auto ex = _mm256_loadu_ps(&bounds.extentX[i]);
+			const auto ey = _mm256_loadu_ps(&bounds.extentY[i]);
+			const auto ez = _mm256_loadu_ps(&bounds.extentZ[i]);
+
+			// Summed in the scalar kernel's order so both agree on every box
+			auto inside = _mm256_castsi256_ps(_mm256_set1_epi32(-1));
+			for (auto p = 0; p < 6; p++) {
+				auto distance = _mm256_add_ps(_mm256_mul_ps(nx[p], cx), _mm256_mul_ps(ny[p], cy));
+				distance = _mm256_add_ps(_mm256_add_ps(distance, _mm256_mul_ps(nz[p], cz)), nw[p]);
+				auto radius = _mm256_add_ps(_mm256_mul_ps(ax[p], ex), _mm256_mul_ps(ay[p], ey));
+				radius = _mm256_add_ps(radius, _mm256_mul_ps(az[p], ez));
+				inside = _mm256_and_ps(inside, _mm256_cmp_ps(_mm256_add_ps(distance, radius), zero, _CMP_NLT_UQ));
+			}
+
+			auto mask = static_cast<unsigned int>(_mm256_movemask_ps(inside));
+			while (mask) {
+				out[count++] = i + std::countr_zero(mask);
+				mask &= mask - 1;
+			}
+		}
+
+		return count + cull_scalar(frustum, bounds, i, end, out + count);
+	}
+#endif
+
+	kernel_fn pick_kernel() {
+#if defined(CPU_FEATURES_X86)
+		if (selectedKernel != culling::kernel::scalar && cpu_features::has_avx2()) {
+			return cull_avx2;
+		}
+#endif
+		return cull_scalar;
+	}
+}
+
+namespace culling {
+	void bounds_t::clear() {
+		centerX.clear();
+		centerY.clear();
+		centerZ.clear();
+		extentX.clear();
+		extentY.clear();
+		extentZ.clear();
+	}
+
+	void bounds_t::reserve(const size_t count) {
+		centerX.reserve(count);
+		centerY.reserve(count);
+		centerZ.reserve(count);
+		extentX.reserve(count);
+		extentY.reserve(count);
+		extentZ.reserve(count);
+	}
+
+	void bounds_t::push(const aabb_t& box) {
+		centerX.push_back(box.center.x);
+		centerY.push_back(box.center.y);
+		centerZ.push_back(box.center.z);
+		extentX.push_back(box.extent.x);
+		extentY.push_back(box.extent.y);
+		extentZ.push_back(box.extent.z);
+	}
+
+	frustum_t extract_frustum(const glm::mat4& m) {
+		// Rows of the matrix, glm stores columns
+		const glm::vec4 x(m[0][0], m[1][0], m[2][0], m[3][0]);
+		const glm::vec4 y(m[0][1], m[1][1], m[2][1], m[3][1]);
+		const glm::vec4 z(m[0][2], m[1][2], m[2][2], m[3][2]);
+		const glm::vec4 w(m[0][3], m[1][3], m[2][3], m[3][3]);
+
+		frustum_t frustum{ { w + x, w - x, w + y, w - y, w + z, w - z } };
+		for (auto& plane : frustum.planes) {
+			plane /= glm::length(glm::vec3(plane));
+		}
+		return frustum;
+	}
+
+	aabb_t transform(const aabb_t& box, const glm::mat4& matrix) {
+		// Arvo: each new half size is the old one projected on the absolute axes
+		const glm::mat3 linear(matrix);
+		const glm::mat3 absolute(glm::abs(linear[0]), glm::abs(linear[1]), glm::abs(linear[2]));
+		return { glm::vec3(matrix * glm::vec4(box.center, 1.f)), absolute * box.extent };
+	}
+
+	void set_kernel(const kernel selected) {
+		selectedKernel = selected;
+	}
+
+	void set_max_threads(const unsigned int threads) {
+		maxThreads = threads;
+	}
+
+	void cull(const frustum_t& frustum, const bounds_t& bounds, std::vector<uint32_t>& visible) {
+		const auto kernel = pick_kernel();
+		const auto count = static_cast<uint32_t>(bounds.size());
+		visible.resize(count);
+
+		const auto threads = maxThreads ? maxThreads : job_system::thread_count();
+		const auto slices = std::clamp(count / MIN_BOXES_PER_JOB, 1u, threads);
+		if (slices == 1) {
+			visible.resize(kernel(frustum, bounds, 0, count, visible.data()));
+			return;
+		}
+
+		// Each job compacts into its own slice of the output, the slices are joined after
+		// Slices are a multiple of 8 so only the last one has a scalar tail
+		const auto slice = (count / slices + 7) & ~7u;
+		std::vector<size_t> found(slices);
+		job_system::parallel_for(slices, 1, [&](const uint32_t begin, const uint32_t end) {
+			for (auto t = begin; t < end; t++) {
+				const auto first = std::min(count, t * slice);
+				const auto last = t + 1 == slices ? count : std::min(count, first + slice);
+				found[t] = kernel(frustum, bounds, first, last, visible.data() + first);
+			}
+		});
+
+		size_t total = found[0];
+		for (auto t = 1u; t < slices; t++) {
+			std::memmove(visible.data() + total, visible.data() + std::min(count, t * slice), found[t] * sizeof(uint32_t));
+			total += found[t];
+		}
+		visible.resize(total);
+	}
+}
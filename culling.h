@@ -0,0 +1,65 @@
+#ifndef CULLING_H
+#define CULLING_H
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+#include "glm/glm.hpp"
+
+// Axis aligned box as its center and half size
+struct aabb_t {
+	glm::vec3 center{ 0 };
+	glm::vec3 extent{ 0 };
+};
+
+// Normalized planes of a view frustum, xyz points inside and w is the distance
+// Order is left, right, bottom, top, near, far
+struct frustum_t {
+	glm::vec4 planes[6];
+};
+
+// Visibility tests of many world space boxes against a frustum
+// Boxes are kept as structure of arrays so the AVX2 kernel tests 8 per iteration,
+// CPUs without it use the scalar kernel, and big sets are split across threads
+namespace culling {
+	// Boxes in structure of arrays layout
+	struct bounds_t {
+		std::vector<float> centerX, centerY, centerZ;
+		std::vector<float> extentX, extentY, extentZ;
+
+		void clear();
+		void reserve(size_t count);
+		void push(const aabb_t& box);
+
+		[[nodiscard]]
+		size_t size() const {
+			return centerX.size();
+		}
+	};
+
+	enum class kernel {
+		// AVX2 when the CPU has it
+		automatic,
+		scalar,
+		avx2
+	};
+
+	// Gribb/Hartmann plane extraction, works for any projection
+	[[nodiscard]]
+	frustum_t extract_frustum(const glm::mat4& viewProjection);
+
+	// The box around a transformed box
+	[[nodiscard]]
+	aabb_t transform(const aabb_t& box, const glm::mat4& matrix);
+
+	// Mostly for benchmarks, an unsupported kernel falls back to scalar
+	void set_kernel(kernel selected);
+
+	// Upper bound on the jobs a cull is split into, 0 gives one per job system thread
+	void set_max_threads(unsigned int threads);
+
+	// Indices of the boxes that touch the frustum, in ascending order
+	// Boxes straddling a plane count as visible
+	void cull(const frustum_t& frustum, const bounds_t& bounds, std::vector<uint32_t>& visible);
+}
+
+#endif // CULLING_H
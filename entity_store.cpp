@@ -0,0 +1,215 @@
+#include "entity_store.h"
+#include "batch_math.h"
+#include "job_system.h"
+#include <algorithm>
+#include <cstring>
+#include "glm/gtx/transform.hpp"
+
+namespace {
+	// Below this a job costs more to hand out than it saves
+	constexpr uint32_t MIN_ENTITIES_PER_JOB = 1 << 15;
+
+	// Split [0, count) into at most maxThreads contiguous ranges, 0 gives one per job system thread
+	// work(range, first, end) runs as a job on each, returns how many ranges there were
+	template<typename F>
+	unsigned int split(const uint32_t count, const unsigned int maxThreads, F&& work) {
+		const auto threads = maxThreads ? maxThreads : job_system::thread_count();
+		const auto ranges = std::clamp(count / MIN_ENTITIES_PER_JOB, 1u, threads);
+		const auto slice = (count + ranges - 1) / ranges;
+
+		job_system::parallel_for(ranges, 1, [&](const uint32_t begin, const uint32_t end) {
+			for (auto r = begin; r < end; r++) {
+				const auto first = std::min(count, r * slice);
+				work(r, first, std::min(count, first + slice));
+			}
+		});
+		return ranges;
+	}
+
+	template<typename T>
+	void move_last(std::vector<T>& values, const uint32_t slot) {
+		values[slot] = values.back();
+		values.pop_back();
+	}
+}
+
+entity_t entity_store::create(const model* source, const aabb_t& bounds) {
+	uint32_t index;
+	if (m_vFree.empty()) {
+		index = static_cast<uint32_t>(m_vSlots.size());
+		m_vSlots.push_back(0);
+		m_vGenerations.push_back(0);
+	}
+	else {
+		index = m_vFree.back();
+		m_vFree.pop_back();
+	}
+
+	const entity_t entity{ index, m_vGenerations[index] };
+	m_vSlots[index] = static_cast<uint32_t>(m_vEntities.size());
+
+	m_vEntities.push_back(entity);
+	m_vPositions.emplace_back(0.f);
+	m_vRotations.emplace_back(0.f);
+	m_vScales.emplace_back(1.f);
+	m_vLocalBounds.push_back(bounds);
+	m_vSources.push_back(source);
+	m_vDirty.push_back(COMPONENTS);
+	m_vWorlds.emplace_back(1.f);
+	m_vNormals.emplace_back(1.f);
+	m_sBounds.push(bounds);
+	return entity;
+}
+
+void entity_store::destroy(const entity_t entity) {
+	if (!alive(entity)) {
+		return;
+	}
+
+	// The last slot moves into the freed one
+	const auto slot = m_vSlots[entity.index];
+	m_vSlots[m_vEntities.back().index] = slot;
+	move_last(m_vEntities, slot);
+	move_last(m_vPositions, slot);
+	move_last(m_vRotations, slot);
+	move_last(m_vScales, slot);
+	move_last(m_vLocalBounds, slot);
+	move_last(m_vSources, slot);
+	move_last(m_vDirty, slot);
+	move_last(m_vWorlds, slot);
+	move_last(m_vNormals, slot);
+	move_last(m_sBounds.centerX, slot);
+	move_last(m_sBounds.centerY, slot);
+	move_last(m_sBounds.centerZ, slot);
+	move_last(m_sBounds.extentX, slot);
+	move_last(m_sBounds.extentY, slot);
+	move_last(m_sBounds.extentZ, slot);
+
+	m_vSlots[entity.index] = UINT32_MAX;
+	m_vGenerations[entity.index]++;
+	m_vFree.push_back(entity.index);
+}
+
+void entity_store::set_position(const entity_t entity, const glm::vec3& position) {
+	const auto slot = get_slot(entity);
+	m_vPositions[slot] = position;
+	mark(slot);
+}
+
+void entity_store::set_rotation(const entity_t entity, const float pitch, const float yaw) {
+	const auto slot = get_slot(entity);
+	m_vRotations[slot] = { pitch, yaw };
+	mark(slot);
+}
+
+void entity_store::set_scale(const entity_t entity, const glm::vec3& scale) {
+	const auto slot = get_slot(entity);
+	m_vScales[slot] = scale;
+	mark(slot);
+}
+
+void entity_store::set_world(const entity_t entity, const glm::mat4& world) {
+	const auto slot = get_slot(entity);
+	m_vWorlds[slot] = world;
+	m_vPositions[slot] = glm::vec3(world[3]);
+	m_vDirty[slot] = WORLD;
+}
+
+glm::mat4 entity_store::get_current_world(const entity_t entity) const {
+	const auto slot = get_slot(entity);
+	if (m_vDirty[slot] != COMPONENTS) {
+		return m_vWorlds[slot];
+	}
+
+	// SCALE ROTATE TRANSFORM, like compose_trs
+	const auto identity = glm::mat4(1.f);
+	const auto& rotation = m_vRotations[slot];
+	const auto rotate = glm::rotate(identity, glm::radians(rotation.y), glm::vec3{ 0.f, 1.f, 0.f })
+		* glm::rotate(identity, glm::radians(rotation.x), glm::vec3{ 1.f, 0.f, 0.f });
+	return glm::translate(identity, m_vPositions[slot]) * rotate * glm::scale(identity, m_vScales[slot]);
+}
+
+void entity_store::set_max_threads(const unsigned int threads) {
+	m_uMaxThreads = threads;
+}
+
+unsigned int entity_store::update_transforms() {
+	m_vJobChanged.resize(m_uMaxThreads ? m_uMaxThreads : job_system::thread_count());
+	const auto threads = split(static_cast<uint32_t>(size()), static_cast<unsigned int>(m_vJobChanged.size()), [&](const unsigned int t, const uint32_t first, const uint32_t end) {
+		// The batch kernels run over each run of consecutive dirty slots
+		auto& changed = m_vJobChanged[t];
+		changed.clear();
+		for (auto slot = first; slot < end;) {
+			if (m_vDirty[slot] == CLEAN) {
+				slot++;
+				continue;
+			}
+			auto last = slot;
+			while (last < end && m_vDirty[last] != CLEAN) {
+				last++;
+			}
+
+			// Worlds that were set whole only need their normals
+			for (auto from = slot; from < last;) {
+				const auto dirty = m_vDirty[from];
+				auto to = from;
+				while (to < last && m_vDirty[to] == dirty) {
+					m_vDirty[to++] = CLEAN;
+				}
+				if (dirty == COMPONENTS) {
+					batch_math::compose_trs(m_vPositions.data() + from, m_vRotations.data() + from, m_vScales.data() + from, to - from,
+						m_vWorlds.data() + from, m_vNormals.data() + from);
+				}
+				else {
+					batch_math::inverse_transpose(m_vWorlds.data() + from, to - from, m_vNormals.data() + from);
+				}
+				from = to;
+			}
+
+			batch_math::transform_bounds(m_vLocalBounds.data() + slot, m_vWorlds.data() + slot, last - slot, m_sBounds, slot);
+			for (auto i = slot; i < last; i++) {
+				changed.push_back(i);
+			}
+			slot = last;
+		}
+	});
+
+	m_vChanged.clear();
+	for (auto t = 0u; t < threads; t++) {
+		m_vChanged.insert(m_vChanged.end(), m_vJobChanged[t].begin(), m_vJobChanged[t].end());
+	}
+	return static_cast<unsigned int>(m_vChanged.size());
+}
+
+void entity_store::cull(const frustum_t& frustum, std::vector<uint32_t>& visible) const {
+	culling::cull(frustum, m_sBounds, visible);
+}
+
+void entity_store::build_draw_list(const std::vector<uint32_t>& visible, const glm::vec3& eye, std::vector<draw_t>& draws) const {
+	const auto count = static_cast<uint32_t>(visible.size());
+	const auto first = draws.size();
+	draws.resize(first + count);
+
+	// Each job compacts into its own range of the output, the ranges are joined after
+	std::vector<uint32_t> found(m_uMaxThreads ? m_uMaxThreads : job_system::thread_count());
+	std::vector<uint32_t> starts(found.size());
+	const auto threads = split(count, static_cast<unsigned int>(found.size()), [&](const unsigned int t, const uint32_t begin, const uint32_t end) {
+		auto* out = draws.data() + first + begin;
+		uint32_t written = 0;
+		for (auto i = begin; i < end; i++) {
+			const auto slot = visible[i];
+			if (const auto* source = m_vSources[slot]) {
+				out[written++] = { source, slot, glm::distance(eye, m_vPositions[slot]) };
+			}
+		}
+		starts[t] = begin;
+		found[t] = written;
+	});
+
+	auto total = static_cast<uint32_t>(found[0]);
+	for (auto t = 1u; t < threads; t++) {
+		std::memmove(draws.data() + first + total, draws.data() + first + starts[t], found[t] * sizeof(draw_t));
+		total += found[t];
+	}
+	draws.resize(first + total);
+}
@@ -0,0 +1,180 @@
+#ifndef ENTITY_STORE_H
+#define ENTITY_STORE_H
+#include <cstdint>
+#include <vector>
+#include "glm/glm.hpp"
+#include "culling.h"
+
+class model;
+
+// Handle to an entity, the generation tells a reused index apart from the entity that had it before
+struct entity_t {
+	uint32_t index = UINT32_MAX;
+	uint32_t generation = 0;
+
+	bool operator==(const entity_t& other) const = default;
+};
+
+// Transform and render components of many entities, one contiguous array per component
+//
+// Components live in dense slots that stay packed, destroying an entity moves the last one
+// into its slot, so the systems below walk plain arrays front to back. Handles map to slots
+// through a sparse table and stay valid however slots move. World bounds are kept in the
+// culling layout, so culling reads them as they are, and the systems split big stores
+// across threads. Entities share their mesh, shader and material through a model, and a
+// model's own placement is an entity too, see model
+// Entities placed by something else, like a scene graph node, can take their world matrix
+// whole instead of being built from position, rotation and scale
+class entity_store {
+public:
+	// A visible entity ready for render_queue::submit with its slot's matrices
+	struct draw_t {
+		const model* source;
+		uint32_t slot;
+		float depth;
+	};
+
+private:
+	// What update_transforms has to do for a slot
+	enum dirty_t : uint8_t {
+		CLEAN,
+		// Build the world matrix from position, rotation and scale
+		COMPONENTS,
+		// The world matrix was set, only normal and bounds follow it
+		WORLD
+	};
+
+	// Dense, by slot
+	std::vector<entity_t> m_vEntities;
+	std::vector<glm::vec3> m_vPositions;
+	// Pitch and yaw in degrees, applied like model's
+	std::vector<glm::vec2> m_vRotations;
+	std::vector<glm::vec3> m_vScales;
+	std::vector<aabb_t> m_vLocalBounds;
+	std::vector<const model*> m_vSources;
+	std::vector<uint8_t> m_vDirty;
+	std::vector<glm::mat4> m_vWorlds;
+	std::vector<glm::mat3> m_vNormals;
+	culling::bounds_t m_sBounds;
+
+	// Slots the last update_transforms recomputed, and each job's share of them
+	std::vector<uint32_t> m_vChanged;
+	std::vector<std::vector<uint32_t>> m_vJobChanged;
+
+	// Sparse, by entity index
+	std::vector<uint32_t> m_vSlots;
+	std::vector<uint32_t> m_vGenerations;
+	std::vector<uint32_t> m_vFree;
+
+	unsigned int m_uMaxThreads = 0;
+
+	void mark(uint32_t slot) {
+		m_vDirty[slot] = COMPONENTS;
+	}
+
+public:
+	// source may be null for entities nothing draws, bounds are in model space
+	entity_t create(const model* source, const aabb_t& bounds);
+	void destroy(entity_t entity);
+
+	[[nodiscard]]
+	bool alive(const entity_t entity) const {
+		return entity.index < m_vGenerations.size() && m_vGenerations[entity.index] == entity.generation
+			&& m_vSlots[entity.index] != UINT32_MAX;
+	}
+
+	// Where the entity's components are, until an entity is destroyed
+	[[nodiscard]]
+	uint32_t get_slot(const entity_t entity) const {
+		return m_vSlots[entity.index];
+	}
+
+	void set_position(entity_t entity, const glm::vec3& position);
+	void set_rotation(entity_t entity, float pitch, float yaw);
+	void set_scale(entity_t entity, const glm::vec3& scale);
+
+	// Place the entity by its world matrix, until its position, rotation or scale is set again
+	// The position follows the matrix's translation, so depth sorts by where it really is
+	void set_world(entity_t entity, const glm::mat4& world);
+
+	// World matrix of the latest placement, whether update_transforms ran since or not
+	[[nodiscard]]
+	glm::mat4 get_current_world(entity_t entity) const;
+
+	[[nodiscard]]
+	const glm::vec3& get_position(const entity_t entity) const {
+		return m_vPositions[get_slot(entity)];
+	}
+
+	// Pitch and yaw in degrees
+	[[nodiscard]]
+	const glm::vec2& get_rotation(const entity_t entity) const {
+		return m_vRotations[get_slot(entity)];
+	}
+
+	[[nodiscard]]
+	const glm::vec3& get_scale(const entity_t entity) const {
+		return m_vScales[get_slot(entity)];
+	}
+
+	[[nodiscard]]
+	const model* get_source(const uint32_t slot) const {
+		return m_vSources[slot];
+	}
+
+	[[nodiscard]]
+	entity_t get_entity(const uint32_t slot) const {
+		return m_vEntities[slot];
+	}
+
+	// As of the last update_transforms
+	[[nodiscard]]
+	const glm::mat4& get_world(const uint32_t slot) const {
+		return m_vWorlds[slot];
+	}
+
+	[[nodiscard]]
+	const glm::mat3& get_normal(const uint32_t slot) const {
+		return m_vNormals[slot];
+	}
+
+	[[nodiscard]]
+	const culling::bounds_t& get_bounds() const {
+		return m_sBounds;
+	}
+
+	// As of the last update_transforms
+	[[nodiscard]]
+	aabb_t get_world_bounds(const uint32_t slot) const {
+		return { { m_sBounds.centerX[slot], m_sBounds.centerY[slot], m_sBounds.centerZ[slot] },
+			{ m_sBounds.extentX[slot], m_sBounds.extentY[slot], m_sBounds.extentZ[slot] } };
+	}
+
+	[[nodiscard]]
+	size_t size() const {
+		return m_vEntities.size();
+	}
+
+	// Upper bound on the jobs a system is split into, 0 gives one per job system thread
+	void set_max_threads(unsigned int threads);
+
+	// Recompute world and normal matrices and world bounds of the entities changed since the
+	// last call, returns how many
+	unsigned int update_transforms();
+
+	// Slots the last update_transforms recomputed, in ascending order, until an entity is destroyed
+	[[nodiscard]]
+	const std::vector<uint32_t>& get_changed() const {
+		return m_vChanged;
+	}
+
+	// Slots of the entities whose world bounds touch the frustum, in ascending order
+	// Threads and kernel follow the culling settings
+	void cull(const frustum_t& frustum, std::vector<uint32_t>& visible) const;
+
+	// One draw per visible slot that has a source, in the order given
+	// depth is the distance from eye, as model::submit uses
+	void build_draw_list(const std::vector<uint32_t>& visible, const glm::vec3& eye, std::vector<draw_t>& draws) const;
+};
+
+#endif // ENTITY_STORE_H
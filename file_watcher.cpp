@@ -0,0 +1,114 @@
+#include "file_watcher.h"
+#include <algorithm>
+#include <iostream>
+
+#ifdef __linux__
+#include <sys/inotify.h>
+#include <unistd.h>
+#endif
+
+#ifdef __linux__
+file_watcher::file_watcher(const std::string& directory) : m_pDirectory(directory) {
+	m_iFd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+	if (m_iFd < 0) {
+		std::cerr << "Failed to initialize inotify for " << directory << std::endl;
+		return;
+	}
+
+	// Editors often write a temporary file and rename it over the original, so watch moves too
+	constexpr auto mask = IN_CLOSE_WRITE | IN_MOVED_TO | IN_CREATE;
+
+	const auto add_watch = [&](const std::filesystem::path& dir, const std::string& prefix) {
+		const auto wd = inotify_add_watch(m_iFd, dir.string().c_str(), mask);
+		if (wd >= 0) {
+			m_mWatches[wd] = prefix;
+		}
+	};
+
+	// inotify is not recursive, every subdirectory needs its own watch
+	add_watch(m_pDirectory, "");
+	std::error_code ec;
+	for (const auto& entry : std::filesystem::recursive_directory_iterator(m_pDirectory, ec)) {
+		if (entry.is_directory()) {
+			add_watch(entry.path(), std::filesystem::relative(entry.path(), m_pDirectory).generic_string() + "/");
+		}
+	}
+}
+
+file_watcher::~file_watcher() {
+	if (m_iFd >= 0) {
+		close(m_iFd);
+	}
+}
+
+std::vector<std::string> file_watcher::poll() {
+	std::vector<std::string> changed;
+	if (m_iFd < 0) {
+		return changed;
+	}
+
+	alignas(inotify_event) char buffer[4096];
+	for (;;) {
+		const auto length = read(m_iFd, buffer, sizeof(buffer));
+		if (length <= 0) {
+			break;
+		}
+
+		for (auto offset = 0l; offset < length;) {
+			const auto* event = reinterpret_cast<const inotify_event*>(buffer + offset);
+			offset += sizeof(inotify_event) + event->len;
+
+			const auto watch = m_mWatches.find(event->wd);
+			if (watch == m_mWatches.end() || event->len == 0 || (event->mask & IN_ISDIR)) {
+				continue;
+			}
+
+			auto path = watch->second + event->name;
+			if (std::find(changed.begin(), changed.end(), path) == changed.end()) {
+				changed.push_back(std::move(path));
+			}
+		}
+	}
+
+	return changed;
+}
+#else
+file_watcher::file_watcher(const std::string& directory) : m_pDirectory(directory) {
+	scan(nullptr);
+}
+
+file_watcher::~file_watcher() = default;
+
+void file_watcher::scan(std::vector<std::string>* changed) {
+	std::error_code ec;
+	for (const auto& entry : std::filesystem::recursive_directory_iterator(m_pDirectory, ec)) {
+		if (!entry.is_regular_file()) {
+			continue;
+		}
+
+		const auto path = std::filesystem::relative(entry.path(), m_pDirectory).generic_string();
+		const auto time = entry.last_write_time(ec);
+		auto& known = m_mTimes[path];
+		if (known != time) {
+			if (changed && known != std::filesystem::file_time_type{}) {
+				changed->push_back(path);
+			}
+			known = time;
+		}
+	}
+}
+
+std::vector<std::string> file_watcher::poll() {
+	std::vector<std::string> changed;
+
+	// Walking the directory is not free, a few times a second is plenty
+	const auto now = std::chrono::steady_clock::now();
+	if (now - m_tLastScan < std::chrono::milliseconds(250)) {
+		return changed;
+	}
+	m_tLastScan = now;
+
+	scan(&changed);
+	return changed;
+}
+#endif
@@ -0,0 +1,36 @@
+#ifndef FILE_WATCHER_H
+#define FILE_WATCHER_H
+#include <chrono>
+#include <filesystem>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// Reports files that changed under a directory (and its subdirectories)
+// Uses inotify on Linux, elsewhere it falls back to comparing modification times
+class file_watcher {
+	std::filesystem::path m_pDirectory;
+
+#ifdef __linux__
+	int m_iFd = -1;
+	std::unordered_map<int, std::string> m_mWatches;
+#else
+	std::unordered_map<std::string, std::filesystem::file_time_type> m_mTimes;
+	std::chrono::steady_clock::time_point m_tLastScan{};
+
+	void scan(std::vector<std::string>* changed);
+#endif
+
+public:
+	explicit file_watcher(const std::string& directory);
+	~file_watcher();
+
+	file_watcher(const file_watcher&) = delete;
+	file_watcher& operator=(const file_watcher&) = delete;
+
+	// Paths relative to the directory, with '/' separators, of every file
+	// written since the last call. Never blocks
+	std::vector<std::string> poll();
+};
+
+#endif // FILE_WATCHER_H
@@ -0,0 +1,205 @@
+#include "frame_data.h"
+#include "glad/glad.h"
+#include "gl_state.h"
+#include "gl_extensions.h"
+#include <chrono>
+#include <cstring>
+#include <vector>
+
+namespace {
+	constexpr GLbitfield PERSISTENT_FLAGS = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+
+	size_t frameSize = 4 << 20;
+	unsigned int framesInFlight = 3;
+
+	// Without persistent mapping the buffer is orphaned every frame, so it only needs one region
+	bool persistent = false;
+	unsigned int regions = 1;
+
+	unsigned int buffer = 0;
+	unsigned char* mapped = nullptr;
+	size_t uniformAlignment = 256;
+
+	// One fence per region, placed when the frame that wrote it ends
+	std::vector<GLsync> fences;
+	unsigned int region = 0;
+	size_t head = 0;
+
+	// Buffers replaced mid frame, ranges in them stay in use until the frame is drawn
+	std::vector<unsigned int> retired;
+
+	frame_data::stats_t current, last;
+
+	size_t round_up(const size_t value, const size_t alignment) {
+		return (value + alignment - 1) / alignment * alignment;
+	}
+
+	void create_buffer() {
+		glGenBuffers(1, &buffer);
+		gl_state::bind_buffer(GL_COPY_WRITE_BUFFER, buffer);
+
+		if (persistent) {
+			gl_extensions::buffer_storage(GL_COPY_WRITE_BUFFER, frameSize * regions, nullptr, PERSISTENT_FLAGS);
+			mapped = static_cast<unsigned char*>(glMapBufferRange(GL_COPY_WRITE_BUFFER, 0, frameSize * regions, PERSISTENT_FLAGS));
+			if (mapped) {
+				return;
+			}
+
+			// Storage without a mapping is no use to us, start over with a plain buffer
+			gl_state::forget_buffer(buffer);
+			glDeleteBuffers(1, &buffer);
+			persistent = false;
+			regions = 1;
+			fences.assign(1, nullptr);
+			region = 0;
+			create_buffer();
+			return;
+		}
+
+		glBufferData(GL_COPY_WRITE_BUFFER, frameSize * regions, nullptr, GL_STREAM_DRAW);
+	}
+
+	void ensure_created() {
+		if (buffer) {
+			return;
+		}
+
+		persistent = gl_extensions::supports_buffer_storage();
+		regions = persistent ? framesInFlight : 1;
+		fences.assign(regions, nullptr);
+		region = 0;
+		head = 0;
+
+		GLint alignment = 0;
+		glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &alignment);
+		if (alignment > 0) {
+			uniformAlignment = alignment;
+		}
+
+		create_buffer();
+	}
+
+	// A frame ran out of room, move on to a buffer with bigger regions
+	// The GPU may not have used any region yet, so the old fences are not needed
+	void grow(const size_t needed) {
+		while (frameSize < needed) {
+			frameSize *= 2;
+		}
+
+		retired.push_back(buffer);
+		for (auto& fence : fences) {
+			if (fence) {
+				glDeleteSync(fence);
+				fence = nullptr;
+			}
+		}
+
+		mapped = nullptr;
+		create_buffer();
+		head = 0;
+		current.grows++;
+	}
+}
+
+namespace frame_data {
+	void init(const size_t size, const unsigned int frames) {
+		if (buffer) {
+			return;
+		}
+		frameSize = size;
+		framesInFlight = frames > 0 ? frames : 1;
+	}
+
+	void begin_frame() {
+		ensure_created();
+
+		// Buffers that were replaced last frame, GL frees them once the GPU is done
+		for (auto name : retired) {
+			gl_state::forget_buffer(name);
+			glDeleteBuffers(1, &name);
+		}
+		retired.clear();
+
+		if (persistent) {
+			fences[region] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+			gl_state::count_calls();
+			region = (region + 1) % regions;
+
+			// Only waits when the CPU is more than frames in flight ahead of the GPU
+			if (auto& fence = fences[region]) {
+				const auto start = std::chrono::steady_clock::now();
+				while (glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000000) == GL_TIMEOUT_EXPIRED) {
+					gl_state::count_calls();
+				}
+				current.waitMs += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+				glDeleteSync(fence);
+				gl_state::count_calls(2);
+				fence = nullptr;
+			}
+		}
+		else {
+			// Orphan, the driver hands out fresh storage while last frame's draws keep the old
+			gl_state::bind_buffer(GL_COPY_WRITE_BUFFER, buffer);
+			glBufferData(GL_COPY_WRITE_BUFFER, frameSize, nullptr, GL_STREAM_DRAW);
+			gl_state::count_calls();
+		}
+
+		current.capacity = frameSize;
+		current.persistent = persistent;
+		last = current;
+		current = {};
+		head = 0;
+	}
+
+	unsigned int frames_in_flight() {
+		return framesInFlight;
+	}
+
+	range_t write(const void* data, const size_t size, const size_t alignment) {
+		ensure_created();
+
+		auto offset = round_up(head, alignment);
+		if (offset + size > frameSize) {
+			grow(size);
+			offset = 0;
+		}
+
+		const range_t range{ buffer, region * frameSize + offset, size };
+		current.bytes += offset + size - head;
+		head = offset + size;
+
+		if (persistent) {
+			std::memcpy(mapped + range.offset, data, size);
+			return range;
+		}
+
+		// The buffer was orphaned this frame, nothing else writes or reads this range
+		gl_state::bind_buffer(GL_COPY_WRITE_BUFFER, buffer);
+		auto* target = glMapBufferRange(GL_COPY_WRITE_BUFFER, range.offset, size,
+			GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_RANGE_BIT | GL_MAP_UNSYNCHRONIZED_BIT);
+		if (!target) {
+			glBufferSubData(GL_COPY_WRITE_BUFFER, range.offset, size, data);
+			gl_state::count_calls(2);
+			return range;
+		}
+
+		std::memcpy(target, data, size);
+		glUnmapBuffer(GL_COPY_WRITE_BUFFER);
+		gl_state::count_calls(2);
+		return range;
+	}
+
+	range_t write_uniform(const void* data, const size_t size) {
+		ensure_created();
+		return write(data, size, uniformAlignment);
+	}
+
+	void bind_uniform(const unsigned int binding, const range_t& range) {
+		gl_state::bind_buffer_range(GL_UNIFORM_BUFFER, binding, range.buffer, range.offset, range.size);
+	}
+
+	stats_t get_stats() {
+		return last;
+	}
+}
@@ -0,0 +1,78 @@
+#ifndef FRAME_DATA_H
+#define FRAME_DATA_H
+#include <cstddef>
+#include "block_layout.h"
+
+// Allocator for data that is written once per frame and read by the GPU that frame
+// (uniform blocks, instance data, draw commands)
+//
+// One large buffer is split into a region per frame in flight. Each frame bump allocates
+// from its region, and a fence placed at the end of the frame keeps the region from being
+// reused before the GPU is done with it. With buffer storage the buffer stays persistently
+// and coherently mapped, otherwise it is orphaned every frame and each range is mapped on its own
+namespace frame_data {
+	struct range_t {
+		unsigned int buffer = 0;
+		size_t offset = 0;
+		size_t size = 0;
+	};
+
+	struct stats_t {
+		size_t bytes = 0;
+		size_t capacity = 0;
+		double waitMs = 0;
+		unsigned int grows = 0;
+		bool persistent = false;
+	};
+
+	// Optional, before the first allocation, the defaults are 4 MB and 3 frames
+	void init(size_t frameSize, unsigned int framesInFlight);
+
+	// Fence the region the last frame wrote and move to the next one, waiting if the GPU still reads it
+	void begin_frame();
+
+	// Frames the CPU may run ahead of the GPU, for other per frame buffers to keep in step
+	[[nodiscard]]
+	unsigned int frames_in_flight();
+
+	// Copy data into this frame's region
+	// A frame that outgrows its region moves to a bigger buffer, ranges handed out before stay valid
+	range_t write(const void* data, size_t size, size_t alignment);
+
+	// Same, aligned for binding as a uniform block
+	range_t write_uniform(const void* data, size_t size);
+
+	// Bind a range from write_uniform to a uniform block binding point
+	void bind_uniform(unsigned int binding, const range_t& range);
+
+	// Counters for the last complete frame
+	[[nodiscard]]
+	stats_t get_stats();
+}
+
+// A std140 uniform block holding one T, streamed through the frame data buffer
+// T must match its block layout
+template <typename T>
+class uniform_buffer {
+	static_assert(block_layout::matches<T>(block_packing::std140), "struct does not match its std140 block layout");
+
+	unsigned int m_uBinding = 0;
+
+public:
+	explicit uniform_buffer(const unsigned int binding) : m_uBinding(binding) {}
+
+	// Write this frame's value and bind it to the binding point
+	void upload(const T& data);
+
+	[[nodiscard]]
+	unsigned int binding() const {
+		return m_uBinding;
+	}
+};
+
+template <typename T>
+void uniform_buffer<T>::upload(const T& data) {
+	frame_data::bind_uniform(m_uBinding, frame_data::write_uniform(&data, sizeof(T)));
+}
+
+#endif // FRAME_DATA_H
@@ -0,0 +1,96 @@
+#ifndef FRAME_PIPELINE_H
+#define FRAME_PIPELINE_H
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include "job_system.h"
+
+// Two stage frame pipeline
+//
+// The simulation stage fills a packet with everything a frame draws, the GL stage draws from
+// the packet the simulation finished last. Two packets take turns: while the GL stage draws
+// frame N from one, a job simulates frame N + 1 into the other. With a spare core a frame
+// takes as long as the slower stage instead of both, and what is drawn is at most one frame
+// behind the simulation
+// The GL stage never sees a packet while it is written, and the simulation never touches
+// what the GL stage reads, as long as the two only share what the packet holds
+template <typename Packet>
+class frame_pipeline {
+public:
+	struct stats_t {
+		double simulateMs = 0;
+		double drawMs = 0;
+		// GL stage time spent waiting for the simulation
+		double waitMs = 0;
+	};
+
+private:
+	using clock_type = std::chrono::steady_clock;
+
+	Packet m_aPackets[2];
+	uint32_t m_uCurrent = 0;
+	std::function<void(Packet&)> m_fSimulate;
+	job_counter m_cSimulating;
+	bool m_bSimulating = false;
+	clock_type::time_point m_tStarted;
+	// Written by the simulation job, only read once finish() waited for it
+	double m_dSimulateMs = 0;
+	stats_t m_sStats;
+
+public:
+	frame_pipeline() = default;
+	frame_pipeline(const frame_pipeline&) = delete;
+	frame_pipeline& operator=(const frame_pipeline&) = delete;
+
+	~frame_pipeline() {
+		finish();
+	}
+
+	// Start simulating the next frame on the job system, simulate(packet) fills the next packet
+	// Call from the GL thread, then draw current() and finish()
+	void start(std::function<void(Packet&)> simulate) {
+		finish();
+		m_fSimulate = std::move(simulate);
+		m_bSimulating = true;
+		m_tStarted = clock_type::now();
+
+		// On a worker, a wait on the GL thread (say a parallel_for while drawing) would otherwise
+		// pick the whole simulation up and run the two stages one after the other again
+		job_system::run_on_workers([this] {
+			const auto start = clock_type::now();
+			m_fSimulate(m_aPackets[m_uCurrent ^ 1]);
+			m_dSimulateMs = std::chrono::duration<double, std::milli>(clock_type::now() - start).count();
+		}, &m_cSimulating);
+	}
+
+	// Packet the GL stage draws, unchanged until finish()
+	[[nodiscard]]
+	const Packet& current() const {
+		return m_aPackets[m_uCurrent];
+	}
+
+	// Wait for the simulation and make its packet the current one
+	void finish() {
+		if (!m_bSimulating) {
+			return;
+		}
+
+		const auto waitStart = clock_type::now();
+		job_system::wait(m_cSimulating);
+		const auto waitEnd = clock_type::now();
+		m_sStats.simulateMs = m_dSimulateMs;
+		m_sStats.drawMs = std::chrono::duration<double, std::milli>(waitStart - m_tStarted).count();
+		m_sStats.waitMs = std::chrono::duration<double, std::milli>(waitEnd - waitStart).count();
+
+		m_uCurrent ^= 1;
+		m_bSimulating = false;
+	}
+
+	// Timings of the last finished frame, only changes in finish()
+	[[nodiscard]]
+	const stats_t& get_stats() const {
+		return m_sStats;
+	}
+};
+
+#endif // FRAME_PIPELINE_H
@@ -0,0 +1,147 @@
+#include "geometry_pool.h"
+#include "glad/glad.h"
+#include "gl_state.h"
+#include "frame_data.h"
+#include <cstddef>
+
+namespace {
+	constexpr unsigned int INSTANCE_ATTRIBUTE = 5;
+
+	struct buffer_t {
+		unsigned int name = 0;
+		size_t used = 0;
+		size_t capacity = 0;
+	};
+
+	unsigned int vao = 0;
+	buffer_t vertices{ 0, 0, 1 << 16 };
+	buffer_t indices{ 0, 0, 3 << 16 };
+
+	// The latest instance upload, and where the instance attributes point
+	frame_data::range_t instances;
+	unsigned int pointedBuffer = 0;
+	size_t pointedBase = 0;
+
+	void create(buffer_t& buffer, const unsigned target, const size_t elementSize, const unsigned usage) {
+		glGenBuffers(1, &buffer.name);
+		gl_state::bind_buffer(target, buffer.name);
+		glBufferData(target, buffer.capacity * elementSize, nullptr, usage);
+	}
+
+	// Buffers that hold mesh data are copied into a bigger one, so they get a new name
+	void grow(buffer_t& buffer, const size_t needed, const size_t elementSize) {
+		if (buffer.used + needed <= buffer.capacity) {
+			return;
+		}
+
+		auto capacity = buffer.capacity;
+		while (buffer.used + needed > capacity) {
+			capacity *= 2;
+		}
+
+		unsigned int grown;
+		glGenBuffers(1, &grown);
+		gl_state::bind_buffer(GL_COPY_WRITE_BUFFER, grown);
+		glBufferData(GL_COPY_WRITE_BUFFER, capacity * elementSize, nullptr, GL_STATIC_DRAW);
+		gl_state::bind_buffer(GL_COPY_READ_BUFFER, buffer.name);
+		glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0, 0, buffer.used * elementSize);
+
+		gl_state::forget_buffer(buffer.name);
+		glDeleteBuffers(1, &buffer.name);
+		buffer.name = grown;
+		buffer.capacity = capacity;
+	}
+
+	void point_vertex_attributes() {
+		gl_state::bind_vertex_array(vao);
+		gl_state::bind_buffer(GL_ARRAY_BUFFER, vertices.name);
+		gl_state::bind_buffer(GL_ELEMENT_ARRAY_BUFFER, indices.name);
+
+		// X,Y,Z
+		glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(mesh_vertex_t), (void*)offsetof(mesh_vertex_t, x));
+		// U,V
+		glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, sizeof(mesh_vertex_t), (void*)offsetof(mesh_vertex_t, u));
+		// Normal X,Y,Z
+		glVertexAttribPointer(2, 3, GL_FLOAT, GL_FALSE, sizeof(mesh_vertex_t), (void*)offsetof(mesh_vertex_t, nx));
+		// Textured? Normals?
+		glVertexAttribIPointer(3, 1, GL_INT, sizeof(mesh_vertex_t), (void*)offsetof(mesh_vertex_t, textured));
+		glVertexAttribIPointer(4, 1, GL_INT, sizeof(mesh_vertex_t), (void*)offsetof(mesh_vertex_t, hasNormal));
+	}
+
+	void create_pool() {
+		// The VAO first, the element array binding below belongs to it
+		glGenVertexArrays(1, &vao);
+		gl_state::bind_vertex_array(vao);
+
+		create(vertices, GL_ARRAY_BUFFER, sizeof(mesh_vertex_t), GL_STATIC_DRAW);
+		create(indices, GL_ELEMENT_ARRAY_BUFFER, sizeof(unsigned), GL_STATIC_DRAW);
+
+		point_vertex_attributes();
+		for (auto i = 0u; i < 5; i++) {
+			glEnableVertexAttribArray(i);
+		}
+
+		// One object id per instance, everything else is fetched with it
+		glEnableVertexAttribArray(INSTANCE_ATTRIBUTE);
+		glVertexAttribDivisor(INSTANCE_ATTRIBUTE, 1);
+
+		// Enabled arrays need a buffer behind them even for shaders that never read them
+		geometry_pool::upload_instances({ 0 });
+		geometry_pool::point_instance_attributes(0);
+	}
+}
+
+namespace geometry_pool {
+	range_t allocate(const std::vector<mesh_vertex_t>& meshVertices, const std::vector<unsigned>& meshIndices) {
+		if (!vao) {
+			create_pool();
+		}
+
+		const auto oldVertices = vertices.name, oldIndices = indices.name;
+		grow(vertices, meshVertices.size(), sizeof(mesh_vertex_t));
+		grow(indices, meshIndices.size(), sizeof(unsigned));
+		if (vertices.name != oldVertices || indices.name != oldIndices) {
+			point_vertex_attributes();
+		}
+
+		gl_state::bind_buffer(GL_ARRAY_BUFFER, vertices.name);
+		glBufferSubData(GL_ARRAY_BUFFER, vertices.used * sizeof(mesh_vertex_t), meshVertices.size() * sizeof(mesh_vertex_t), meshVertices.data());
+
+		// The element array binding is part of the VAO
+		gl_state::bind_vertex_array(vao);
+		gl_state::bind_buffer(GL_ELEMENT_ARRAY_BUFFER, indices.name);
+		glBufferSubData(GL_ELEMENT_ARRAY_BUFFER, indices.used * sizeof(unsigned), meshIndices.size() * sizeof(unsigned), meshIndices.data());
+
+		const range_t range{ static_cast<unsigned int>(indices.used), static_cast<unsigned int>(meshIndices.size()), static_cast<int>(vertices.used) };
+		vertices.used += meshVertices.size();
+		indices.used += meshIndices.size();
+		return range;
+	}
+
+	unsigned int vertex_array() {
+		if (!vao) {
+			create_pool();
+		}
+		return vao;
+	}
+
+	void upload_instances(const std::vector<uint32_t>& objects) {
+		instances = frame_data::write(objects.data(), objects.size() * sizeof(uint32_t), alignof(uint32_t));
+	}
+
+	// GL 3.3 has no base instance, so draws move the attribute offsets instead
+	void point_instance_attributes(const unsigned int first) {
+		const auto base = instances.offset + first * sizeof(uint32_t);
+		if (pointedBuffer == instances.buffer && pointedBase == base) {
+			return;
+		}
+
+		gl_state::bind_vertex_array(vao);
+		gl_state::bind_buffer(GL_ARRAY_BUFFER, instances.buffer);
+		glVertexAttribIPointer(INSTANCE_ATTRIBUTE, 1, GL_UNSIGNED_INT, sizeof(uint32_t), (void*)base);
+		gl_state::count_calls();
+
+		pointedBuffer = instances.buffer;
+		pointedBase = base;
+	}
+}
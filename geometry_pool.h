@@ -0,0 +1,39 @@
+#ifndef GEOMETRY_POOL_H
+#define GEOMETRY_POOL_H
+#include <cstdint>
+#include <vector>
+
+struct mesh_vertex_t {
+	float x, y, z;
+	float u, v;
+	float nx, ny, nz;
+	int textured, hasNormal;
+};
+
+// Every mesh lives in one vertex buffer and one index buffer behind a single VAO,
+// so draws of different meshes only differ by their offsets and can be merged into
+// one multi draw. Each instance carries one object id (attribute location 5), streamed
+// through the frame data buffer each frame
+namespace geometry_pool {
+	// Where a mesh sits in the pool, in the form draw commands want
+	struct range_t {
+		unsigned int firstIndex = 0;
+		unsigned int count = 0;
+		int baseVertex = 0;
+	};
+
+	// Copy a mesh into the pool, growing the buffers when they are full
+	range_t allocate(const std::vector<mesh_vertex_t>& vertices, const std::vector<unsigned>& indices);
+
+	[[nodiscard]]
+	unsigned int vertex_array();
+
+	// Write this frame's object ids, instanced draws index into them from then on
+	void upload_instances(const std::vector<uint32_t>& objects);
+
+	// Make instance 0 of a draw read object id first of the uploaded ones
+	// Only needed without base instance support, skipped when nothing changes
+	void point_instance_attributes(unsigned int first);
+}
+
+#endif // GEOMETRY_POOL_H
@@ -0,0 +1,86 @@
+#include "gl_extensions.h"
+#include <string>
+#include <unordered_set>
+
+namespace {
+	std::unordered_set<std::string> extensions;
+	int versionMajor = 0, versionMinor = 0;
+	bool programBinary = false;
+	bool parallelShaderCompile = false;
+	bool multiDrawIndirect = false;
+	bool bufferStorage = false;
+}
+
+namespace gl_extensions {
+	void load(const GLADloadproc loader) {
+		glGetIntegerv(GL_MAJOR_VERSION, &versionMajor);
+		glGetIntegerv(GL_MINOR_VERSION, &versionMinor);
+
+		int count = 0;
+		glGetIntegerv(GL_NUM_EXTENSIONS, &count);
+		for (auto i = 0; i < count; i++) {
+			extensions.emplace(reinterpret_cast<const char*>(glGetStringi(GL_EXTENSIONS, i)));
+		}
+
+		// Program binaries
+		if (has_version(4, 1) || has("GL_ARB_get_program_binary")) {
+			get_program_binary = reinterpret_cast<get_program_binary_proc>(loader("glGetProgramBinary"));
+			program_binary = reinterpret_cast<program_binary_proc>(loader("glProgramBinary"));
+			program_parameteri = reinterpret_cast<program_parameteri_proc>(loader("glProgramParameteri"));
+
+			int formats = 0;
+			glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &formats);
+			programBinary = get_program_binary && program_binary && program_parameteri && formats > 0;
+		}
+
+		// Parallel shader compile, the KHR and ARB versions share the enum
+		if (has("GL_KHR_parallel_shader_compile")) {
+			max_shader_compiler_threads = reinterpret_cast<max_shader_compiler_threads_proc>(loader("glMaxShaderCompilerThreadsKHR"));
+		}
+		else if (has("GL_ARB_parallel_shader_compile")) {
+			max_shader_compiler_threads = reinterpret_cast<max_shader_compiler_threads_proc>(loader("glMaxShaderCompilerThreadsARB"));
+		}
+
+		if (max_shader_compiler_threads) {
+			// Let the driver pick how many threads to use
+			max_shader_compiler_threads(0xFFFFFFFF);
+			parallelShaderCompile = true;
+		}
+
+		// Multi draw indirect, per draw data is found through each command's base instance
+		if (has_version(4, 3) || (has("GL_ARB_multi_draw_indirect") && has("GL_ARB_base_instance"))) {
+			multi_draw_elements_indirect = reinterpret_cast<multi_draw_elements_indirect_proc>(loader("glMultiDrawElementsIndirect"));
+			multiDrawIndirect = multi_draw_elements_indirect != nullptr;
+		}
+
+		// Immutable storage, needed for persistent mapping
+		if (has_version(4, 4) || has("GL_ARB_buffer_storage")) {
+			buffer_storage = reinterpret_cast<buffer_storage_proc>(loader("glBufferStorage"));
+			bufferStorage = buffer_storage != nullptr;
+		}
+	}
+
+	bool has(const char* name) {
+		return extensions.contains(name);
+	}
+
+	bool has_version(const int major, const int minor) {
+		return versionMajor > major || (versionMajor == major && versionMinor >= minor);
+	}
+
+	bool supports_program_binary() {
+		return programBinary;
+	}
+
+	bool supports_parallel_shader_compile() {
+		return parallelShaderCompile;
+	}
+
+	bool supports_multi_draw_indirect() {
+		return multiDrawIndirect;
+	}
+
+	bool supports_buffer_storage() {
+		return bufferStorage;
+	}
+}
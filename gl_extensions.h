@@ -0,0 +1,71 @@
+#ifndef GL_EXTENSIONS_H
+#define GL_EXTENSIONS_H
+#include <glad/glad.h>
+
+// glad is generated for core 3.3 only, entry points from newer versions or
+// extensions that we use opportunistically are loaded here instead
+
+#ifndef GL_PROGRAM_BINARY_RETRIEVABLE_HINT
+#define GL_PROGRAM_BINARY_RETRIEVABLE_HINT 0x8257
+#define GL_PROGRAM_BINARY_LENGTH 0x8741
+#define GL_NUM_PROGRAM_BINARY_FORMATS 0x87FE
+#define GL_PROGRAM_BINARY_FORMATS 0x87FF
+#endif
+
+#ifndef GL_COMPLETION_STATUS_KHR
+#define GL_COMPLETION_STATUS_KHR 0x91B1
+#endif
+
+#ifndef GL_DRAW_INDIRECT_BUFFER
+#define GL_DRAW_INDIRECT_BUFFER 0x8F3F
+#endif
+
+#ifndef GL_MAP_PERSISTENT_BIT
+#define GL_MAP_PERSISTENT_BIT 0x0040
+#define GL_MAP_COHERENT_BIT 0x0080
+#endif
+
+namespace gl_extensions {
+	typedef void (APIENTRYP get_program_binary_proc)(GLuint program, GLsizei bufSize, GLsizei* length, GLenum* binaryFormat, void* binary);
+	typedef void (APIENTRYP program_binary_proc)(GLuint program, GLenum binaryFormat, const void* binary, GLsizei length);
+	typedef void (APIENTRYP program_parameteri_proc)(GLuint program, GLenum pname, GLint value);
+	typedef void (APIENTRYP max_shader_compiler_threads_proc)(GLuint count);
+	typedef void (APIENTRYP multi_draw_elements_indirect_proc)(GLenum mode, GLenum type, const void* indirect, GLsizei drawcount, GLsizei stride);
+	typedef void (APIENTRYP buffer_storage_proc)(GLenum target, GLsizeiptr size, const void* data, GLbitfield flags);
+
+	inline get_program_binary_proc get_program_binary = nullptr;
+	inline program_binary_proc program_binary = nullptr;
+	inline program_parameteri_proc program_parameteri = nullptr;
+	inline max_shader_compiler_threads_proc max_shader_compiler_threads = nullptr;
+	inline multi_draw_elements_indirect_proc multi_draw_elements_indirect = nullptr;
+	inline buffer_storage_proc buffer_storage = nullptr;
+
+	// Load everything we know about, call once after glad has been initialized
+	void load(GLADloadproc loader);
+
+	// Is the extension in the context's extension list
+	[[nodiscard]]
+	bool has(const char* name);
+
+	// Does the context have at least this GL version
+	[[nodiscard]]
+	bool has_version(int major, int minor);
+
+	// GL 4.1 / ARB_get_program_binary with at least one binary format
+	[[nodiscard]]
+	bool supports_program_binary();
+
+	// KHR/ARB_parallel_shader_compile, GL_COMPLETION_STATUS_KHR can be polled
+	[[nodiscard]]
+	bool supports_parallel_shader_compile();
+
+	// GL 4.3 / ARB_multi_draw_indirect, with base instance in the commands (4.2 / ARB_base_instance)
+	[[nodiscard]]
+	bool supports_multi_draw_indirect();
+
+	// GL 4.4 / ARB_buffer_storage, buffers can stay mapped while the GPU uses them
+	[[nodiscard]]
+	bool supports_buffer_storage();
+}
+
+#endif // GL_EXTENSIONS_H
@@ -0,0 +1,387 @@
+#include "gl_state.h"
+#include "glad/glad.h"
+#include <array>
+
+#ifndef GL_DRAW_INDIRECT_BUFFER
+#define GL_DRAW_INDIRECT_BUFFER 0x8F3F
+#endif
+#ifndef GL_SHADER_STORAGE_BUFFER
+#define GL_SHADER_STORAGE_BUFFER 0x90D2
+#endif
+
+namespace {
+	// Shadowed values start out unknown so the first call always goes through
+	constexpr unsigned unknown = ~0u;
+	constexpr unsigned max_texture_units = 32;
+	constexpr unsigned max_indexed_bindings = 64;
+
+	enum buffer_slot {
+		slot_array,
+		slot_element_array,
+		slot_uniform,
+		slot_copy_read,
+		slot_copy_write,
+		slot_pixel_pack,
+		slot_pixel_unpack,
+		slot_texture,
+		slot_draw_indirect,
+		slot_shader_storage,
+		slot_count
+	};
+
+	enum texture_slot {
+		tex_2d,
+		tex_cube_map,
+		tex_2d_array,
+		tex_3d,
+		tex_buffer,
+		tex_count
+	};
+
+	struct indexed_binding_t {
+		unsigned buffer = unknown;
+		long long offset = -1;
+		long long size = -1;
+	};
+
+	struct state_t {
+		unsigned program = unknown;
+		unsigned vao = unknown;
+		std::array<unsigned, slot_count> buffers{};
+		std::array<indexed_binding_t, max_indexed_bindings> uniformBindings{};
+		std::array<indexed_binding_t, max_indexed_bindings> storageBindings{};
+		unsigned activeUnit = unknown;
+		std::array<std::array<unsigned, tex_count>, max_texture_units> textures{};
+
+		int depthTest = -1, depthMask = -1, cullFace = -1, blend = -1;
+		unsigned depthFunc = unknown, cullMode = unknown, frontFace = unknown;
+		unsigned blendSrc = unknown, blendDst = unknown;
+		int scissorTest = -1;
+		std::array<int, 4> scissor{ -1, -1, -1, -1 };
+
+		state_t() {
+			buffers.fill(unknown);
+			for (auto& unit : textures) {
+				unit.fill(unknown);
+			}
+		}
+	};
+
+	// A new context has GL's defaults, the fixed function state starts out known
+	state_t context_defaults() {
+		state_t defaults;
+		defaults.depthTest = 0;
+		defaults.depthMask = 1;
+		defaults.cullFace = 0;
+		defaults.blend = 0;
+		defaults.depthFunc = GL_LESS;
+		defaults.cullMode = GL_BACK;
+		defaults.frontFace = GL_CCW;
+		defaults.blendSrc = GL_ONE;
+		defaults.blendDst = GL_ZERO;
+		defaults.scissorTest = 0;
+		return defaults;
+	}
+
+	state_t state = context_defaults();
+	gl_state::counters_t current{}, lastFrame{};
+
+	// Returns true if the call has to be issued
+	template <typename T>
+	bool update(T& shadow, const T value) {
+		if (shadow == value) {
+			current.filtered++;
+			return false;
+		}
+
+		shadow = value;
+		current.issued++;
+		return true;
+	}
+
+	int buffer_slot_for(const unsigned target) {
+		switch (target) {
+		case GL_ARRAY_BUFFER: return slot_array;
+		case GL_ELEMENT_ARRAY_BUFFER: return slot_element_array;
+		case GL_UNIFORM_BUFFER: return slot_uniform;
+		case GL_COPY_READ_BUFFER: return slot_copy_read;
+		case GL_COPY_WRITE_BUFFER: return slot_copy_write;
+		case GL_PIXEL_PACK_BUFFER: return slot_pixel_pack;
+		case GL_PIXEL_UNPACK_BUFFER: return slot_pixel_unpack;
+		case GL_TEXTURE_BUFFER: return slot_texture;
+		case GL_DRAW_INDIRECT_BUFFER: return slot_draw_indirect;
+		case GL_SHADER_STORAGE_BUFFER: return slot_shader_storage;
+		default: return -1;
+		}
+	}
+
+	int texture_slot_for(const unsigned target) {
+		switch (target) {
+		case GL_TEXTURE_2D: return tex_2d;
+		case GL_TEXTURE_CUBE_MAP: return tex_cube_map;
+		case GL_TEXTURE_2D_ARRAY: return tex_2d_array;
+		case GL_TEXTURE_3D: return tex_3d;
+		case GL_TEXTURE_BUFFER: return tex_buffer;
+		default: return -1;
+		}
+	}
+
+	indexed_binding_t* indexed_binding_for(const unsigned target, const unsigned index) {
+		if (index >= max_indexed_bindings) {
+			return nullptr;
+		}
+
+		switch (target) {
+		case GL_UNIFORM_BUFFER: return &state.uniformBindings[index];
+		case GL_SHADER_STORAGE_BUFFER: return &state.storageBindings[index];
+		default: return nullptr;
+		}
+	}
+
+	void set_capability(int& shadow, const unsigned cap, const bool enabled) {
+		if (update(shadow, enabled ? 1 : 0)) {
+			if (enabled) {
+				glEnable(cap);
+			}
+			else {
+				glDisable(cap);
+			}
+		}
+	}
+}
+
+namespace gl_state {
+	void use_program(const unsigned program) {
+		if (update(state.program, program)) {
+			glUseProgram(program);
+		}
+	}
+
+	void bind_vertex_array(const unsigned vao) {
+		if (update(state.vao, vao)) {
+			glBindVertexArray(vao);
+			state.buffers[slot_element_array] = unknown;
+		}
+	}
+
+	void bind_buffer(const unsigned target, const unsigned buffer) {
+		const auto slot = buffer_slot_for(target);
+		if (slot < 0) {
+			current.issued++;
+			glBindBuffer(target, buffer);
+			return;
+		}
+
+		if (update(state.buffers[slot], buffer)) {
+			glBindBuffer(target, buffer);
+		}
+	}
+
+	void bind_buffer_base(const unsigned target, const unsigned index, const unsigned buffer) {
+		auto* binding = indexed_binding_for(target, index);
+		if (binding && binding->buffer == buffer && binding->offset == -1) {
+			current.filtered++;
+			return;
+		}
+
+		current.issued++;
+		glBindBufferBase(target, index, buffer);
+
+		if (binding) {
+			*binding = { buffer, -1, -1 };
+		}
+
+		const auto slot = buffer_slot_for(target);
+		if (slot >= 0) {
+			state.buffers[slot] = buffer;
+		}
+	}
+
+	void bind_buffer_range(const unsigned target, const unsigned index, const unsigned buffer, const long long offset, const long long size) {
+		auto* binding = indexed_binding_for(target, index);
+		if (binding && binding->buffer == buffer && binding->offset == offset && binding->size == size) {
+			current.filtered++;
+			return;
+		}
+
+		current.issued++;
+		glBindBufferRange(target, index, buffer, static_cast<GLintptr>(offset), static_cast<GLsizeiptr>(size));
+
+		if (binding) {
+			*binding = { buffer, offset, size };
+		}
+
+		const auto slot = buffer_slot_for(target);
+		if (slot >= 0) {
+			state.buffers[slot] = buffer;
+		}
+	}
+
+	void active_texture(const unsigned unit) {
+		if (update(state.activeUnit, unit)) {
+			glActiveTexture(GL_TEXTURE0 + unit);
+		}
+	}
+
+	void bind_texture(const unsigned unit, const unsigned target, const unsigned texture) {
+		const auto slot = texture_slot_for(target);
+		if (slot < 0 || unit >= max_texture_units) {
+			active_texture(unit);
+			current.issued++;
+			glBindTexture(target, texture);
+			return;
+		}
+
+		auto& shadow = state.textures[unit][slot];
+		if (shadow == texture) {
+			current.filtered++;
+			return;
+		}
+
+		active_texture(unit);
+		update(shadow, texture);
+		glBindTexture(target, texture);
+	}
+
+	void set_depth_test(const bool enabled) {
+		set_capability(state.depthTest, GL_DEPTH_TEST, enabled);
+	}
+
+	void set_depth_mask(const bool enabled) {
+		if (update(state.depthMask, enabled ? 1 : 0)) {
+			glDepthMask(enabled ? GL_TRUE : GL_FALSE);
+		}
+	}
+
+	void set_depth_func(const unsigned func) {
+		if (update(state.depthFunc, func)) {
+			glDepthFunc(func);
+		}
+	}
+
+	void set_cull_face(const bool enabled) {
+		set_capability(state.cullFace, GL_CULL_FACE, enabled);
+	}
+
+	void set_cull_mode(const unsigned mode) {
+		if (update(state.cullMode, mode)) {
+			glCullFace(mode);
+		}
+	}
+
+	void set_front_face(const unsigned mode) {
+		if (update(state.frontFace, mode)) {
+			glFrontFace(mode);
+		}
+	}
+
+	void set_blend(const bool enabled) {
+		set_capability(state.blend, GL_BLEND, enabled);
+	}
+
+	void set_blend_func(const unsigned src, const unsigned dst) {
+		if (state.blendSrc == src && state.blendDst == dst) {
+			current.filtered++;
+			return;
+		}
+
+		state.blendSrc = src;
+		state.blendDst = dst;
+		current.issued++;
+		glBlendFunc(src, dst);
+	}
+
+	void set_scissor_test(const bool enabled) {
+		set_capability(state.scissorTest, GL_SCISSOR_TEST, enabled);
+	}
+
+	void set_scissor(const int x, const int y, const int width, const int height) {
+		if (update(state.scissor, { x, y, width, height })) {
+			glScissor(x, y, width, height);
+		}
+	}
+
+	bool current_scissor_test() {
+		return state.scissorTest == 1;
+	}
+
+	void set_pipeline_state(const pipeline_state_t& pipeline) {
+		set_depth_test(pipeline.depthTest);
+		set_depth_mask(pipeline.depthMask);
+		set_cull_face(pipeline.cullFace);
+		set_blend(pipeline.blend);
+	}
+
+	bool pipeline_state_known() {
+		return state.depthTest >= 0 && state.depthMask >= 0 && state.cullFace >= 0 && state.blend >= 0;
+	}
+
+	pipeline_state_t current_pipeline_state() {
+		return { state.depthTest == 1, state.depthMask == 1, state.cullFace == 1, state.blend == 1 };
+	}
+
+	unsigned current_program() {
+		return state.program;
+	}
+
+	unsigned current_vertex_array() {
+		return state.vao;
+	}
+
+	void forget_program(const unsigned program) {
+		if (state.program == program) {
+			state.program = unknown;
+		}
+	}
+
+	void forget_vertex_array(const unsigned vao) {
+		if (state.vao == vao) {
+			state.vao = unknown;
+		}
+	}
+
+	void forget_buffer(const unsigned buffer) {
+		for (auto& bound : state.buffers) {
+			if (bound == buffer) {
+				bound = unknown;
+			}
+		}
+		for (auto& binding : state.uniformBindings) {
+			if (binding.buffer == buffer) {
+				binding = {};
+			}
+		}
+		for (auto& binding : state.storageBindings) {
+			if (binding.buffer == buffer) {
+				binding = {};
+			}
+		}
+	}
+
+	void forget_texture(const unsigned texture) {
+		for (auto& unit : state.textures) {
+			for (auto& bound : unit) {
+				if (bound == texture) {
+					bound = unknown;
+				}
+			}
+		}
+	}
+
+	void invalidate() {
+		state = state_t{};
+	}
+
+	void count_calls(const unsigned calls) {
+		current.other += calls;
+	}
+
+	void begin_frame() {
+		lastFrame = current;
+		current = {};
+	}
+
+	counters_t get_frame_counters() {
+		return lastFrame;
+	}
+}
@@ -0,0 +1,94 @@
+#ifndef GL_STATE_H
+#define GL_STATE_H
+
+// Thin state tracking layer over the GL calls the engine makes
+// Every bind/enable goes through here, and calls that would set the value
+// that is already current are dropped before reaching the driver
+namespace gl_state {
+	// The fixed function state drivers are known to specialize programs on
+	struct pipeline_state_t {
+		bool depthTest = true;
+		bool depthMask = true;
+		bool cullFace = true;
+		bool blend = false;
+
+		bool operator==(const pipeline_state_t&) const = default;
+	};
+
+	struct counters_t {
+		unsigned long long issued = 0;
+		unsigned long long filtered = 0;
+		// Driver calls made around this layer, see count_calls
+		unsigned long long other = 0;
+	};
+
+	// Programs and vertex arrays
+	void use_program(unsigned program);
+	void bind_vertex_array(unsigned vao);
+
+	// Buffers, tracked per target
+	// The element array binding belongs to the VAO, so it is forgotten when the VAO changes
+	void bind_buffer(unsigned target, unsigned buffer);
+
+	// Indexed buffer bindings (uniform blocks etc.), also sets the generic binding like GL does
+	void bind_buffer_base(unsigned target, unsigned index, unsigned buffer);
+	void bind_buffer_range(unsigned target, unsigned index, unsigned buffer, long long offset, long long size);
+
+	// Textures, tracked per unit and target
+	void active_texture(unsigned unit);
+	void bind_texture(unsigned unit, unsigned target, unsigned texture);
+
+	// Fixed function state
+	void set_depth_test(bool enabled);
+	void set_depth_mask(bool enabled);
+	void set_depth_func(unsigned func);
+	void set_cull_face(bool enabled);
+	void set_cull_mode(unsigned mode);
+	void set_front_face(unsigned mode);
+	void set_blend(bool enabled);
+	void set_blend_func(unsigned src, unsigned dst);
+	void set_scissor_test(bool enabled);
+	void set_scissor(int x, int y, int width, int height);
+
+	void set_pipeline_state(const pipeline_state_t& pipeline);
+
+	// The shadow starts at a new context's defaults, values forgotten by invalidate() read as
+	// disabled until they are set again
+	[[nodiscard]]
+	pipeline_state_t current_pipeline_state();
+
+	// False after invalidate() until every pipeline field was set again
+	[[nodiscard]]
+	bool pipeline_state_known();
+
+	[[nodiscard]]
+	bool current_scissor_test();
+
+	[[nodiscard]]
+	unsigned current_program();
+
+	[[nodiscard]]
+	unsigned current_vertex_array();
+
+	// Objects being deleted must be forgotten, GL unbinds them implicitly
+	void forget_program(unsigned program);
+	void forget_vertex_array(unsigned vao);
+	void forget_buffer(unsigned buffer);
+	void forget_texture(unsigned texture);
+
+	// Forget everything, for when GL was touched outside of this layer
+	void invalidate();
+
+	// Per frame calls that do not go through this layer (draws, uniforms, buffer writes) report
+	// themselves here, so issued + other is every driver call the frame made
+	void count_calls(unsigned calls = 1);
+
+	// Call once per frame, moves the running counters into the last frame's
+	void begin_frame();
+
+	// Counters for the last complete frame
+	[[nodiscard]]
+	counters_t get_frame_counters();
+}
+
+#endif // GL_STATE_H
@@ -0,0 +1,17 @@
+#ifndef HASH_H
+#define HASH_H
+#include <cstdint>
+#include <string_view>
+
+// 64 bit FNV-1a, stable across runs and platforms so it can key on-disk caches
+constexpr uint64_t fnv1a_basis = 0xcbf29ce484222325ull;
+
+constexpr uint64_t fnv1a(const std::string_view data, uint64_t hash = fnv1a_basis) {
+	for (const auto c : data) {
+		hash ^= static_cast<unsigned char>(c);
+		hash *= 0x100000001b3ull;
+	}
+	return hash;
+}
+
+#endif // HASH_H
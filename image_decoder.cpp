@@ -0,0 +1,249 @@
+#include "image_decoder.h"
+#define STB_IMAGE_IMPLEMENTATION
+#include "stb/stb_image.h"
+#include <array>
+#include <chrono>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <mutex>
+
+decoded_image_t::decoded_image_t(decoded_image_t&& other) noexcept : info(other.info), data(other.data), release(other.release) {
+	other.data = nullptr;
+	other.release = nullptr;
+}
+
+decoded_image_t& decoded_image_t::operator=(decoded_image_t&& other) noexcept {
+	if (this != &other) {
+		if (data && release) {
+			release(data);
+		}
+		info = other.info;
+		data = other.data;
+		release = other.release;
+		other.data = nullptr;
+		other.release = nullptr;
+	}
+	return *this;
+}
+
+decoded_image_t::~decoded_image_t() {
+	if (data && release) {
+		release(data);
+	}
+}
+
+namespace {
+	// Default backend, handles everything stb_image can
+	class stb_image_decoder final : public image_decoder {
+	public:
+		[[nodiscard]]
+		const char* name() const override {
+			return "stb_image";
+		}
+
+		bool get_info(std::span<const unsigned char> src, image_info_t& info) const override {
+			return stbi_info_from_memory(src.data(), static_cast<int>(src.size()), &info.width, &info.height, &info.channels) != 0;
+		}
+
+		bool decode(std::span<const unsigned char> src, decoded_image_t& out, const int desired_channels, const bool flip_vertically) const override {
+			image_info_t info{};
+
+			// The _thread variant keeps the flag local so loads can run concurrently
+			stbi_set_flip_vertically_on_load_thread(flip_vertically);
+			auto* const dat = stbi_load_from_memory(src.data(), static_cast<int>(src.size()), &info.width, &info.height, &info.channels, desired_channels);
+			if (!dat) {
+				return false;
+			}
+
+			if (desired_channels != 0) {
+				info.channels = desired_channels;
+			}
+
+			out = decoded_image_t{};
+			out.info = info;
+			out.data = dat;
+			out.release = stbi_image_free;
+			return true;
+		}
+
+		bool decode_into(std::span<const unsigned char> src, std::span<unsigned char> dst, image_info_t& info, const int desired_channels, const bool flip_vertically) const override {
+			// stb always allocates its own output, so this is a decode and a copy
+			decoded_image_t img;
+			if (!decode(src, img, desired_channels, flip_vertically)) {
+				return false;
+			}
+
+			info = img.info;
+			if (img.size() > dst.size()) {
+				return false;
+			}
+
+			std::memcpy(dst.data(), img.data, img.size());
+			return true;
+		}
+	};
+
+	std::mutex mtx_decoders;
+	std::array<std::shared_ptr<image_decoder>, static_cast<size_t>(image_format::count)> backends{};
+	std::array<image_decode_stats_t, static_cast<size_t>(image_format::count)> stats{};
+
+	std::shared_ptr<image_decoder> stb_backend() {
+		static auto backend = std::make_shared<stb_image_decoder>();
+		return backend;
+	}
+
+	void register_defaults() {
+		static std::once_flag once;
+		std::call_once(once, [] {
+			std::lock_guard lock(mtx_decoders);
+			for (auto& backend : backends) {
+				backend = stb_backend();
+			}
+		});
+	}
+
+	bool starts_with(std::span<const unsigned char> src, const char* sig, const size_t len) {
+		return src.size() >= len && std::memcmp(src.data(), sig, len) == 0;
+	}
+
+	void record(const image_format format, const size_t bytes_in, const size_t bytes_out, const double seconds) {
+		std::lock_guard lock(mtx_decoders);
+		auto& s = stats[static_cast<size_t>(format)];
+		s.images++;
+		s.bytes_in += bytes_in;
+		s.bytes_out += bytes_out;
+		s.seconds += seconds;
+	}
+
+	using clock = std::chrono::steady_clock;
+
+	double seconds_since(const clock::time_point start) {
+		return std::chrono::duration<double>(clock::now() - start).count();
+	}
+}
+
+namespace image_decoders {
+	image_format detect_format(std::span<const unsigned char> src) {
+		if (starts_with(src, "\x89PNG\r\n\x1a\n", 8)) {
+			return image_format::png;
+		}
+		if (starts_with(src, "\xff\xd8\xff", 3)) {
+			return image_format::jpg;
+		}
+		if (starts_with(src, "BM", 2)) {
+			return image_format::bmp;
+		}
+		if (starts_with(src, "GIF8", 4)) {
+			return image_format::gif;
+		}
+		if (starts_with(src, "8BPS", 4)) {
+			return image_format::psd;
+		}
+		if (starts_with(src, "#?RADIANCE", 10) || starts_with(src, "#?RGBE", 6)) {
+			return image_format::hdr;
+		}
+		if (starts_with(src, "P5", 2) || starts_with(src, "P6", 2)) {
+			return image_format::pnm;
+		}
+
+		// TGA has no signature, leave it for the default backend to probe
+		return image_format::unknown;
+	}
+
+	const char* format_name(const image_format format) {
+		switch (format) {
+		case image_format::png: return "png";
+		case image_format::jpg: return "jpg";
+		case image_format::bmp: return "bmp";
+		case image_format::gif: return "gif";
+		case image_format::psd: return "psd";
+		case image_format::hdr: return "hdr";
+		case image_format::pnm: return "pnm";
+		default: return "unknown";
+		}
+	}
+
+	void register_backend(const image_format format, std::shared_ptr<image_decoder> backend) {
+		register_defaults();
+
+		std::lock_guard lock(mtx_decoders);
+		backends[static_cast<size_t>(format)] = backend ? std::move(backend) : stb_backend();
+	}
+
+	std::shared_ptr<image_decoder> get_backend(const image_format format) {
+		register_defaults();
+
+		std::lock_guard lock(mtx_decoders);
+		return backends[static_cast<size_t>(format)];
+	}
+
+	std::shared_ptr<image_decoder> get_stb_backend() {
+		return stb_backend();
+	}
+
+	bool decode(std::span<const unsigned char> src, decoded_image_t& out, const int desired_channels, const bool flip_vertically) {
+		const auto format = detect_format(src);
+		const auto start = clock::now();
+
+		if (!get_backend(format)->decode(src, out, desired_channels, flip_vertically)) {
+			return false;
+		}
+
+		record(format, src.size(), out.size(), seconds_since(start));
+		return true;
+	}
+
+	bool decode_into(std::span<const unsigned char> src, std::span<unsigned char> dst, image_info_t& info, const int desired_channels, const bool flip_vertically) {
+		const auto format = detect_format(src);
+		const auto start = clock::now();
+
+		if (!get_backend(format)->decode_into(src, dst, info, desired_channels, flip_vertically)) {
+			return false;
+		}
+
+		record(format, src.size(), static_cast<size_t>(info.width) * info.height * info.channels, seconds_since(start));
+		return true;
+	}
+
+	bool get_info(std::span<const unsigned char> src, image_info_t& info) {
+		return get_backend(detect_format(src))->get_info(src, info);
+	}
+
+	std::vector<unsigned char> read_file(const std::string& path) {
+		auto ifs = std::ifstream(path, std::ios::binary | std::ios::ate);
+		if (!ifs) {
+			return {};
+		}
+
+		std::vector<unsigned char> bytes(static_cast<size_t>(ifs.tellg()));
+		ifs.seekg(0);
+		ifs.read(reinterpret_cast<char*>(bytes.data()), static_cast<std::streamsize>(bytes.size()));
+		return bytes;
+	}
+
+	image_decode_stats_t get_stats(const image_format format) {
+		std::lock_guard lock(mtx_decoders);
+		return stats[static_cast<size_t>(format)];
+	}
+
+	void reset_stats() {
+		std::lock_guard lock(mtx_decoders);
+		stats = {};
+	}
+
+	void print_stats() {
+		for (size_t i = 0; i < stats.size(); i++) {
+			const auto format = static_cast<image_format>(i);
+			const auto s = get_stats(format);
+			if (s.images == 0) {
+				continue;
+			}
+
+			const auto mbOut = s.bytes_out / (1024.0 * 1024.0);
+			printf("Decoded %llu %s image(s) with %s: %.2f MB in %.2f ms (%.1f MB/s)\n",
+				static_cast<unsigned long long>(s.images), format_name(format), get_backend(format)->name(),
+				mbOut, s.seconds * 1000.0, s.seconds > 0 ? mbOut / s.seconds : 0.0);
+		}
+	}
+}
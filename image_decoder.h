@@ -0,0 +1,99 @@
+#ifndef IMAGE_DECODER_H
+#define IMAGE_DECODER_H
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <span>
+#include <string>
+#include <vector>
+
+// Container formats we can recognise from the first few bytes of a file
+enum class image_format {
+	unknown,
+	png,
+	jpg,
+	bmp,
+	gif,
+	psd,
+	hdr,
+	pnm,
+	count
+};
+
+struct image_info_t {
+	int width{ 0 }, height{ 0 };
+	int channels{ 0 };
+};
+
+// Pixels owned by whichever backend decoded them
+struct decoded_image_t {
+	image_info_t info{};
+	unsigned char* data{ nullptr };
+	void (*release)(void*) { nullptr };
+
+	decoded_image_t() = default;
+	decoded_image_t(const decoded_image_t&) = delete;
+	decoded_image_t& operator=(const decoded_image_t&) = delete;
+	decoded_image_t(decoded_image_t&& other) noexcept;
+	decoded_image_t& operator=(decoded_image_t&& other) noexcept;
+	~decoded_image_t();
+
+	[[nodiscard]]
+	size_t size() const {
+		return static_cast<size_t>(info.width) * info.height * info.channels;
+	}
+};
+
+class image_decoder {
+public:
+	virtual ~image_decoder() = default;
+
+	[[nodiscard]]
+	virtual const char* name() const = 0;
+
+	// Read the dimensions and channel count without decoding the pixels
+	virtual bool get_info(std::span<const unsigned char> src, image_info_t& info) const = 0;
+
+	// Decode into backend owned memory
+	// desired_channels of 0 keeps the channel count of the file
+	virtual bool decode(std::span<const unsigned char> src, decoded_image_t& out, int desired_channels, bool flip_vertically) const = 0;
+
+	// Decode straight into a caller provided buffer (eg. a mapped PBO)
+	// dst must hold at least width * height * channels bytes
+	virtual bool decode_into(std::span<const unsigned char> src, std::span<unsigned char> dst, image_info_t& info, int desired_channels, bool flip_vertically) const = 0;
+};
+
+// Per format decode throughput
+struct image_decode_stats_t {
+	uint64_t images{ 0 };
+	uint64_t bytes_in{ 0 };
+	uint64_t bytes_out{ 0 };
+	double seconds{ 0 };
+};
+
+namespace image_decoders {
+	// Sniff the format from the file signature
+	image_format detect_format(std::span<const unsigned char> src);
+	const char* format_name(image_format format);
+
+	// Register a backend for a format, replacing whatever handled it before
+	// stb is registered for every format it supports by default
+	void register_backend(image_format format, std::shared_ptr<image_decoder> backend);
+	std::shared_ptr<image_decoder> get_backend(image_format format);
+	std::shared_ptr<image_decoder> get_stb_backend();
+
+	// Decode using the backend registered for the signature of src
+	bool decode(std::span<const unsigned char> src, decoded_image_t& out, int desired_channels = 0, bool flip_vertically = false);
+	bool decode_into(std::span<const unsigned char> src, std::span<unsigned char> dst, image_info_t& info, int desired_channels = 0, bool flip_vertically = false);
+	bool get_info(std::span<const unsigned char> src, image_info_t& info);
+
+	// Read a whole file, for callers that do not have the bytes in memory already
+	std::vector<unsigned char> read_file(const std::string& path);
+
+	// Throughput instrumentation
+	image_decode_stats_t get_stats(image_format format);
+	void reset_stats();
+	void print_stats();
+}
+
+#endif // IMAGE_DECODER_H
@@ -0,0 +1,474 @@
+#include "job_system.h"
+#include <condition_variable>
+#include <memory>
+#include <thread>
+
+namespace {
+	using job_t = job_system::detail::job_t;
+
+	// Jobs a thread can have in flight before new ones come from the heap
+	constexpr uint32_t POOL_SIZE = 1 << 12;
+
+	// Jobs a thread can have queued before new ones go to the shared queue
+	constexpr int64_t DEQUE_SIZE = 1 << 12;
+
+	// Rounds of finding nothing before a worker parks
+	constexpr int SPINS_BEFORE_PARKING = 64;
+
+	// Chase-Lev work stealing deque, with the memory orders of Le et al. "Correct and efficient
+	// work-stealing for weak memory models". The owner pushes and pops at the bottom, anyone
+	// steals from the top. Fixed size, push fails when it is full
+	class job_deque {
+		alignas(64) std::atomic<int64_t> m_iTop{ 0 };
+		alignas(64) std::atomic<int64_t> m_iBottom{ 0 };
+		alignas(64) std::atomic<job_t*> m_vJobs[DEQUE_SIZE];
+
+	public:
+		bool push(job_t* job) {
+			const auto bottom = m_iBottom.load(std::memory_order_relaxed);
+			const auto top = m_iTop.load(std::memory_order_acquire);
+			if (bottom - top >= DEQUE_SIZE) {
+				return false;
+			}
+
+			m_vJobs[bottom & (DEQUE_SIZE - 1)].store(job, std::memory_order_relaxed);
+			m_iBottom.store(bottom + 1, std::memory_order_release);
+			return true;
+		}
+
+		job_t* pop() {
+			const auto bottom = m_iBottom.load(std::memory_order_relaxed) - 1;
+			m_iBottom.store(bottom, std::memory_order_relaxed);
+			std::atomic_thread_fence(std::memory_order_seq_cst);
+			auto top = m_iTop.load(std::memory_order_relaxed);
+
+			if (top > bottom) {
+				m_iBottom.store(bottom + 1, std::memory_order_relaxed);
+				return nullptr;
+			}
+
+			auto* job = m_vJobs[bottom & (DEQUE_SIZE - 1)].load(std::memory_order_relaxed);
+			if (top == bottom) {
+				// The last job, thieves may be after it too
+				if (!m_iTop.compare_exchange_strong(top, top + 1, std::memory_order_seq_cst, std::memory_order_relaxed)) {
+					job = nullptr;
+				}
+				m_iBottom.store(bottom + 1, std::memory_order_relaxed);
+			}
+			return job;
+		}
+
+		job_t* steal() {
+			auto top = m_iTop.load(std::memory_order_acquire);
+			std::atomic_thread_fence(std::memory_order_seq_cst);
+			const auto bottom = m_iBottom.load(std::memory_order_acquire);
+			if (top >= bottom) {
+				return nullptr;
+			}
+
+			auto* job = m_vJobs[top & (DEQUE_SIZE - 1)].load(std::memory_order_relaxed);
+			if (!m_iTop.compare_exchange_strong(top, top + 1, std::memory_order_seq_cst, std::memory_order_relaxed)) {
+				return nullptr;
+			}
+			return job;
+		}
+
+		[[nodiscard]]
+		bool empty() const {
+			return m_iBottom.load(std::memory_order_relaxed) <= m_iTop.load(std::memory_order_relaxed);
+		}
+	};
+
+	struct worker_t {
+		job_deque deque;
+		std::unique_ptr<job_t[]> pool{ new job_t[POOL_SIZE] };
+		uint32_t next = 0;
+		alignas(64) std::atomic<uint64_t> executed{ 0 };
+		std::atomic<uint64_t> stolen{ 0 };
+		std::atomic<uint64_t> parked{ 0 };
+	};
+
+	// Index 0 is the main thread
+	std::vector<std::unique_ptr<worker_t>> workers;
+	std::vector<std::thread> threads;
+	std::mutex startMutex;
+	std::atomic<bool> running{ false };
+	std::atomic<bool> stopping{ false };
+
+	// -1 on threads outside the system
+	thread_local int currentWorker = -1;
+	thread_local uint32_t stealSeed = 0x9E3779B9u;
+
+	// Jobs from threads outside the system, and from threads whose deque is full
+	std::mutex sharedMutex;
+	std::vector<job_t*> sharedJobs;
+	std::atomic<uint32_t> sharedCount{ 0 };
+
+	std::mutex mainMutex;
+	std::vector<job_t*> mainJobs;
+	std::atomic<uint32_t> mainCount{ 0 };
+
+	// Jobs the main thread leaves to the workers
+	std::mutex workersMutex;
+	std::vector<job_t*> workersJobs;
+	std::atomic<uint32_t> workersCount{ 0 };
+
+	// Parked workers sleep until the epoch moves
+	std::mutex sleepMutex;
+	std::condition_variable sleepCondition;
+	uint64_t wakeEpoch = 0;
+	std::atomic<uint32_t> sleepers{ 0 };
+
+	void wake_one() {
+		// Pairs with the fence a parking worker issues after counting itself in, either it sees
+		// the new job or this sees it sleeping
+		std::atomic_thread_fence(std::memory_order_seq_cst);
+		if (sleepers.load(std::memory_order_relaxed) == 0) {
+			return;
+		}
+		{
+			std::lock_guard lock(sleepMutex);
+			wakeEpoch++;
+		}
+		sleepCondition.notify_one();
+	}
+
+	void push_shared(job_t* job) {
+		{
+			std::lock_guard lock(sharedMutex);
+			sharedJobs.push_back(job);
+			sharedCount.fetch_add(1, std::memory_order_release);
+		}
+		wake_one();
+	}
+
+	job_t* pop_locked(std::mutex& mutex, std::vector<job_t*>& jobs, std::atomic<uint32_t>& count) {
+		if (count.load(std::memory_order_acquire) == 0) {
+			return nullptr;
+		}
+		std::lock_guard lock(mutex);
+		if (jobs.empty()) {
+			return nullptr;
+		}
+		auto* job = jobs.back();
+		jobs.pop_back();
+		count.fetch_sub(1, std::memory_order_relaxed);
+		return job;
+	}
+
+	job_t* find_job(const int index) {
+		if (index >= 0) {
+			if (auto* job = workers[index]->deque.pop()) {
+				return job;
+			}
+		}
+		if (auto* job = pop_locked(sharedMutex, sharedJobs, sharedCount)) {
+			return job;
+		}
+		if (index != 0 || workers.size() == 1) {
+			if (auto* job = pop_locked(workersMutex, workersJobs, workersCount)) {
+				return job;
+			}
+		}
+
+		// Start at a random victim so thieves spread out
+		stealSeed ^= stealSeed << 13;
+		stealSeed ^= stealSeed >> 17;
+		stealSeed ^= stealSeed << 5;
+		const auto count = static_cast<uint32_t>(workers.size());
+		const auto start = stealSeed % count;
+		for (auto i = 0u; i < count; i++) {
+			const auto victim = (start + i) % count;
+			if (static_cast<int>(victim) == index) {
+				continue;
+			}
+			if (auto* job = workers[victim]->deque.steal()) {
+				if (index >= 0) {
+					workers[index]->stolen.fetch_add(1, std::memory_order_relaxed);
+				}
+				return job;
+			}
+		}
+		return nullptr;
+	}
+
+	void execute(job_t* job) {
+		job->invoke(*job);
+
+		// The slot can be handed out again as soon as it is marked free
+		auto* counter = job->counter;
+		if (job->heap) {
+			delete job;
+		}
+		else {
+			job->free.store(true, std::memory_order_release);
+		}
+		if (counter) {
+			counter->decrement();
+		}
+		if (currentWorker >= 0) {
+			workers[currentWorker]->executed.fetch_add(1, std::memory_order_relaxed);
+		}
+	}
+
+	void work(const int index) {
+		currentWorker = index;
+		stealSeed += index * 0x85EBCA6Bu;
+		auto& self = *workers[index];
+
+		auto idle = 0;
+		while (!stopping.load(std::memory_order_acquire)) {
+			if (auto* job = find_job(index)) {
+				execute(job);
+				idle = 0;
+				continue;
+			}
+			if (++idle < SPINS_BEFORE_PARKING) {
+				std::this_thread::yield();
+				continue;
+			}
+
+			// Count in as a sleeper, then look once more before sleeping so nothing handed out
+			// in between is missed
+			std::unique_lock lock(sleepMutex);
+			const auto epoch = wakeEpoch;
+			sleepers.fetch_add(1, std::memory_order_seq_cst);
+			lock.unlock();
+			std::atomic_thread_fence(std::memory_order_seq_cst);
+
+			if (auto* job = find_job(index)) {
+				sleepers.fetch_sub(1, std::memory_order_relaxed);
+				execute(job);
+				idle = 0;
+				continue;
+			}
+
+			lock.lock();
+			sleepCondition.wait(lock, [epoch] { return wakeEpoch != epoch || stopping.load(std::memory_order_relaxed); });
+			sleepers.fetch_sub(1, std::memory_order_relaxed);
+			self.parked.fetch_add(1, std::memory_order_relaxed);
+			idle = 0;
+		}
+	}
+
+	void ensure_started() {
+		if (!running.load(std::memory_order_acquire)) {
+			job_system::init();
+		}
+	}
+
+	// Workers are joined before the other globals here go
+	struct shutdown_at_exit_t {
+		~shutdown_at_exit_t() {
+			job_system::shutdown();
+		}
+	} shutdownAtExit;
+}
+
+void job_counter::decrement() {
+	auto value = m_uValue.load(std::memory_order_relaxed);
+	while (value > 1) {
+		if (m_uValue.compare_exchange_weak(value, value - 1, std::memory_order_acq_rel, std::memory_order_relaxed)) {
+			return;
+		}
+	}
+
+	// Reaching zero happens under the lock, so a waiter that locked after seeing zero knows
+	// this thread is done with the counter
+	std::vector<job_t*> released;
+	{
+		std::lock_guard lock(m_mWaiters);
+		released.swap(m_vWaiters);
+		m_uValue.fetch_sub(1, std::memory_order_acq_rel);
+	}
+	for (auto* job : released) {
+		job_system::detail::release(job);
+	}
+}
+
+bool job_counter::park(job_t* job) {
+	std::lock_guard lock(m_mWaiters);
+	if (m_uValue.load(std::memory_order_acquire) == 0) {
+		return false;
+	}
+	m_vWaiters.push_back(job);
+	return true;
+}
+
+namespace job_system {
+	namespace detail {
+		job_t* allocate() {
+			if (currentWorker >= 0) {
+				auto& worker = *workers[currentWorker];
+				auto& job = worker.pool[worker.next++ & (POOL_SIZE - 1)];
+				if (job.free.load(std::memory_order_acquire)) {
+					job.free.store(false, std::memory_order_relaxed);
+					job.heap = false;
+					return &job;
+				}
+			}
+
+			auto* job = new job_t;
+			job->free.store(false, std::memory_order_relaxed);
+			job->heap = true;
+			return job;
+		}
+
+		void submit(job_t* job, job_counter* counter, job_counter* after) {
+			ensure_started();
+			job->counter = counter;
+			if (counter) {
+				counter->increment();
+			}
+			if (after && after->park(job)) {
+				return;
+			}
+			release(job);
+		}
+
+		void release(job_t* job) {
+			if (job->main) {
+				std::lock_guard lock(mainMutex);
+				mainJobs.push_back(job);
+				mainCount.fetch_add(1, std::memory_order_release);
+				return;
+			}
+			if (job->workers) {
+				{
+					std::lock_guard lock(workersMutex);
+					workersJobs.push_back(job);
+					workersCount.fetch_add(1, std::memory_order_release);
+				}
+				wake_one();
+				return;
+			}
+
+			if (currentWorker >= 0 && workers[currentWorker]->deque.push(job)) {
+				wake_one();
+				return;
+			}
+			push_shared(job);
+		}
+
+		bool local_queue_empty() {
+			return currentWorker < 0 || workers[currentWorker]->deque.empty();
+		}
+	}
+
+	void init(unsigned int count) {
+		std::lock_guard lock(startMutex);
+		if (running.load(std::memory_order_relaxed)) {
+			return;
+		}
+
+		if (count == 0) {
+			count = std::max(1u, std::thread::hardware_concurrency()) - 1;
+		}
+		stopping.store(false, std::memory_order_relaxed);
+		workers.clear();
+		for (auto i = 0u; i <= count; i++) {
+			workers.push_back(std::make_unique<worker_t>());
+		}
+
+		currentWorker = 0;
+		for (auto i = 1u; i <= count; i++) {
+			threads.emplace_back(work, static_cast<int>(i));
+		}
+		running.store(true, std::memory_order_release);
+	}
+
+	void shutdown() {
+		std::lock_guard lock(startMutex);
+		if (!running.load(std::memory_order_relaxed)) {
+			return;
+		}
+
+		{
+			std::lock_guard sleepLock(sleepMutex);
+			stopping.store(true, std::memory_order_relaxed);
+		}
+		sleepCondition.notify_all();
+		for (auto& thread : threads) {
+			thread.join();
+		}
+		threads.clear();
+
+		// Jobs still queued from the heap, pooled ones go with their worker
+		for (auto* job : sharedJobs) {
+			if (job->heap) {
+				delete job;
+			}
+		}
+		for (auto* job : mainJobs) {
+			if (job->heap) {
+				delete job;
+			}
+		}
+		for (auto* job : workersJobs) {
+			if (job->heap) {
+				delete job;
+			}
+		}
+		sharedJobs.clear();
+		mainJobs.clear();
+		workersJobs.clear();
+		sharedCount.store(0, std::memory_order_relaxed);
+		mainCount.store(0, std::memory_order_relaxed);
+		workersCount.store(0, std::memory_order_relaxed);
+		workers.clear();
+
+		currentWorker = -1;
+		running.store(false, std::memory_order_release);
+	}
+
+	unsigned int thread_count() {
+		ensure_started();
+		return static_cast<unsigned int>(workers.size());
+	}
+
+	void wait(job_counter& counter) {
+		ensure_started();
+		const auto index = currentWorker;
+		while (!counter.done()) {
+			if (auto* job = find_job(index)) {
+				execute(job);
+				continue;
+			}
+			if (index == 0) {
+				if (auto* job = pop_locked(mainMutex, mainJobs, mainCount)) {
+					execute(job);
+					continue;
+				}
+			}
+			std::this_thread::yield();
+		}
+		counter.settle();
+	}
+
+	void run_main_jobs() {
+		if (mainCount.load(std::memory_order_acquire) == 0) {
+			return;
+		}
+
+		// Only what was queued so far, jobs these queue wait for the next call
+		std::vector<job_t*> jobs;
+		{
+			std::lock_guard lock(mainMutex);
+			jobs.swap(mainJobs);
+			mainCount.store(0, std::memory_order_relaxed);
+		}
+		for (auto* job : jobs) {
+			execute(job);
+		}
+	}
+
+	stats_t get_stats() {
+		stats_t stats;
+		for (const auto& worker : workers) {
+			stats.jobs += worker->executed.load(std::memory_order_relaxed);
+			stats.steals += worker->stolen.load(std::memory_order_relaxed);
+			stats.parks += worker->parked.load(std::memory_order_relaxed);
+		}
+		return stats;
+	}
+}
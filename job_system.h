@@ -0,0 +1,198 @@
+#ifndef JOB_SYSTEM_H
+#define JOB_SYSTEM_H
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <new>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+namespace job_system::detail {
+	struct job_t;
+}
+
+// Jobs that have not finished yet
+// run() counts a job in when it is handed out and out once it has run. Jobs can also be held
+// back until a counter reaches zero, and increment/decrement use a counter as a gate by hand
+// A counter has to outlive the jobs counted in it, job_system::wait on it before it goes
+class job_counter {
+	std::atomic<uint32_t> m_uValue{ 0 };
+	std::mutex m_mWaiters;
+	std::vector<job_system::detail::job_t*> m_vWaiters;
+
+public:
+	job_counter() = default;
+	job_counter(const job_counter&) = delete;
+	job_counter& operator=(const job_counter&) = delete;
+
+	void increment(uint32_t count = 1) {
+		m_uValue.fetch_add(count, std::memory_order_relaxed);
+	}
+
+	// The last decrement hands out the jobs held back on the counter
+	void decrement();
+
+	// Hold the job back until the counter reaches zero, false when it already has
+	bool park(job_system::detail::job_t* job);
+
+	[[nodiscard]]
+	bool done() const {
+		return m_uValue.load(std::memory_order_acquire) == 0;
+	}
+
+	// Returns once the thread that brought the counter to zero is done with it
+	void settle() {
+		std::lock_guard lock(m_mWaiters);
+	}
+};
+
+// Work stealing thread pool
+//
+// Each thread has a Chase-Lev deque, it pushes and pops its own jobs at the bottom and idle
+// threads steal from the top of the others. The thread that starts the system (main) is
+// thread 0 and only works while it waits. Workers that find nothing park on a condition
+// variable until more jobs are handed out. Jobs from threads outside the system go through
+// a shared queue
+// Jobs for the main thread, like GL calls, are kept apart and only run from run_main_jobs
+// or while the main thread waits. Long jobs the main thread must not pick up while it waits,
+// like a frame's simulation, are kept apart the other way and only run on workers
+namespace job_system {
+	namespace detail {
+		// Bytes a job's callable can take, capture by reference or pointer past that
+		constexpr size_t PAYLOAD = 48;
+
+		struct job_t {
+			void (*invoke)(job_t& job);
+			job_counter* counter;
+			bool heap;
+			bool main;
+			bool workers;
+			// Pool slots only, set once the job has run
+			std::atomic<bool> free{ true };
+			alignas(16) unsigned char payload[PAYLOAD];
+		};
+
+		job_t* allocate();
+
+		// Counts the job into counter, then queues it or holds it back on after
+		void submit(job_t* job, job_counter* counter, job_counter* after);
+
+		// Hand a job that was held back to a queue
+		void release(job_t* job);
+
+		// Whether the calling thread has nothing queued that others could steal
+		[[nodiscard]]
+		bool local_queue_empty();
+
+		template<typename F>
+		job_t* make(F&& work, const bool main, const bool workers = false) {
+			using callable = std::decay_t<F>;
+			static_assert(sizeof(callable) <= PAYLOAD && alignof(callable) <= 16, "Job captures too large, capture by reference or pointer");
+
+			auto* job = allocate();
+			new (job->payload) callable(std::forward<F>(work));
+			job->invoke = [](job_t& self) {
+				auto* stored = std::launder(reinterpret_cast<callable*>(self.payload));
+				(*stored)();
+				stored->~callable();
+			};
+			job->main = main;
+			job->workers = workers;
+			return job;
+		}
+	}
+
+	struct stats_t {
+		uint64_t jobs = 0;
+		uint64_t steals = 0;
+		uint64_t parks = 0;
+	};
+
+	// Start workers, 0 gives one less than the hardware threads. The calling thread becomes the
+	// main thread. Everything below starts the system with the default on first use
+	void init(unsigned int workers = 0);
+
+	// Join the workers, jobs still queued are dropped. Call from the main thread
+	void shutdown();
+
+	// Workers plus the main thread
+	[[nodiscard]]
+	unsigned int thread_count();
+
+	// Run work on any thread, counted in counter and held back until after reaches zero
+	template<typename F>
+	void run(F&& work, job_counter* counter = nullptr, job_counter* after = nullptr) {
+		detail::submit(detail::make(std::forward<F>(work), false), counter, after);
+	}
+
+	// The same, but only the main thread runs it
+	template<typename F>
+	void run_on_main(F&& work, job_counter* counter = nullptr, job_counter* after = nullptr) {
+		detail::submit(detail::make(std::forward<F>(work), true), counter, after);
+	}
+
+	// The same, but only workers run it, so a main thread wait never gets stuck inside it
+	// Without workers the main thread runs it while it waits
+	template<typename F>
+	void run_on_workers(F&& work, job_counter* counter = nullptr, job_counter* after = nullptr) {
+		detail::submit(detail::make(std::forward<F>(work), false, true), counter, after);
+	}
+
+	// Run other jobs until the counter reaches zero
+	void wait(job_counter& counter);
+
+	// Main thread, the main thread jobs queued so far
+	void run_main_jobs();
+
+	[[nodiscard]]
+	stats_t get_stats();
+
+	namespace detail {
+		// Runs a range grain items at a time, splitting half of what is left off as a new job
+		// whenever the thread has nothing queued for others to steal (lazy binary splitting)
+		// so ranges are only cut as finely as idle threads ask for
+		template<typename F>
+		struct range_job_t {
+			F* body;
+			job_counter* counter;
+			uint32_t first, end, grain;
+
+			void operator()() const {
+				auto begin = first, stop = end;
+				while (begin < stop) {
+					if (stop - begin > grain * 2 && local_queue_empty()) {
+						const auto middle = begin + (stop - begin) / 2;
+						run(range_job_t{ body, counter, middle, stop, grain }, counter);
+						stop = middle;
+					}
+					const auto next = std::min(stop, begin + grain);
+					(*body)(begin, next);
+					begin = next;
+				}
+			}
+		};
+	}
+
+	// body(first, end) over [0, count) in ranges of at least minGrain items, returns when all ran
+	// The grain grows with the count so small bodies are not called too often
+	template<typename F>
+	void parallel_for(const uint32_t count, const uint32_t minGrain, F&& body) {
+		const auto threads = thread_count();
+		const auto grain = std::max({ 1u, minGrain, count / (threads * 16) });
+		if (threads == 1 || count <= grain) {
+			if (count) {
+				body(0u, count);
+			}
+			return;
+		}
+
+		job_counter counter;
+		detail::range_job_t<std::remove_reference_t<F>>{ &body, &counter, 0, count, grain }();
+		wait(counter);
+	}
+}
+
+#endif // JOB_SYSTEM_H
@@ -0,0 +1,43 @@
+#ifndef MAILBOX_H
+#define MAILBOX_H
+#include <atomic>
+#include <cstdint>
+#include <type_traits>
+
+// Hands the latest value from one writer thread to one reader thread without locks
+//
+// Three slots: the writer fills its own and swaps it with the shared one, the reader swaps its
+// own for the shared one when something new is there. Neither side ever waits on the other
+// A value the reader never got to is replaced by the next, so every value has to carry the
+// whole state (keys held, totals) rather than what changed since the last one
+template <typename T>
+class mailbox {
+	static_assert(std::is_trivially_copyable_v<T>, "Mailbox values are copied between threads");
+
+	// Set in the shared index when the writer left a value the reader has not taken
+	static constexpr uint8_t FRESH = 4;
+	static constexpr uint8_t SLOT = 3;
+
+	T m_aSlots[3]{};
+	std::atomic<uint8_t> m_uShared{ 0 };
+	alignas(64) uint8_t m_uWriting = 1;
+	alignas(64) uint8_t m_uReading = 2;
+
+public:
+	void write(const T& value) {
+		m_aSlots[m_uWriting] = value;
+		m_uWriting = m_uShared.exchange(m_uWriting | FRESH, std::memory_order_acq_rel) & SLOT;
+	}
+
+	// The latest value written, false when it is the same one the last read returned
+	bool read(T& value) {
+		const auto fresh = (m_uShared.load(std::memory_order_relaxed) & FRESH) != 0;
+		if (fresh) {
+			m_uReading = m_uShared.exchange(m_uReading, std::memory_order_acq_rel) & SLOT;
+		}
+		value = m_aSlots[m_uReading];
+		return fresh;
+	}
+};
+
+#endif // MAILBOX_H
@@ -8,8 +8,6 @@
 // Library includes
 #include "glad/glad.h"
 #include "GLFW/glfw3.h"
-#define STB_IMAGE_IMPLEMENTATION
-#include "stb/stb_image.h"
 #include "glm/glm.hpp"
 #include <algorithm>
 #include <fstream>
@@ -27,7 +25,26 @@
 #include <glm/gtc/matrix_inverse.hpp>
 #include <glm/gtc/type_ptr.hpp>
 #include "model.h"
+#include "material.h"
 #include "utils.h"
+#include "image_decoder.h"
+#include "gl_state.h"
+#include "program_cache.h"
+#include "warmup.h"
+#include "render_queue.h"
+#include "frame_data.h"
+#include "object_data.h"
+#include "occlusion.h"
+#include "aabb_tree.h"
+#include "scene_graph.h"
+#include "entity_store.h"
+#include "command_buffer.h"
+#include "job_system.h"
+#include "frame_pipeline.h"
+#include "mailbox.h"
+#include <atomic>
+#include <chrono>
+#include <thread>
 
 // Constant data
 constexpr auto WINDOW_WIDTH = 1366;
@@ -35,11 +52,23 @@ constexpr auto WINDOW_HEIGHT = 768;
 constexpr auto CAMERA_SPEED = 1.f;
 constexpr auto MOUSE_SENSITIVITY = 0.1f;
 
+// Camera keys held, bits of input_state_t::keys
+constexpr uint32_t KEY_FORWARD = 1 << 0;
+constexpr uint32_t KEY_BACKWARD = 1 << 1;
+constexpr uint32_t KEY_LEFT = 1 << 2;
+constexpr uint32_t KEY_RIGHT = 1 << 3;
+constexpr uint32_t KEY_UP = 1 << 4;
+constexpr uint32_t KEY_DOWN = 1 << 5;
+
 // Global data
 std::shared_ptr<shader> mainShader;
 std::shared_ptr<shader> lightingShader;
 std::shared_ptr<shader> lightSourceShader;
 std::shared_ptr<shader> skyboxShader;
+
+// Skybox uniforms, resolved once the programs linked
+uniform_handle<int> uniformLightingSkybox, uniformSkyboxMap;
+uniform_handle<glm::mat4> uniformSkyboxView, uniformSkyboxProjection;
 unsigned int texContainer, texFace, texCapsule, texTerrain, texSphere;
 unsigned int texSkybox;
 float deltaTime{0}, lastTime{0};
@@ -49,12 +78,17 @@ auto cam1 = camera(glm::vec3(0, 0, 3));
 void process_input_for_window(GLFWwindow* window);
 void mouse_callback(GLFWwindow* window, double xpos, double ypos);
 void scroll_callback(GLFWwindow* window, double xoffset, double yoffset);
+void framebuffer_callback(GLFWwindow* window, int width, int height);
+int run_renderer(GLFWwindow* window);
 bool initialize_shaders();
 void initialize_textures();
 void initialize_skybox();
 void init_matrix_ubo();
-void update_matrix_ubo(const glm::mat4&& view, const glm::mat4&& projection, const glm::vec3&& cameraPosition);
-void bind_matrix_ubo(const GLuint shader);
+void update_matrix_ubo(const glm::mat4& view, const glm::mat4& projection, const glm::vec3& cameraPosition);
+void bind_matrix_ubo(const std::shared_ptr<shader>& program);
+void update_light_ubo(const glm::vec3& position, const glm::vec3& color);
+struct frame_packet_t;
+void report_frame_stats(float curTime, const frame_packet_t& packet);
 
 std::shared_ptr<mesh> meshSphere;
 std::shared_ptr<mesh> meshCube;
@@ -63,56 +97,268 @@ std::shared_ptr<mesh> meshCooper;
 std::shared_ptr<mesh> meshTerrain;
 std::shared_ptr<mesh> meshSkybox;
 
-std::shared_ptr<model> modelSphere;
+// Placement of everything drawn in the scene, one entity per model
+// Declared before the models, they give their entities back when they go
+entity_store sceneEntities;
+
+std::vector<std::shared_ptr<model>> modelSpheres;
 std::shared_ptr<model> modelLight;
+std::shared_ptr<model> modelSkybox;
 
-void RenderLight() {
-	glm::vec3 lightPos(sin(glfwGetTime()) * 1, 0.25, cos(glfwGetTime()) * 1);
-	lightingShader->setVec3("lightPos", lightPos.x, lightPos.y, lightPos.z);
-	modelLight->set_position(lightPos);
-	modelLight->set_scale({ 0.2f, 0.2f, 0.2f });
-	modelLight->draw();
+// Everything drawn in a frame goes through here
+render_queue renderQueue;
+
+// Index 10 just to test
+GLuint binding_point_index = 10;
+GLuint light_binding_index = 11;
+uniform_buffer<shader_data_t> uboMatrices{ binding_point_index };
+uniform_buffer<light_data_t> uboLight{ light_binding_index };
+
+// Material of the lit spheres, picks which lighting variant they use
+std::shared_ptr<material> materialSphere;
+
+const glm::vec3 cubePositions[] = {
+	glm::vec3(0.0f, 0.0f, 0.0f),
+	glm::vec3(2.0f, 5.0f, -15.0f),
+	glm::vec3(-1.5f, -2.2f, -2.5f),
+	glm::vec3(-3.8f, -2.0f, -12.3f),
+	glm::vec3(2.4f, -0.4f, -3.5f),
+	glm::vec3(-1.7f, 3.0f, -7.5f),
+	glm::vec3(1.3f, -2.0f, -2.5f),
+	glm::vec3(1.5f, 2.0f, -2.5f),
+	glm::vec3(1.5f, 0.2f, -1.5f),
+	glm::vec3(-1.3f, 1.0f, -1.5f)
+};
+
+// The light orbits on a pivot, its entity takes the light node's world matrix
+scene_graph sceneGraph;
+uint32_t lightPivot, lightNode;
+
+// Each drawn entity and its entry in the scene index, indexed by entity index
+struct scene_object_t {
+	entity_t entity;
+	int32_t proxy = aabb_tree::NONE;
+};
+std::vector<scene_object_t> sceneObjects;
+
+// World bounds of the drawn entities, user values are entity indices
+// Bounds follow the entities the store recomputed and the frame only submits what the camera sees
+aabb_tree sceneIndex;
+std::vector<uint32_t> visibleObjects;
+
+// Camera input as the event thread last saw it, always the whole state
+// Angles are totals in degrees since startup, the simulation applies how far they moved since
+// the state it applied last
+struct input_state_t {
+	std::chrono::steady_clock::time_point sampled;
+	uint32_t keys = 0;
+	double yaw = 0, pitch = 0, fov = 0;
+};
+
+// The main thread only handles window events, the render thread owns the GL context
+// Input goes from one to the other through the mailbox, the render thread never waits on it
+mailbox<input_state_t> inputMailbox;
+mailbox<glm::ivec2> framebufferMailbox;
+std::atomic<bool> running{ true };
+
+// Event thread side, published whenever it changes
+input_state_t eventInput;
+bool eventInputChanged = false;
+
+// Simulation side, the state the camera is at
+input_state_t appliedInput;
+
+// Everything the GL stage needs from the simulation for one frame
+// Visible objects are recorded in chunks on worker threads, then replayed into the queue in order
+struct frame_packet_t {
+	glm::mat4 view{ 1.f }, projection{ 1.f };
+	glm::vec3 eye{ 0.f }, lightPosition{ 0.f };
+	std::vector<command_buffer> commands;
+	uint32_t visible = 0, objects = 0, updated = 0;
+
+	// When the input the frame used was sampled, and whether it was new to this frame
+	std::chrono::steady_clock::time_point inputSampled;
+	bool inputFresh = false;
+};
+
+// Time from sampling input to the swap of the first frame showing it, about a refresh short of
+// the photons with vsync on
+struct input_latency_t {
+	double totalMs = 0;
+	double maxMs = 0;
+	unsigned int samples = 0;
+};
+input_latency_t inputLatency;
+
+// The camera, scene entities, scene graph and scene index belong to the simulation stage, the
+// GL stage only reads the packets it finished
+frame_pipeline<frame_packet_t> framePipeline;
+
+void add_scene_object(const model& source) {
+	const auto entity = source.get_entity();
+	if (sceneObjects.size() <= entity.index) {
+		sceneObjects.resize(entity.index + 1);
+	}
+	sceneObjects[entity.index] = { entity, sceneIndex.insert(sceneEntities.get_world_bounds(sceneEntities.get_slot(entity)), entity.index) };
 }
 
-void RenderLitCubes() {
-	glm::vec3 cubePositions[] = {
-		glm::vec3(0.0f, 0.0f, 0.0f),
-		glm::vec3(2.0f, 5.0f, -15.0f),
-		glm::vec3(-1.5f, -2.2f, -2.5f),
-		glm::vec3(-3.8f, -2.0f, -12.3f),
-		glm::vec3(2.4f, -0.4f, -3.5f),
-		glm::vec3(-1.7f, 3.0f, -7.5f),
-		glm::vec3(1.3f, -2.0f, -2.5f),
-		glm::vec3(1.5f, 2.0f, -2.5f),
-		glm::vec3(1.5f, 0.2f, -1.5f),
-		glm::vec3(-1.3f, 1.0f, -1.5f)
-	};
-	
-	lightingShader->setVec3("lightColor", 1.f, 1.f, 1.0f);
+void build_scene() {
+	for (size_t i = 0; i < modelSpheres.size(); i++) {
+		modelSpheres[i]->set_position(cubePositions[i]);
+	}
+
+	lightPivot = sceneGraph.create();
+	sceneGraph.set_position(lightPivot, { 0.f, 0.25f, 0.f });
+	lightNode = sceneGraph.create(lightPivot);
+	sceneGraph.set_position(lightNode, { 0.f, 0.f, 1.f });
+	sceneGraph.set_scale(lightNode, glm::vec3(0.2f));
+	sceneGraph.update();
+	sceneEntities.set_world(modelLight->get_entity(), sceneGraph.get_world(lightNode));
+	sceneEntities.update_transforms();
+
+	for (const auto& sphere : modelSpheres) {
+		add_scene_object(*sphere);
+	}
+	add_scene_object(*modelLight);
+}
+
+void UpdateCamera(const input_state_t& input, const float delta) {
+	const auto step = CAMERA_SPEED * delta;
+	if (input.keys & KEY_FORWARD) {
+		cam1.move_forward(step);
+	}
+	if (input.keys & KEY_BACKWARD) {
+		cam1.move_backward(step);
+	}
+	if (input.keys & KEY_LEFT) {
+		cam1.move_left(step);
+	}
+	if (input.keys & KEY_RIGHT) {
+		cam1.move_right(step);
+	}
+	if (input.keys & KEY_UP) {
+		cam1.move_up(step);
+	}
+	if (input.keys & KEY_DOWN) {
+		cam1.move_down(step);
+	}
+
+	if (input.yaw != appliedInput.yaw || input.pitch != appliedInput.pitch) {
+		cam1.add_yaw(static_cast<float>(input.yaw - appliedInput.yaw));
+		cam1.add_pitch(static_cast<float>(input.pitch - appliedInput.pitch));
+	}
+	if (input.fov != appliedInput.fov) {
+		cam1.adjust_fov(static_cast<float>(input.fov - appliedInput.fov));
+	}
+	appliedInput = input;
+}
+
+void UpdateLight(const float time) {
+	sceneGraph.set_yaw(lightPivot, glm::degrees(time));
+}
 
+void UpdateLitCubes(const float delta) {
 	static float rotation = 0.f;
-	rotation += 120.f * deltaTime;
+	rotation += 120.f * delta;
+
+	for (const auto& sphere : modelSpheres) {
+		sphere->set_yaw(rotation);
+	}
+}
+
+// Recompute what moved and keep the scene index in step with it
+void UpdateScene(frame_packet_t& packet) {
+	sceneGraph.update();
+	for (const auto node : sceneGraph.get_changed()) {
+		if (node == lightNode) {
+			sceneEntities.set_world(modelLight->get_entity(), sceneGraph.get_world(node));
+		}
+	}
+
+	packet.updated = sceneEntities.update_transforms();
+	for (const auto slot : sceneEntities.get_changed()) {
+		const auto entity = sceneEntities.get_entity(slot);
+		if (entity.index < sceneObjects.size() && sceneObjects[entity.index].proxy != aabb_tree::NONE) {
+			sceneIndex.update(sceneObjects[entity.index].proxy, sceneEntities.get_world_bounds(slot));
+		}
+	}
+
+	packet.lightPosition = sceneGraph.get_world_position(lightNode);
+}
+
+// Record whatever the index finds in the view frustum
+void RecordScene(frame_packet_t& packet) {
+	visibleObjects.clear();
+	sceneIndex.query_frustum(cam1.get_frustum(), visibleObjects);
+
+	const auto eye = cam1.get_pos();
+	command_buffer::record(packet.commands, static_cast<uint32_t>(visibleObjects.size()), renderQueue.get_far_plane(),
+		[eye](command_buffer& buffer, const uint32_t first, const uint32_t end) {
+			for (auto i = first; i < end; i++) {
+				const auto slot = sceneEntities.get_slot(sceneObjects[visibleObjects[i]].entity);
+				sceneEntities.get_source(slot)->submit(buffer, eye, sceneEntities.get_world(slot), sceneEntities.get_normal(slot));
+			}
+		});
+	packet.visible = static_cast<uint32_t>(visibleObjects.size());
+	packet.objects = static_cast<uint32_t>(sceneIndex.size());
+}
+
+// Simulation stage, runs on the job system while the GL stage draws the frame before
+// Takes the latest input the event thread published, as late as it can
+void Simulate(const float time, const float delta, frame_packet_t& packet) {
+	input_state_t input;
+	packet.inputFresh = inputMailbox.read(input);
+	packet.inputSampled = input.sampled;
+
+	UpdateCamera(input, delta);
+	UpdateLight(time);
+	UpdateLitCubes(delta);
+	UpdateScene(packet);
+	RecordScene(packet);
+
+	packet.view = cam1.get_view_matrix();
+	packet.projection = cam1.get_projection_matrix();
+	packet.eye = cam1.get_pos();
+}
+
+// The queue draws it after everything opaque, at the far plane
+void RenderSkybox(const frame_packet_t& packet) {
+	gl_state::bind_texture(3, GL_TEXTURE_CUBE_MAP, texSkybox);
+	lightingShader->set(uniformLightingSkybox, 3);
+	skyboxShader->set(uniformSkyboxMap, 3);
+	skyboxShader->set(uniformSkyboxView, glm::mat4(glm::mat3(packet.view)));
+	skyboxShader->set(uniformSkyboxProjection, packet.projection);
+	modelSkybox->submit(renderQueue, packet.eye, render_pass::skybox);
+}
+
+// GL stage, draws a packet the simulation finished
+void Render(const frame_packet_t& packet) {
+	update_matrix_ubo(packet.view, packet.projection, packet.eye);
+	update_light_ubo(packet.lightPosition, { 1.f, 1.f, 1.f });
 
-	// SCALE TRANSLATE ROTATE
-	for (auto& pos : cubePositions) {
-		lightingShader->setInt("textured", 0);
-		modelSphere->set_position(pos); 
-		modelSphere->set_yaw(rotation);
-		modelSphere->draw();
+	RenderSkybox(packet);
+	for (const auto& buffer : packet.commands) {
+		renderQueue.submit(buffer);
 	}
+	renderQueue.set_occlusion(packet.projection * packet.view);
+	renderQueue.flush();
 }
 
-void RenderSkybox() {
-	glDepthMask(GL_FALSE);
-	skyboxShader->use();
-	glActiveTexture(GL_TEXTURE3); 
-	glBindTexture(GL_TEXTURE_CUBE_MAP, texSkybox);
-	lightingShader->setInt("skybox", 3); 
-	skyboxShader->setInt("skybox", 3);
-	skyboxShader->setMatrix("view", glm::mat4(glm::mat3(cam1.get_view_matrix())));
-	skyboxShader->setMatrix("projection", cam1.get_projection_matrix());
-	meshSkybox->Draw();
-	glDepthMask(GL_TRUE);
+void StartSimulation(const float time, const float delta) {
+	framePipeline.start([time, delta](frame_packet_t& packet) {
+		Simulate(time, delta, packet);
+	});
+}
+
+// Count the latency of input that first showed in the frame just swapped
+void MeasureInputLatency(const frame_packet_t& packet) {
+	if (!packet.inputFresh) {
+		return;
+	}
+	const auto ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - packet.inputSampled).count();
+	inputLatency.totalMs += ms;
+	inputLatency.maxMs = std::max(inputLatency.maxMs, ms);
+	inputLatency.samples++;
 }
 
 int main() {
@@ -130,104 +376,221 @@ int main() {
 	
 	glfwSetCursorPosCallback(window, mouse_callback);
 	glfwSetScrollCallback(window, scroll_callback);
+	glfwSetFramebufferSizeCallback(window, framebuffer_callback);
+
+	// The render thread takes the GL context, this thread only handles window events so input
+	// keeps being sampled while a swap blocks on vsync
+	glfwMakeContextCurrent(nullptr);
+	auto result = 0;
+	std::thread renderer([window, &result] {
+		result = run_renderer(window);
+		job_system::shutdown();
+		glfwMakeContextCurrent(nullptr);
+
+		running.store(false, std::memory_order_release);
+		glfwPostEmptyEvent();
+	});
+
+	while (running.load(std::memory_order_acquire)) {
+		glfwWaitEvents();
+		process_input_for_window(window);
+		if (glfwWindowShouldClose(window)) {
+			running.store(false, std::memory_order_release);
+		}
+	}
+	renderer.join();
+
+	// GL objects still alive are released at exit
+	glfwMakeContextCurrent(window);
+	return result;
+}
+
+// Loads everything and draws frames until the event thread stops it, owns the GL context
+int run_renderer(GLFWwindow* window) {
+	glfwMakeContextCurrent(window);
+
+	// Workers for asset decoding, culling and draw recording, this thread is the job system's
+	// main thread, the one main thread jobs run on
+	job_system::init();
 
-	// Initialize our shaders
+	// Faint skybox reflection on the spheres, untextured
+	materialSphere = std::make_shared<material>(glm::vec3(0.4f), glm::vec3(1.f), glm::vec3(0.5f), 2, 16.f);
+	materialSphere->set_reflectivity(0.05f);
+
+	// Submit our shaders, the driver compiles them while we load everything else
+	const auto shaderStart = std::chrono::steady_clock::now();
 	if (!initialize_shaders()) {
 		return -1;
 	}
-	init_matrix_ubo();
-	bind_matrix_ubo(mainShader->getProgram());
-	bind_matrix_ubo(lightingShader->getProgram());
-	bind_matrix_ubo(lightSourceShader->getProgram());
+	const auto submitMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - shaderStart).count();
 
 	// Generate and setup the textures (just one for now)
 	initialize_textures();
 	initialize_skybox();
+	image_decoders::print_stats();
+
+	resource_manager::load_mesh("test.mesh");
+	resource_manager::load_mesh("sphere.mesh");
+	meshSkybox = resource_manager::load_mesh("skybox.mesh");
+
+	// Now wait on whatever the driver has not finished yet
+	const auto waitStart = std::chrono::steady_clock::now();
+	if (!resource_manager::finish_shaders()) {
+		return -1;
+	}
+	const auto waitMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - waitStart).count();
+	const auto cacheStats = program_cache::get_stats();
+	printf("Shader setup: %.2f ms submitting, %.2f ms waiting after asset loading (%s, %u from binary cache, %u compiled, %u rejected)\n",
+		submitMs, waitMs, cacheStats.hits > 0 && cacheStats.misses == 0 && cacheStats.rejected == 0 ? "warm" : "cold",
+		cacheStats.hits, cacheStats.misses + cacheStats.rejected, cacheStats.rejected);
+
+	init_matrix_ubo();
+	bind_matrix_ubo(mainShader);
+	bind_matrix_ubo(lightingShader);
+	bind_matrix_ubo(lightSourceShader);
+	lightingShader->bind_uniform_block<light_data_t>("light_data", light_binding_index);
+
+	uniformLightingSkybox = lightingShader->get_uniform<int>("skybox");
+	uniformSkyboxMap = skyboxShader->get_uniform<int>("skybox");
+	uniformSkyboxView = skyboxShader->get_uniform<glm::mat4>("view");
+	uniformSkyboxProjection = skyboxShader->get_uniform<glm::mat4>("projection");
+
+	// Models register their program and mesh for the warm-up
+	// What the scene draws is placed in its store, the skybox follows the camera instead
+	for (size_t i = 0; i < std::size(cubePositions); i++) {
+		modelSpheres.push_back(std::make_shared<model>("test.mesh", "genericLit", materialSphere, sceneEntities));
+	}
+	modelLight = std::make_shared<model>("sphere.mesh", "genericLight", sceneEntities);
+	modelSkybox = std::make_shared<model>("skybox.mesh", "skybox");
+
+	// The lit "spheres" are cubes, so their bounds make an exact occluder
+	const auto occluder = std::make_shared<occluder_t>(occlusion::make_box(modelSpheres[0]->get_mesh()->get_bounds()));
+	for (const auto& sphere : modelSpheres) {
+		sphere->set_occluder(occluder);
+	}
+	warmup::add(skyboxShader, meshSkybox, { .depthMask = false }, "skybox");
+
+	// Scene graph and index after the models, the index needs their bounds
+	build_scene();
+
+	// Pay for deferred driver compiles now rather than on the first frames
+	warmup::run();
+
+	// Recompile shaders as they are edited
+	resource_manager::watch_shaders(true);
 
 	// Main camera
 	cam1.look_at({ 0, 0, 0 });
 
+	// The first packet, the loop draws each one while the next is simulated
+	lastTime = glfwGetTime();
+	StartSimulation(lastTime, 0.f);
+	framePipeline.finish();
+
 	// Our main render loop
-	modelSphere = std::make_shared<model>("test.mesh", "genericLit");
-	modelLight = std::make_shared<model>("sphere.mesh", "genericLight");
-	meshSkybox = resource_manager::load_mesh("skybox.mesh");
 
-	while (!glfwWindowShouldClose(window)) {
+	while (running.load(std::memory_order_acquire)) {
+		gl_state::begin_frame();
+		frame_data::begin_frame();
+		object_data::begin_frame();
+
 		const float curTime = glfwGetTime();
 		deltaTime = curTime - lastTime;
 		lastTime = curTime;
 
-		glfwPollEvents();
-		process_input_for_window(window);
+		glm::ivec2 framebufferSize;
+		if (framebufferMailbox.read(framebufferSize)) {
+			glViewport(0, 0, framebufferSize.x, framebufferSize.y);
+			gl_state::count_calls();
+		}
+
+		// Shaders only reload between frames, the simulation reads them while recording
+		resource_manager::update_shaders();
+		job_system::run_main_jobs();
+
+		StartSimulation(curTime, deltaTime);
 
 		glClearColor(0.02f, 0.02f, 0.02f, 1.f);
 		glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+		gl_state::count_calls(2);
+		Render(framePipeline.current());
+		glfwSwapBuffers(window);
+		MeasureInputLatency(framePipeline.current());
+
+		report_frame_stats(curTime, framePipeline.current());
+		framePipeline.finish();
+	}
 
-		update_matrix_ubo(cam1.get_projection_matrix(), cam1.get_view_matrix(), cam1.get_pos());
+	return 0;
+}
 
-		RenderSkybox();
-		RenderLight();
-		RenderLitCubes();
+// Print per frame driver call averages about once a second
+void report_frame_stats(const float curTime, const frame_packet_t& packet) {
+	static float lastReport = curTime;
+	static unsigned frames = 0;
 
-		glfwSwapBuffers(window);
+	frames++;
+	if (curTime - lastReport < 1.f) {
+		return;
 	}
 
-	return 0;
+	const auto uniforms = shader::get_uniform_stats();
+	const auto state = gl_state::get_frame_counters();
+	const auto queue = renderQueue.get_stats();
+	const auto frameData = frame_data::get_stats();
+	const auto objects = object_data::get_stats();
+	const auto pipeline = framePipeline.get_stats();
+	printf("%.1f fps | uniform uploads/frame: %.1f, skipped: %.1f | gl state calls issued: %llu, filtered: %llu | driver calls last frame: %llu | scene: %u of %zu visible, %u transforms updated | draws: %u (%u meshes, %u instances, %u culled, %u occluded), program switches: %u, vao switches: %u | frame data: %.1f KB%s, waited %.2f ms | objects: %u, re-uploaded: %u | simulate: %.2f ms, gl: %.2f ms, waited %.2f ms | input to swap: %.2f ms, max %.2f ms\n",
+		frames / (curTime - lastReport),
+		static_cast<double>(uniforms.uploads) / frames,
+		static_cast<double>(uniforms.skipped) / frames,
+		state.issued, state.filtered, state.issued + state.other,
+		packet.visible, static_cast<size_t>(packet.objects), packet.updated,
+		queue.draws, queue.commands, queue.instances, queue.culled, queue.occluded, queue.programSwitches, queue.vaoSwitches,
+		frameData.bytes / 1024.0, frameData.persistent ? " persistent" : "", frameData.waitMs,
+		objects.objects, objects.uploaded,
+		pipeline.simulateMs, pipeline.drawMs, pipeline.waitMs,
+		inputLatency.samples ? inputLatency.totalMs / inputLatency.samples : 0.0, inputLatency.maxMs);
+
+	shader::reset_uniform_stats();
+	inputLatency = {};
+	lastReport = curTime;
+	frames = 0;
 }
 
-GLuint uboMatrices = 0;
-GLuint binding_point_index = 10;
+// Bound before the first frame so the warm-up draws read valid blocks
 void init_matrix_ubo() {
-	// Generate the uniform buffer
-	// Bind it, copy the data over, and unbind
-	glGenBuffers(1, &uboMatrices);
-	glBindBuffer(GL_UNIFORM_BUFFER, uboMatrices);
-	glBufferData(GL_UNIFORM_BUFFER, sizeof(shader_data), &shader_data, GL_DYNAMIC_DRAW);
-	glBindBuffer(GL_UNIFORM_BUFFER, 0);
-
-	// Index 10 just to test
-	glBindBufferBase(GL_UNIFORM_BUFFER, binding_point_index, uboMatrices);
+	uboMatrices.upload(shader_data);
+	update_light_ubo({}, { 1.f, 1.f, 1.f });
 }
 
-void update_matrix_ubo(const glm::mat4&& view, const glm::mat4&& projection, const glm::vec3&& cameraPosition) {
+void update_matrix_ubo(const glm::mat4& view, const glm::mat4& projection, const glm::vec3& cameraPosition) {
 	shader_data.view = view;
 	shader_data.projection = projection;
 	shader_data.cameraPosition = cameraPosition;
 
-	glBindBuffer(GL_UNIFORM_BUFFER, uboMatrices);
-	glBufferSubData(GL_UNIFORM_BUFFER, 0, sizeof(glm::mat4), glm::value_ptr(shader_data.projection));
-	glBufferSubData(GL_UNIFORM_BUFFER, sizeof(glm::mat4), sizeof(glm::mat4), glm::value_ptr(shader_data.view));
-	glBufferSubData(GL_UNIFORM_BUFFER, 2 * sizeof(glm::mat4), sizeof(glm::vec3), glm::value_ptr(shader_data.cameraPosition));
-	glBindBuffer(GL_UNIFORM_BUFFER, 0);
+	// The struct matches the std140 block, so it goes up in one copy
+	uboMatrices.upload(shader_data);
+}
+
+void update_light_ubo(const glm::vec3& position, const glm::vec3& color) {
+	uboLight.upload({ position, color });
 }
 
-void bind_matrix_ubo(const GLuint shader) {
-	const auto block_index = glGetUniformBlockIndex(shader, "shader_data");
-	glUniformBlockBinding(shader, block_index, binding_point_index); 
+void bind_matrix_ubo(const std::shared_ptr<shader>& program) {
+	// Goes through the shader so the binding survives hot reloads
+	program->bind_uniform_block<shader_data_t>("shader_data", binding_point_index);
 }
 
+// Only submits the programs, compile errors are reported by resource_manager::finish_shaders
 bool initialize_shaders() {
 	mainShader = resource_manager::load_shader("generic", "vertex.vert", "fragment.frag");
-	if (mainShader->error) {
-		std::cerr << "Error compiling shaders: \n" << mainShader->log << std::endl;
-		return false;
-	}
-
-	lightingShader = resource_manager::load_shader("genericLit", "lighting.vert", "lighting.frag");
-	if (lightingShader->error) {
-		std::cerr << "Error compiling shaders: \n" << lightingShader->log << std::endl;
-		return false;
-	}
-
+	lightingShader = resource_manager::load_shader("genericLit", "lighting.vert", "lighting.frag", materialSphere->get_shader_features());
 	lightSourceShader = resource_manager::load_shader("genericLight", "lighting.vert", "lightsource.frag");
-	if (lightSourceShader->error) {
-		std::cerr << "Error compiling shaders: \n" << lightSourceShader->log << std::endl;
-		return false;
-	}
-
 	skyboxShader = resource_manager::load_shader("skybox", "skybox.vert", "skybox.frag");
-	if (skyboxShader->error) {
-		std::cerr << "Error compiling shaders: \n" << skyboxShader->log << std::endl;
+
+	if (!mainShader || !lightingShader || !lightSourceShader || !skyboxShader) {
+		std::cerr << "Error loading shader sources" << std::endl;
 		return false;
 	}
 
@@ -259,24 +622,32 @@ void process_input_for_window(GLFWwindow* window) {
 		glfwSetWindowShouldClose(window, true);
 	}
 
-	// Camera Movement
+	// Camera Movement, the simulation moves the camera while the keys are held
+	uint32_t keys = 0;
 	if (glfwGetKey(window, GLFW_KEY_W) == GLFW_PRESS) {
-		cam1.move_forward(CAMERA_SPEED * deltaTime);
+		keys |= KEY_FORWARD;
 	}
 	if (glfwGetKey(window, GLFW_KEY_S) == GLFW_PRESS) {
-		cam1.move_backward(CAMERA_SPEED * deltaTime);
+		keys |= KEY_BACKWARD;
 	}
 	if (glfwGetKey(window, GLFW_KEY_A) == GLFW_PRESS) {
-		cam1.move_left(CAMERA_SPEED * deltaTime);
+		keys |= KEY_LEFT;
 	}
 	if (glfwGetKey(window, GLFW_KEY_D) == GLFW_PRESS) {
-		cam1.move_right(CAMERA_SPEED * deltaTime);
+		keys |= KEY_RIGHT;
 	}
 	if (glfwGetKey(window, GLFW_KEY_UP) == GLFW_PRESS) {
-		cam1.move_up(CAMERA_SPEED * deltaTime);
+		keys |= KEY_UP;
 	}
 	if (glfwGetKey(window, GLFW_KEY_DOWN) == GLFW_PRESS) {
-		cam1.move_down(CAMERA_SPEED * deltaTime);
+		keys |= KEY_DOWN;
+	}
+
+	if (keys != eventInput.keys || eventInputChanged) {
+		eventInput.keys = keys;
+		eventInput.sampled = std::chrono::steady_clock::now();
+		inputMailbox.write(eventInput);
+		eventInputChanged = false;
 	}
 }
 
@@ -299,11 +670,18 @@ void mouse_callback(GLFWwindow* window, double xpos, double ypos) {
 	xoffset *= MOUSE_SENSITIVITY;
 	yoffset *= MOUSE_SENSITIVITY;
 
-	cam1.add_yaw(xoffset);
-	cam1.add_pitch(yoffset);
+	eventInput.yaw += xoffset;
+	eventInput.pitch += yoffset;
+	eventInputChanged = true;
 }
 
 void scroll_callback(GLFWwindow* window, double xoffset, double yoffset)
 {
-	cam1.adjust_fov(-2.f * yoffset);
+	eventInput.fov -= 2.0 * yoffset;
+	eventInputChanged = true;
+}
+
+// Applied by the render thread at the start of its next frame
+void framebuffer_callback(GLFWwindow*, const int width, const int height) {
+	framebufferMailbox.write({ width, height });
 }
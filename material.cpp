@@ -1,21 +1,65 @@
 #include "material.h"
 
-inline glm::vec3 material::get_ambient() const {
+material::material(const glm::vec3 ambient, const glm::vec3 diffuse, const glm::vec3 specular, const int illum, const float shiny) :
+	m_cAmbient(ambient), m_cDiffuse(diffuse), m_cSpecular(specular), m_iIllum(illum), m_fShiny(shiny) {
+	static unsigned nextId = 1;
+	m_uId = nextId++;
+}
+
+glm::vec3 material::get_ambient() const {
 	return m_cAmbient;
 }
 
-inline glm::vec3 material::get_diffuse() const {
+glm::vec3 material::get_diffuse() const {
 	return m_cDiffuse;
 }
 
-inline glm::vec3 material::get_specular() const {
+glm::vec3 material::get_specular() const {
 	return m_cSpecular;
 }
 
-inline int material::get_illum() const {
+int material::get_illum() const {
 	return m_iIllum;
 }
 
-inline float material::get_shinyness() const {
+float material::get_shinyness() const {
 	return m_fShiny;
-}
\ No newline at end of file
+}
+
+void material::set_diffuse_map(const unsigned texture) {
+	m_uDiffuseMap = texture;
+}
+
+unsigned material::get_diffuse_map() const {
+	return m_uDiffuseMap;
+}
+
+void material::set_normal_map(const unsigned texture) {
+	m_uNormalMap = texture;
+}
+
+unsigned material::get_normal_map() const {
+	return m_uNormalMap;
+}
+
+void material::set_reflectivity(const float reflectivity) {
+	m_fReflectivity = reflectivity;
+}
+
+float material::get_reflectivity() const {
+	return m_fReflectivity;
+}
+
+shader_features material::get_shader_features() const {
+	shader_features features = 0;
+	if (m_uDiffuseMap != 0) {
+		features |= shader_feature::textured;
+	}
+	if (m_uNormalMap != 0) {
+		features |= shader_feature::normal_map;
+	}
+	if (m_fReflectivity > 0.f) {
+		features |= shader_feature::reflection;
+	}
+	return features;
+}
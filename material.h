@@ -2,6 +2,7 @@
 #define MATERIAL_H
 
 #include "glm/vec3.hpp"
+#include "shader.h"
 
 class material {
 	glm::vec3 m_cAmbient {};
@@ -9,10 +10,21 @@ class material {
 	glm::vec3 m_cSpecular {};
 	int       m_iIllum{ 2 };
 	float     m_fShiny{ 100 };
+
+	// Optional textures and environment reflection, each one enables a shader feature
+	unsigned  m_uDiffuseMap{ 0 };
+	unsigned  m_uNormalMap{ 0 };
+	float     m_fReflectivity{ 0 };
+
+	unsigned  m_uId;
 	
 public:
-	material(const glm::vec3 ambient, const glm::vec3 diffuse, const glm::vec3 specular, const int illum, const float shiny) :
-		m_cAmbient(ambient), m_cDiffuse(diffuse), m_cSpecular(specular), m_iIllum(illum), m_fShiny(shiny) {}
+	material(const glm::vec3 ambient, const glm::vec3 diffuse, const glm::vec3 specular, const int illum, const float shiny);
+
+	[[nodiscard]]
+	unsigned get_id() const {
+		return m_uId;
+	}
 
 	[[nodiscard]]
 	glm::vec3 get_ambient() const;
@@ -28,6 +40,25 @@ public:
 	
 	[[nodiscard]]
 	float get_shinyness() const;
+
+	void set_diffuse_map(unsigned texture);
+
+	[[nodiscard]]
+	unsigned get_diffuse_map() const;
+
+	void set_normal_map(unsigned texture);
+
+	[[nodiscard]]
+	unsigned get_normal_map() const;
+
+	void set_reflectivity(float reflectivity);
+
+	[[nodiscard]]
+	float get_reflectivity() const;
+
+	// Shader variant keywords this material needs
+	[[nodiscard]]
+	shader_features get_shader_features() const;
 };
 
 #endif // MATERIAL_H
@@ -1,45 +1,24 @@
 #include "mesh.h"
 #include "glad/glad.h"
+#include "gl_state.h"
 
 mesh::mesh(const std::vector<mesh_vertex_t>& vertices, const std::vector<unsigned>& indices) {
-	NumIndices = indices.size();
+	static unsigned int nextId = 1;
+	m_uId = nextId++;
 
-	// Generate opengl buffers
-	glGenBuffers(1, &VBO);
-	glGenBuffers(1, &EBO);
-
-	// Generate our VAO
-	glGenVertexArrays(1, &VAO);
-	glBindVertexArray(VAO);
-
-	// Copy our vertex data into vbo
-	glBindBuffer(GL_ARRAY_BUFFER, VBO);
-	glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(vertices[0]), &vertices.front(), GL_STATIC_DRAW);
-
-	// Copy our indices into our ebo
-	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
-	glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(indices[0]), &indices.front(), GL_STATIC_DRAW);
-
-	// X,Y,Z
-	glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(mesh_vertex_t), nullptr);
-	glEnableVertexAttribArray(0);
-
-	// U,V,W
-	glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, sizeof(mesh_vertex_t), (void*)(3 * sizeof(float)));
-	glEnableVertexAttribArray(1);
-
-	// Normal X,Y,Z 
-	glVertexAttribPointer(2, 3, GL_FLOAT, GL_FALSE, sizeof(mesh_vertex_t), (void*)(5 * sizeof(float)));
-	glEnableVertexAttribArray(2);
-
-	// Textured?
-	glVertexAttribIPointer(3, 1, GL_FLOAT, sizeof(mesh_vertex_t), (void*)(8 * sizeof(float)));
-	glEnableVertexAttribArray(3);
+	if (vertices.empty() || indices.empty()) {
+		return;
+	}
 
-	// Normals?
-	glVertexAttribIPointer(4, 1, GL_FLOAT, sizeof(mesh_vertex_t), (void*)(9 * sizeof(float)));
-	glEnableVertexAttribArray(4);
+	auto low = glm::vec3(vertices[0].x, vertices[0].y, vertices[0].z), high = low;
+	for (const auto& vertex : vertices) {
+		low = glm::min(low, glm::vec3(vertex.x, vertex.y, vertex.z));
+		high = glm::max(high, glm::vec3(vertex.x, vertex.y, vertex.z));
+	}
+	m_sBounds = { (low + high) * 0.5f, (high - low) * 0.5f };
 
+	// Copy our vertex data and indices into the shared buffers
+	m_sRange = geometry_pool::allocate(vertices, indices);
 	valid = true;
 }
 
@@ -49,7 +28,22 @@ void mesh::Draw() {
 		return;
 	}
 
-	// Simply bind VAO and draw
-	glBindVertexArray(VAO);
-	glDrawElements(GL_TRIANGLES, NumIndices, GL_UNSIGNED_INT, 0);
-}
\ No newline at end of file
+	// Simply bind VAO and draw our part of the pool
+	gl_state::bind_vertex_array(geometry_pool::vertex_array());
+	glDrawElementsBaseVertex(GL_TRIANGLES, m_sRange.count, GL_UNSIGNED_INT,
+		(void*)(m_sRange.firstIndex * sizeof(unsigned)), m_sRange.baseVertex);
+	gl_state::count_calls();
+}
+
+void mesh::draw_instanced(const unsigned int first, const unsigned int count) {
+	if (!valid) {
+		std::cerr << "Attempted to render invalid mesh: " << std::hex << this << std::endl;
+		return;
+	}
+
+	geometry_pool::point_instance_attributes(first);
+	gl_state::bind_vertex_array(geometry_pool::vertex_array());
+	glDrawElementsInstancedBaseVertex(GL_TRIANGLES, m_sRange.count, GL_UNSIGNED_INT,
+		(void*)(m_sRange.firstIndex * sizeof(unsigned)), count, m_sRange.baseVertex);
+	gl_state::count_calls();
+}
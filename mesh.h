@@ -8,20 +8,12 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <iostream>
+#include "geometry_pool.h"
+#include "culling.h"
 
 class material;
 
-struct mesh_vertex_t {
-	float x, y, z;
-	float u, v;
-	float nx, ny, nz;
-	int textured, hasNormal;
-};
-
 class mesh {
-	// Vertex data
-	std::vector<mesh_vertex_t> m_vVertexData;
-
 	// Material definitions
 	std::vector<material*> m_vMaterials;
 
@@ -30,17 +22,46 @@ class mesh {
 	unsigned int m_uTexNormal;
 	unsigned int m_uTexSpecular;
 
-	// Buffers
-	unsigned int VBO;
-	unsigned int VAO;
-	unsigned int EBO;
+	// Where our vertices and indices live in the geometry pool
+	geometry_pool::range_t m_sRange;
 
-	unsigned int NumIndices;
+	// Bounds of the vertices in model space
+	aabb_t m_sBounds;
+
+	unsigned int m_uId;
 	bool valid = false;
 
 public:
 	mesh(const std::vector<mesh_vertex_t>& vertices, const std::vector<unsigned>& indices);
 
 	void Draw();
+
+	// Draw count instances, starting at instance first of the instance buffer
+	void draw_instanced(unsigned int first, unsigned int count);
+
+	[[nodiscard]]
+	unsigned int get_vertex_array() const {
+		return geometry_pool::vertex_array();
+	}
+
+	[[nodiscard]]
+	const geometry_pool::range_t& get_range() const {
+		return m_sRange;
+	}
+
+	[[nodiscard]]
+	const aabb_t& get_bounds() const {
+		return m_sBounds;
+	}
+
+	[[nodiscard]]
+	unsigned int get_id() const {
+		return m_uId;
+	}
+
+	[[nodiscard]]
+	unsigned int get_index_count() const {
+		return m_sRange.count;
+	}
 };
-#endif // MESH_H
\ No newline at end of file
+#endif // MESH_H
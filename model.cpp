@@ -1,20 +1,110 @@
 #include "model.h"
+#include "command_buffer.h"
 #include "mesh.h"
+#include "material.h"
+#include "gl_state.h"
+#include "warmup.h"
+#include "glad/glad.h"
+
+// Texture units used by material maps
+constexpr unsigned DIFFUSE_MAP_UNIT = 0;
+constexpr unsigned NORMAL_MAP_UNIT = 1;
+
+model::model(std::string mesh, std::string shader, std::shared_ptr<material> material, entity_store& store) : m_mMesh(resource_manager::load_mesh(mesh)), m_sShaderName(std::move(shader)), m_pStore(&store) {
+	place();
+	set_material(std::move(material));
+}
+
+model::~model() {
+	m_pStore->destroy(m_eEntity);
+}
+
+entity_store& model::default_store() {
+	// Leaked, models held by globals can outlive any static store
+	static auto* store = new entity_store;
+	return *store;
+}
+
+void model::place() {
+	m_eEntity = m_pStore->create(this, m_mMesh ? m_mMesh->get_bounds() : aabb_t{});
+}
+
+void model::set_material(std::shared_ptr<material> material) {
+	m_mMaterial = std::move(material);
+	if (m_sShaderName.empty()) {
+		return;
+	}
+
+	// Each feature the material uses picks a specialized program
+	const auto features = m_mMaterial ? m_mMaterial->get_shader_features() : 0;
+	m_mShader = resource_manager::load_shader_variant(m_sShaderName, features);
+	resolve_uniforms();
+}
 
 glm::mat4 model::get_transform() const {
-	auto modelMatrix = glm::mat4(1.0);
-	const auto mScale = scale(modelMatrix, m_vScale);
-	const auto mRotate = rotate(modelMatrix, glm::radians(m_fYaw), glm::vec3{ 0.f, 1.f, 0.f }) * rotate(modelMatrix, glm::radians(m_fPitch), glm::vec3{ 1.f, 0.f, 0.f });
-	const auto mTranslate = translate(modelMatrix, m_vPosition);
-	return mTranslate * mRotate * mScale;
+	return m_pStore->get_current_world(m_eEntity);
+}
+
+aabb_t model::get_world_bounds() const {
+	return culling::transform(m_mMesh->get_bounds(), get_transform());
+}
+
+void model::resolve_uniforms() {
+	if (!m_mShader) {
+		return;
+	}
+
+	m_hModel = m_mShader->get_uniform<glm::mat4>("model");
+	m_hObjectColor = m_mShader->get_uniform<glm::vec3>("objectColor");
+	m_hReflectivity = m_mShader->get_uniform<float>("reflectivity");
+	m_hDiffuseMap = m_mShader->get_uniform<int>("tex1");
+	m_hNormalMap = m_mShader->get_uniform<int>("normalMap");
+
+	// Models draw with the default pipeline state, have it warmed up before the first frame
+	const auto features = m_mMaterial ? m_mMaterial->get_shader_features() : 0;
+	warmup::add(m_mShader, m_mMesh, {}, (m_sShaderName.empty() ? "model" : m_sShaderName) + " #" + std::to_string(features));
 }
 
 void model::draw() const {
-	m_mShader->use();
-	const auto model = get_transform();
-	m_mShader->setMatrix("normalModel", glm::inverseTranspose(model));
-	m_mShader->setMatrix("model", model);
-	m_mShader->setInt("textured", 1);
-	m_mShader->setVec3("objectColor", m_vColor);
-	m_mMesh->Draw();
+	// Instanced shaders fetch their data by object id, a queue of one takes care of that
+	static render_queue immediate;
+	submit(immediate, get_position());
+	immediate.flush();
+}
+
+void model::submit(render_queue& queue, const glm::vec3& eye, const render_pass pass) const {
+	queue.submit(pass, *this, get_transform(), glm::distance(eye, get_position()));
+}
+
+void model::submit(render_queue& queue, const glm::vec3& eye, const glm::mat4& world, const glm::mat3& normal, const render_pass pass) const {
+	queue.submit(pass, *this, world, normal, glm::distance(eye, glm::vec3(world[3])));
+}
+
+void model::submit(command_buffer& buffer, const glm::vec3& eye, const render_pass pass) const {
+	buffer.draw(pass, *this, get_transform(), glm::distance(eye, get_position()));
+}
+
+void model::submit(command_buffer& buffer, const glm::vec3& eye, const glm::mat4& world, const glm::mat3& normal, const render_pass pass) const {
+	buffer.draw(pass, *this, world, normal, glm::distance(eye, glm::vec3(world[3])));
+}
+
+void model::bind_material() const {
+	// Handles are only valid when the variant uses the feature
+	if (m_mMaterial) {
+		m_mShader->set(m_hReflectivity, m_mMaterial->get_reflectivity());
+		if (m_hDiffuseMap.valid()) {
+			gl_state::bind_texture(DIFFUSE_MAP_UNIT, GL_TEXTURE_2D, m_mMaterial->get_diffuse_map());
+			m_mShader->set(m_hDiffuseMap, static_cast<int>(DIFFUSE_MAP_UNIT));
+		}
+		if (m_hNormalMap.valid()) {
+			gl_state::bind_texture(NORMAL_MAP_UNIT, GL_TEXTURE_2D, m_mMaterial->get_normal_map());
+			m_mShader->set(m_hNormalMap, static_cast<int>(NORMAL_MAP_UNIT));
+		}
+	}
+}
+
+void model::draw_transform(const glm::mat4& transform) const {
+	m_mShader->set(m_hModel, transform);
+	m_mShader->set(m_hObjectColor, glm::vec3(m_vColor));
+	warmup::draw(*m_mMesh);
 }
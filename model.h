@@ -4,24 +4,94 @@
 
 #include "resource_manager.h"
 #include "shader.h"
+#include "render_queue.h"
+#include "culling.h"
+#include "entity_store.h"
 #include "glm/vec3.hpp"
 #include "glm/vec4.hpp"
 #include "glm/gtc/matrix_inverse.hpp"
 #include "glm/gtx/transform.hpp"
 
 class mesh;
+class material;
+struct occluder_t;
 
+// What draws an object, and where
+// Mesh, shader and material are shared, the placement is an entity in a store the model draws
+// itself from. A scene keeps its models in its own store and updates all of them at once
+// there, models made without one share a store of their own
 class model {
 	std::shared_ptr<mesh> m_mMesh;
 	std::shared_ptr<shader> m_mShader;
-	glm::vec3 m_vPosition {0};
+	std::shared_ptr<material> m_mMaterial;
+	std::shared_ptr<const occluder_t> m_mOccluder;
+	std::string m_sShaderName;
 	glm::vec4 m_vColor {1};
-	glm::vec3 m_vScale {1.0};
-	float m_fPitch, m_fYaw;
+	entity_store* m_pStore;
+	entity_t m_eEntity;
+
+	// Uniform handles for our shader, resolved once
+	uniform_handle<glm::mat4> m_hModel;
+	uniform_handle<glm::vec3> m_hObjectColor;
+	uniform_handle<float> m_hReflectivity;
+	uniform_handle<int> m_hDiffuseMap;
+	uniform_handle<int> m_hNormalMap;
+
+	void resolve_uniforms();
+	void place();
 
 public:
-	model(std::shared_ptr<mesh> &&mesh, std::shared_ptr<shader> &&shader) : m_mMesh(std::move(mesh)), m_mShader(std::move(shader)) {}
-	model(std::string mesh, std::string shader) : m_mMesh(resource_manager::load_mesh(mesh)), m_mShader(resource_manager::load_shader(shader)) {}
+	// The store models without one of their own are placed in, never destroyed
+	static entity_store& default_store();
+
+	model(std::shared_ptr<mesh> &&mesh, std::shared_ptr<shader> &&shader, entity_store& store = default_store()) : m_mMesh(std::move(mesh)), m_mShader(std::move(shader)), m_pStore(&store) { place(); resolve_uniforms(); }
+	model(std::string mesh, std::string shader, entity_store& store = default_store()) : m_mMesh(resource_manager::load_mesh(mesh)), m_mShader(resource_manager::load_shader(shader)), m_sShaderName(shader), m_pStore(&store) { place(); resolve_uniforms(); }
+	model(std::string mesh, std::string shader, std::shared_ptr<material> material, entity_store& store = default_store());
+
+	// The entity points back at the model, so it stays where it was made
+	model(const model&) = delete;
+	model& operator=(const model&) = delete;
+
+	~model();
+
+	[[nodiscard]]
+	entity_store& get_store() const {
+		return *m_pStore;
+	}
+
+	[[nodiscard]]
+	entity_t get_entity() const {
+		return m_eEntity;
+	}
+
+	// Switches to the shader variant the material needs
+	// Only available when the model was created from a shader name
+	void set_material(std::shared_ptr<material> material);
+
+	[[nodiscard]]
+	const std::shared_ptr<material>& get_material() const {
+		return m_mMaterial;
+	}
+
+	[[nodiscard]]
+	const std::shared_ptr<shader>& get_shader() const {
+		return m_mShader;
+	}
+
+	[[nodiscard]]
+	const std::shared_ptr<mesh>& get_mesh() const {
+		return m_mMesh;
+	}
+
+	// Simplified geometry the render queue rasterizes on the CPU to hide what is behind this model
+	void set_occluder(std::shared_ptr<const occluder_t> occluder) {
+		m_mOccluder = std::move(occluder);
+	}
+
+	[[nodiscard]]
+	const std::shared_ptr<const occluder_t>& get_occluder() const {
+		return m_mOccluder;
+	}
 
 	auto set_color(glm::vec4 &col) {
 		m_vColor = col;
@@ -32,31 +102,51 @@ public:
 		return m_vColor;
 	}
 	
-	auto set_position(glm::vec3& pos) {
-		m_vPosition = pos;
+	auto set_position(const glm::vec3& pos) {
+		m_pStore->set_position(m_eEntity, pos);
 	}
 
 	[[nodiscard]]
 	auto get_position() const {
-		return m_vPosition;
+		return m_pStore->get_position(m_eEntity);
 	}
 	
 	auto set_pitch(const float pitch) {
-		m_fPitch = pitch;
+		m_pStore->set_rotation(m_eEntity, pitch, m_pStore->get_rotation(m_eEntity).y);
 	}
 	
 	auto set_yaw(const float yaw) {
-		m_fYaw = yaw;
+		m_pStore->set_rotation(m_eEntity, m_pStore->get_rotation(m_eEntity).x, yaw);
 	}
 
 	auto set_scale(const glm::vec3& scale) {
-		m_vScale = scale;
+		m_pStore->set_scale(m_eEntity, scale);
 	}
 
-	// SCALE ROTATE TRANSFORM
+	// SCALE ROTATE TRANSFORM, or the world matrix the entity was placed by
 	[[nodiscard]]
 	glm::mat4 get_transform() const;
 
+	// The mesh bounds moved by the current transform
+	[[nodiscard]]
+	aabb_t get_world_bounds() const;
+
 	void draw() const;
+
+	// Queue a draw with the current transform, sorted by distance from the eye
+	void submit(render_queue& queue, const glm::vec3& eye, render_pass pass = render_pass::opaque) const;
+
+	// Queue a draw with matrices cached elsewhere, ignoring the model's own placement
+	void submit(render_queue& queue, const glm::vec3& eye, const glm::mat4& world, const glm::mat3& normal, render_pass pass = render_pass::opaque) const;
+
+	// The same two, recorded for the queue to replay later, safe to call from any thread
+	void submit(command_buffer& buffer, const glm::vec3& eye, render_pass pass = render_pass::opaque) const;
+	void submit(command_buffer& buffer, const glm::vec3& eye, const glm::mat4& world, const glm::mat3& normal, render_pass pass = render_pass::opaque) const;
+
+	// The two halves of a draw, the render queue skips bind_material when the previous
+	// draw already used the same shader and material
+	// draw_transform is only used for shaders that do not read instance data
+	void bind_material() const;
+	void draw_transform(const glm::mat4& transform) const;
 };
 #endif // MODEL_H
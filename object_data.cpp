@@ -0,0 +1,152 @@
+#include "object_data.h"
+#include "glad/glad.h"
+#include "gl_state.h"
+#include "frame_data.h"
+#include <cstring>
+#include <vector>
+
+namespace {
+	struct dirty_t {
+		uint32_t first;
+		uint32_t end;
+	};
+
+	// One buffer texture per frame in flight, a frame only writes the one the GPU finished with
+	struct ring_entry_t {
+		unsigned int buffer = 0;
+		unsigned int texture = 0;
+		size_t capacity = 0;
+
+		// What each slot holds on the GPU once the pending ranges are uploaded
+		std::vector<object_data_t> slots;
+		std::vector<dirty_t> dirty;
+
+		// Placed when the frame that used the buffer ends
+		GLsync fence = nullptr;
+	};
+
+	std::vector<ring_entry_t> ring;
+	unsigned int entry = 0;
+	uint32_t cursor = 0;
+
+	object_data::stats_t current, last;
+
+	void mark_dirty(ring_entry_t& target, const uint32_t slot) {
+		// Slots are handed out in order, so neighbours merge into one upload
+		if (!target.dirty.empty() && target.dirty.back().end == slot) {
+			target.dirty.back().end++;
+			return;
+		}
+		target.dirty.push_back({ slot, slot + 1 });
+	}
+
+	ring_entry_t& current_entry() {
+		if (ring.empty()) {
+			ring.resize(frame_data::frames_in_flight());
+		}
+		return ring[entry];
+	}
+
+	// A bigger buffer loses its contents, every slot goes up again
+	void reserve(ring_entry_t& target, const size_t count) {
+		if (count <= target.capacity) {
+			return;
+		}
+
+		if (!target.buffer) {
+			glGenBuffers(1, &target.buffer);
+			glGenTextures(1, &target.texture);
+		}
+
+		target.capacity = target.capacity ? target.capacity : 1024;
+		while (target.capacity < count) {
+			target.capacity *= 2;
+		}
+
+		gl_state::bind_buffer(GL_TEXTURE_BUFFER, target.buffer);
+		glBufferData(GL_TEXTURE_BUFFER, target.capacity * sizeof(object_data_t), nullptr, GL_DYNAMIC_DRAW);
+
+		// Reattach so the texture sees the new storage
+		gl_state::bind_texture(object_data::TEXTURE_UNIT, GL_TEXTURE_BUFFER, target.texture);
+		glTexBuffer(GL_TEXTURE_BUFFER, GL_RGBA32F, target.buffer);
+
+		target.dirty.clear();
+		if (!target.slots.empty()) {
+			target.dirty.push_back({ 0, static_cast<uint32_t>(target.slots.size()) });
+		}
+	}
+}
+
+namespace object_data {
+	void begin_frame() {
+		current.objects = cursor;
+		last = current;
+		current = {};
+		cursor = 0;
+
+		// Fence the buffer the last frame drew from and move to the next one, its fence
+		// only holds us up when the CPU is frames in flight ahead of the GPU
+		auto& used = current_entry();
+		if (used.buffer) {
+			used.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+			gl_state::count_calls();
+		}
+		entry = (entry + 1) % ring.size();
+
+		if (auto& fence = ring[entry].fence) {
+			while (glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000000) == GL_TIMEOUT_EXPIRED) {
+				gl_state::count_calls();
+			}
+			glDeleteSync(fence);
+			gl_state::count_calls(2);
+			fence = nullptr;
+		}
+	}
+
+	uint32_t push(const object_data_t& data) {
+		auto& target = current_entry();
+		const auto slot = cursor++;
+		if (slot == target.slots.size()) {
+			target.slots.push_back(data);
+			mark_dirty(target, slot);
+		}
+		else if (std::memcmp(&target.slots[slot], &data, sizeof(object_data_t)) != 0) {
+			target.slots[slot] = data;
+			mark_dirty(target, slot);
+		}
+		return slot;
+	}
+
+	void upload() {
+		auto& target = current_entry();
+		reserve(target, target.slots.size());
+		gl_state::bind_texture(TEXTURE_UNIT, GL_TEXTURE_BUFFER, target.texture);
+		if (target.dirty.empty()) {
+			return;
+		}
+
+		// The GPU is done with this buffer, so the writes need no synchronization
+		gl_state::bind_buffer(GL_TEXTURE_BUFFER, target.buffer);
+		for (const auto& range : target.dirty) {
+			const auto offset = range.first * sizeof(object_data_t);
+			const auto size = (range.end - range.first) * sizeof(object_data_t);
+			auto* mapped = glMapBufferRange(GL_TEXTURE_BUFFER, offset, size, GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_RANGE_BIT | GL_MAP_UNSYNCHRONIZED_BIT);
+			if (mapped) {
+				std::memcpy(mapped, &target.slots[range.first], size);
+				glUnmapBuffer(GL_TEXTURE_BUFFER);
+				gl_state::count_calls(2);
+			}
+			else {
+				glBufferSubData(GL_TEXTURE_BUFFER, offset, size, &target.slots[range.first]);
+				gl_state::count_calls(2);
+			}
+			current.uploaded += range.end - range.first;
+			current.uploads++;
+		}
+		target.dirty.clear();
+	}
+
+	stats_t get_stats() {
+		return last;
+	}
+}
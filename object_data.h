@@ -0,0 +1,48 @@
+#ifndef OBJECT_DATA_H
+#define OBJECT_DATA_H
+#include <cstdint>
+#include "glm/glm.hpp"
+
+// Per object constants of the instanced shaders, mirrored by shaders/object_data.glsl
+// Stored as 8 RGBA32F texels, the normal matrix columns are padded to vec4
+struct object_data_t {
+	glm::mat4 model;
+	glm::mat3x4 normalModel;
+	glm::vec4 color;
+};
+static_assert(sizeof(object_data_t) == 8 * sizeof(glm::vec4), "object_data_t must be 8 texels");
+
+// All objects drawn in a frame, packed in one buffer texture that shaders index by object id
+//
+// GL 3.3 has neither storage buffers nor gl_DrawID, so the array is a texture buffer
+// and the id arrives through an instanced vertex attribute (see geometry_pool).
+// There is a buffer texture per frame in flight (frame_data::frames_in_flight), each fenced
+// like the frame data regions, so a frame never writes one the GPU still reads
+// Slots are handed out in submission order each frame and compared against what the slot
+// held the last time its buffer was used, so a scene submitted the same way only uploads
+// what moved, once into each buffer
+namespace object_data {
+	// Texture unit the buffer texture stays bound to
+	constexpr unsigned int TEXTURE_UNIT = 4;
+
+	struct stats_t {
+		unsigned int objects = 0;
+		unsigned int uploaded = 0;
+		unsigned int uploads = 0;
+	};
+
+	// Start handing out slots from the first one again
+	void begin_frame();
+
+	// Store the data of one object, returns the id shaders fetch it with
+	uint32_t push(const object_data_t& data);
+
+	// Upload the slots that changed since the last call, the render queue does this before drawing
+	void upload();
+
+	// Counters for the last complete frame
+	[[nodiscard]]
+	stats_t get_stats();
+}
+
+#endif // OBJECT_DATA_H
@@ -0,0 +1,261 @@
+#include "occlusion.h"
+#include "cpu_features.h"
+#include "job_system.h"
+#include <algorithm>
+#include <array>
+#include <cmath>
+
+#if defined(CPU_FEATURES_X86)
+#include <immintrin.h>
+#endif
+
+namespace {
+	using occlusion::triangle_t;
+	using raster_fn = void(*)(const std::vector<triangle_t>&, int, int, float*);
+
+	constexpr int BLOCKS_X = occlusion_buffer::WIDTH / occlusion_buffer::BLOCK;
+	constexpr int ROWS_PER_BAND = occlusion_buffer::HEIGHT / occlusion_buffer::BANDS;
+
+	// Below this the bands are rasterized on the calling thread
+	constexpr size_t PARALLEL_TRIANGLES = 512;
+
+	// Spans start on a multiple of 8 in both kernels, so they test the same pixels
+	void raster_scalar(const std::vector<triangle_t>& triangles, const int rowBegin, const int rowEnd, float* depth) {
+		for (const auto& tri : triangles) {
+			const auto y0 = std::max(tri.minY, rowBegin), y1 = std::min(tri.maxY, rowEnd - 1);
+			for (auto y = y0; y <= y1; y++) {
+				const auto py = static_cast<float>(y) + 0.5f;
+				const auto row0 = tri.b[0] * py + tri.c[0];
+				const auto row1 = tri.b[1] * py + tri.c[1];
+				const auto row2 = tri.b[2] * py + tri.c[2];
+				const auto rowZ = tri.zb * py + tri.zc;
+				auto* row = depth + y * occlusion_buffer::WIDTH;
+
+				for (auto x = tri.minX; x <= (tri.maxX | 7); x++) {
+					const auto px = static_cast<float>(x) + 0.5f;
+					const auto inside = tri.a[0] * px + row0 > 0.f && tri.a[1] * px + row1 > 0.f && tri.a[2] * px + row2 > 0.f;
+					const auto z = tri.za * px + rowZ;
+					if (inside && z < row[x]) {
+						row[x] = z;
+					}
+				}
+			}
+		}
+	}
+
+#if defined(CPU_FEATURES_X86)
+	TARGET_AVX2 void raster_avx2(const std::vector<triangle_t>& triangles, const int rowBegin, const int rowEnd, float* depth) {
+		const auto offsets = _mm256_setr_ps(0.5f, 1.5f, 2.5f, 3.5f, 4.5f, 5.5f, 6.5f, 7.5f);
+		const auto zero = _mm256_setzero_ps();
+
+		for (const auto& tri : triangles) {
+			const auto a0 = _mm256_set1_ps(tri.a[0]), a1 = _mm256_set1_ps(tri.a[1]), a2 = _mm256_set1_ps(tri.a[2]);
+			const auto za = _mm256_set1_ps(tri.za);
+
+			const auto y0 = std::max(tri.minY, rowBegin), y1 = std::min(tri.maxY, rowEnd - 1);
+			for (auto y = y0; y <= y1; y++) {
+				const auto py = static_cast<float>(y) + 0.5f;
+				const auto row0 = _mm256_set1_ps(tri.b[0] * py + tri.c[0]);
+				const auto row1 = _mm256_set1_ps(tri.b[1] * py + tri.c[1]);
+				const auto row2 = _mm256_set1_ps(tri.b[2] * py + tri.c[2]);
+				const auto rowZ = _mm256_set1_ps(tri.zb * py + tri.zc);
+				auto* row = depth + y * occlusion_buffer::WIDTH;
+
+				for (auto x = tri.minX; x <= tri.maxX; x += 8) {
+					const auto px = _mm256_add_ps(_mm256_set1_ps(static_cast<float>(x)), offsets);
+					auto inside = _mm256_cmp_ps(_mm256_add_ps(_mm256_mul_ps(a0, px), row0), zero, _CMP_GT_OQ);
+					inside = _mm256_and_ps(inside, _mm256_cmp_ps(_mm256_add_ps(_mm256_mul_ps(a1, px), row1), zero, _CMP_GT_OQ));
+					inside = _mm256_and_ps(inside, _mm256_cmp_ps(_mm256_add_ps(_mm256_mul_ps(a2, px), row2), zero, _CMP_GT_OQ));
+					if (_mm256_testz_ps(inside, inside)) {
+						continue;
+					}
+
+					const auto z = _mm256_add_ps(_mm256_mul_ps(za, px), rowZ);
+					const auto current = _mm256_loadu_ps(row + x);
+					const auto closer = _mm256_and_ps(inside, _mm256_cmp_ps(z, current, _CMP_LT_OQ));
+					_mm256_storeu_ps(row + x, _mm256_blendv_ps(current, z, closer));
+				}
+			}
+		}
+	}
+#endif
+}
+
+occlusion_buffer::occlusion_buffer() : m_vDepth(WIDTH * HEIGHT, 1.f), m_vHiZ(BLOCKS_X * (HEIGHT / BLOCK), 1.f) {}
+
+void occlusion_buffer::begin(const glm::mat4& viewProjection) {
+	m_mViewProjection = viewProjection;
+	m_vTriangles.clear();
+	std::fill(m_vDepth.begin(), m_vDepth.end(), 1.f);
+	std::fill(m_vHiZ.begin(), m_vHiZ.end(), 1.f);
+	m_sStats = {};
+}
+
+void occlusion_buffer::add_occluder(const occluder_t& occluder, const glm::mat4& transform) {
+	const auto matrix = m_mViewProjection * transform;
+	m_vClip.clear();
+	for (const auto& position : occluder.positions) {
+		m_vClip.push_back(matrix * glm::vec4(position, 1.f));
+	}
+
+	for (size_t i = 0; i + 2 < occluder.indices.size(); i += 3) {
+		const glm::vec4* clip[3] = { &m_vClip[occluder.indices[i]], &m_vClip[occluder.indices[i + 1]], &m_vClip[occluder.indices[i + 2]] };
+
+		// Near plane crossings would need clipping, dropping them is always safe
+		auto crossesNear = false;
+		auto outside = 0x3F;
+		for (const auto* c : clip) {
+			crossesNear |= c->w <= 0.f || c->z < -c->w;
+			outside &= (c->x < -c->w) | (c->x > c->w) << 1 | (c->y < -c->w) << 2 | (c->y > c->w) << 3 | (c->z > c->w) << 4;
+		}
+		if (crossesNear || outside) {
+			continue;
+		}
+
+		float x[3], y[3], z[3];
+		for (auto v = 0; v < 3; v++) {
+			x[v] = (clip[v]->x / clip[v]->w * 0.5f + 0.5f) * WIDTH;
+			y[v] = (clip[v]->y / clip[v]->w * 0.5f + 0.5f) * HEIGHT;
+			z[v] = clip[v]->z / clip[v]->w * 0.5f + 0.5f;
+		}
+
+		// Counter clockwise is front facing, closed occluders only need those
+		const auto area = (x[1] - x[0]) * (y[2] - y[0]) - (x[2] - x[0]) * (y[1] - y[0]);
+		if (!(area > 0.f)) {
+			continue;
+		}
+
+		triangle_t tri;
+		tri.minX = std::max(0, static_cast<int>(std::floor(std::min({ x[0], x[1], x[2] })))) & ~7;
+		tri.maxX = std::min(WIDTH - 1, static_cast<int>(std::ceil(std::max({ x[0], x[1], x[2] }))));
+		tri.minY = std::max(0, static_cast<int>(std::floor(std::min({ y[0], y[1], y[2] }))));
+		tri.maxY = std::min(HEIGHT - 1, static_cast<int>(std::ceil(std::max({ y[0], y[1], y[2] }))));
+		if (tri.minX > tri.maxX || tri.minY > tri.maxY) {
+			continue;
+		}
+
+		// Edge e is the one facing vertex e
+		for (auto e = 0; e < 3; e++) {
+			const auto from = (e + 1) % 3, to = (e + 2) % 3;
+			tri.a[e] = y[from] - y[to];
+			tri.b[e] = x[to] - x[from];
+			tri.c[e] = x[from] * y[to] - y[from] * x[to];
+		}
+
+		// Depth interpolated with the normalized edge functions as barycentrics
+		tri.za = (tri.a[0] * z[0] + tri.a[1] * z[1] + tri.a[2] * z[2]) / area;
+		tri.zb = (tri.b[0] * z[0] + tri.b[1] * z[1] + tri.b[2] * z[2]) / area;
+		tri.zc = (tri.c[0] * z[0] + tri.c[1] * z[1] + tri.c[2] * z[2]) / area;
+		m_vTriangles.push_back(tri);
+	}
+}
+
+void occlusion_buffer::rasterize_band(const int band) {
+	raster_fn raster = raster_scalar;
+#if defined(CPU_FEATURES_X86)
+	if (m_eKernel != culling::kernel::scalar && cpu_features::has_avx2()) {
+		raster = raster_avx2;
+	}
+#endif
+
+	const auto rowBegin = band * ROWS_PER_BAND;
+	raster(m_vTriangles, rowBegin, rowBegin + ROWS_PER_BAND, m_vDepth.data());
+
+	// Farthest depth of every block in the band
+	for (auto by = rowBegin / BLOCK; by < (rowBegin + ROWS_PER_BAND) / BLOCK; by++) {
+		for (auto bx = 0; bx < BLOCKS_X; bx++) {
+			auto farthest = 0.f;
+			for (auto y = by * BLOCK; y < (by + 1) * BLOCK; y++) {
+				const auto* row = &m_vDepth[y * WIDTH + bx * BLOCK];
+				farthest = std::max(farthest, *std::max_element(row, row + BLOCK));
+			}
+			m_vHiZ[by * BLOCKS_X + bx] = farthest;
+		}
+	}
+}
+
+void occlusion_buffer::rasterize() {
+	m_sStats.triangles = static_cast<unsigned int>(m_vTriangles.size());
+
+	// Bands share no pixels, each is its own job
+	if (m_vTriangles.size() < PARALLEL_TRIANGLES) {
+		for (auto band = 0; band < BANDS; band++) {
+			rasterize_band(band);
+		}
+		return;
+	}
+
+	job_system::parallel_for(BANDS, 1, [this](const uint32_t first, const uint32_t end) {
+		for (auto band = first; band < end; band++) {
+			rasterize_band(static_cast<int>(band));
+		}
+	});
+}
+
+bool occlusion_buffer::is_occluded(const aabb_t& box) const {
+	m_sStats.tested++;
+
+	auto minX = INFINITY, minY = INFINITY, maxX = -INFINITY, maxY = -INFINITY, minZ = INFINITY;
+	for (auto corner = 0; corner < 8; corner++) {
+		const auto sign = glm::vec3(corner & 1 ? 1.f : -1.f, corner & 2 ? 1.f : -1.f, corner & 4 ? 1.f : -1.f);
+		const auto clip = m_mViewProjection * glm::vec4(box.center + sign * box.extent, 1.f);
+		if (clip.w <= 0.f || clip.z < -clip.w) {
+			return false;
+		}
+
+		const auto x = (clip.x / clip.w * 0.5f + 0.5f) * WIDTH;
+		const auto y = (clip.y / clip.w * 0.5f + 0.5f) * HEIGHT;
+		minX = std::min(minX, x);
+		maxX = std::max(maxX, x);
+		minY = std::min(minY, y);
+		maxY = std::max(maxY, y);
+		minZ = std::min(minZ, clip.z / clip.w * 0.5f + 0.5f);
+	}
+
+	if (maxX < 0.f || maxY < 0.f || minX >= WIDTH || minY >= HEIGHT) {
+		return false;
+	}
+
+	// Every block the rectangle touches has to be closer than the nearest corner
+	const auto bx0 = std::max(0, static_cast<int>(minX) / BLOCK), bx1 = std::min(BLOCKS_X - 1, static_cast<int>(maxX) / BLOCK);
+	const auto by0 = std::max(0, static_cast<int>(minY) / BLOCK), by1 = std::min(HEIGHT / BLOCK - 1, static_cast<int>(maxY) / BLOCK);
+	for (auto by = by0; by <= by1; by++) {
+		for (auto bx = bx0; bx <= bx1; bx++) {
+			if (m_vHiZ[by * BLOCKS_X + bx] >= minZ) {
+				return false;
+			}
+		}
+	}
+
+	m_sStats.occluded++;
+	return true;
+}
+
+void occlusion_buffer::set_kernel(const culling::kernel kernel) {
+	m_eKernel = kernel;
+}
+
+namespace occlusion {
+	occluder_t make_box(const aabb_t& box) {
+		occluder_t occluder;
+		for (auto corner = 0; corner < 8; corner++) {
+			const auto sign = glm::vec3(corner & 1 ? 1.f : -1.f, corner & 2 ? 1.f : -1.f, corner & 4 ? 1.f : -1.f);
+			occluder.positions.push_back(box.center + sign * box.extent);
+		}
+
+		// Two triangles per face, turned to face outwards
+		for (auto axis = 0; axis < 3; axis++) {
+			for (auto side = 0; side < 2; side++) {
+				const auto u = 1 << ((axis + 1) % 3), v = 1 << ((axis + 2) % 3), w = side << axis;
+				const uint32_t quad[4] = { static_cast<uint32_t>(w), static_cast<uint32_t>(w | u), static_cast<uint32_t>(w | u | v), static_cast<uint32_t>(w | v) };
+				for (const auto& tri : { std::array{ quad[0], quad[1], quad[2] }, std::array{ quad[0], quad[2], quad[3] } }) {
+					const auto& p0 = occluder.positions[tri[0]];
+					const auto normal = glm::cross(occluder.positions[tri[1]] - p0, occluder.positions[tri[2]] - p0);
+					const auto outwards = glm::dot(normal, p0 - box.center) > 0.f;
+					occluder.indices.insert(occluder.indices.end(), { tri[0], outwards ? tri[1] : tri[2], outwards ? tri[2] : tri[1] });
+				}
+			}
+		}
+		return occluder;
+	}
+}
@@ -0,0 +1,102 @@
+#ifndef OCCLUSION_H
+#define OCCLUSION_H
+#include <cstdint>
+#include <vector>
+#include "glm/glm.hpp"
+#include "culling.h"
+
+// Simplified closed mesh in model space, it has to stay inside the real one
+struct occluder_t {
+	std::vector<glm::vec3> positions;
+	std::vector<uint32_t> indices;
+};
+
+namespace occlusion {
+	// A screen space triangle ready to rasterize
+	// Edge functions e = a * x + b * y + c are positive inside, depth is z = za * x + zb * y + zc
+	struct triangle_t {
+		float a[3], b[3], c[3];
+		float za, zb, zc;
+		int minX, maxX, minY, maxY;
+	};
+}
+
+// Low resolution depth buffer rasterized on the CPU from occluders, with a max depth level
+// per 8x8 block to reject boxes that are fully behind them. Nothing here touches GL,
+// so the same occluders and boxes always give the same answer
+//
+// Depth is NDC z in [0, 1], cleared to the far plane. Triangles are stored with their edge
+// functions set up, then rasterized in horizontal bands that can run on separate threads.
+// The AVX2 kernel covers 8 pixels per step and evaluates everything in the scalar kernel's
+// order, so both write identical buffers
+class occlusion_buffer {
+public:
+	static constexpr int WIDTH = 256;
+	static constexpr int HEIGHT = 128;
+	static constexpr int BLOCK = 8;
+	static constexpr int BANDS = 4;
+
+	struct stats_t {
+		unsigned int triangles = 0;
+		unsigned int tested = 0;
+		unsigned int occluded = 0;
+	};
+
+private:
+	glm::mat4 m_mViewProjection{ 1.f };
+	std::vector<occlusion::triangle_t> m_vTriangles;
+	std::vector<glm::vec4> m_vClip;
+	std::vector<float> m_vDepth;
+	std::vector<float> m_vHiZ;
+	culling::kernel m_eKernel = culling::kernel::automatic;
+	mutable stats_t m_sStats;
+
+	void rasterize_band(int band);
+
+public:
+	occlusion_buffer();
+
+	// Clear everything and start a frame seen through viewProjection
+	void begin(const glm::mat4& viewProjection);
+
+	// Set up the front facing triangles of an occluder, those crossing the near plane are
+	// dropped, which only ever makes the buffer hide less
+	void add_occluder(const occluder_t& occluder, const glm::mat4& transform);
+
+	// Rasterize every occluder added since begin and build the max depth level
+	void rasterize();
+
+	// True only when the box is behind occluders everywhere it covers on screen
+	// Boxes crossing the near plane or off screen are never occluded
+	[[nodiscard]]
+	bool is_occluded(const aabb_t& box) const;
+
+	// Mostly for benchmarks, an unsupported kernel falls back to scalar
+	void set_kernel(culling::kernel kernel);
+
+	// WIDTH * HEIGHT depths, row 0 at the bottom
+	[[nodiscard]]
+	const std::vector<float>& get_depth() const {
+		return m_vDepth;
+	}
+
+	// Max depth of each BLOCK x BLOCK tile, WIDTH / BLOCK per row
+	[[nodiscard]]
+	const std::vector<float>& get_hi_z() const {
+		return m_vHiZ;
+	}
+
+	// Since the last begin
+	[[nodiscard]]
+	stats_t get_stats() const {
+		return m_sStats;
+	}
+};
+
+namespace occlusion {
+	// The 12 triangles of a box, the occluder for anything that fills its bounds
+	[[nodiscard]]
+	occluder_t make_box(const aabb_t& box);
+}
+
+#endif // OCCLUSION_H
@@ -0,0 +1,175 @@
+#include "program_cache.h"
+#include "gl_extensions.h"
+#include "hash.h"
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <vector>
+
+namespace {
+	struct cache_header_t {
+		uint32_t magic;
+		uint32_t format;
+		uint64_t key;
+		uint32_t length;
+		uint32_t reserved;
+	};
+
+	constexpr uint32_t cache_magic = 0x4250474C; // "LGPB"
+
+	// Far above any real program binary, a bigger length means the file is damaged
+	constexpr uint32_t max_binary_length = 64u << 20;
+
+	std::string directory = "shader_cache/";
+	program_cache::stats_t stats{};
+
+	// Everything about the driver that can make an old binary invalid
+	uint64_t driver_hash() {
+		static const auto hash = [] {
+			auto h = fnv1a_basis;
+			for (const auto name : { GL_VENDOR, GL_RENDERER, GL_VERSION }) {
+				const auto* str = reinterpret_cast<const char*>(glGetString(name));
+				h = fnv1a(str ? str : "", h);
+			}
+
+			int count = 0;
+			glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &count);
+			std::vector<int> formats(count);
+			if (count > 0) {
+				glGetIntegerv(GL_PROGRAM_BINARY_FORMATS, formats.data());
+			}
+			return fnv1a({ reinterpret_cast<const char*>(formats.data()), formats.size() * sizeof(int) }, h);
+		}();
+		return hash;
+	}
+
+	std::string path_for(const uint64_t key) {
+		char name[32];
+		snprintf(name, sizeof(name), "%016llx.bin", static_cast<unsigned long long>(key));
+		return directory + name;
+	}
+}
+
+namespace program_cache {
+	void set_directory(std::string path) {
+		if (!path.empty() && !path.ends_with('/') && !path.ends_with('\\')) {
+			path += "/";
+		}
+
+		directory = std::move(path);
+	}
+
+	bool enabled() {
+		return !directory.empty() && gl_extensions::supports_program_binary();
+	}
+
+	uint64_t make_key(const std::string& vertex, const std::string& fragment, const std::string& defines) {
+		// Separators so moving text between the parts changes the key
+		auto h = fnv1a(vertex);
+		h = fnv1a("\x1f", h);
+		h = fnv1a(fragment, h);
+		h = fnv1a("\x1f", h);
+		h = fnv1a(defines, h);
+		return h ^ driver_hash();
+	}
+
+	unsigned load(const uint64_t key) {
+		if (!enabled()) {
+			return 0;
+		}
+
+		const auto path = path_for(key);
+		auto ifs = std::ifstream(path, std::ios::binary);
+		cache_header_t header{};
+		if (!ifs || !ifs.read(reinterpret_cast<char*>(&header), sizeof(header)) || header.magic != cache_magic || header.key != key) {
+			stats.misses++;
+			return 0;
+		}
+
+		// A truncated or damaged file is dropped before its length is trusted for anything
+		std::error_code ec;
+		const auto fileSize = std::filesystem::file_size(path, ec);
+		if (ec || header.length == 0 || header.length > max_binary_length || fileSize != sizeof(header) + header.length) {
+			ifs.close();
+			std::filesystem::remove(path, ec);
+			stats.misses++;
+			return 0;
+		}
+
+		std::vector<char> binary(header.length);
+		if (!ifs.read(binary.data(), static_cast<std::streamsize>(binary.size()))) {
+			stats.misses++;
+			return 0;
+		}
+
+		const auto program = glCreateProgram();
+		gl_extensions::program_binary(program, header.format, binary.data(), static_cast<GLsizei>(binary.size()));
+
+		// The driver is free to reject binaries at any time, eg. after an update it did not tell us about
+		int status = 0;
+		glGetProgramiv(program, GL_LINK_STATUS, &status);
+		if (status == 0) {
+			glDeleteProgram(program);
+			ifs.close();
+			std::filesystem::remove(path, ec);
+
+			stats.rejected++;
+			return 0;
+		}
+
+		stats.hits++;
+		return program;
+	}
+
+	void save(const uint64_t key, const unsigned program) {
+		if (!enabled()) {
+			return;
+		}
+
+		int length = 0;
+		glGetProgramiv(program, GL_PROGRAM_BINARY_LENGTH, &length);
+		if (length <= 0) {
+			return;
+		}
+
+		std::vector<char> binary(length);
+		GLenum format = 0;
+		gl_extensions::get_program_binary(program, length, &length, &format, binary.data());
+
+		if (static_cast<uint32_t>(length) > max_binary_length) {
+			return;
+		}
+
+		std::error_code ec;
+		std::filesystem::create_directories(directory, ec);
+
+		// Written next to the entry and renamed over it, so a crash never leaves half a file behind
+		const auto path = path_for(key);
+		const auto temporary = path + ".tmp";
+		{
+			auto ofs = std::ofstream(temporary, std::ios::binary | std::ios::trunc);
+			const cache_header_t header{ cache_magic, format, key, static_cast<uint32_t>(length), 0 };
+			ofs.write(reinterpret_cast<const char*>(&header), sizeof(header));
+			ofs.write(binary.data(), length);
+			ofs.close();
+			if (!ofs) {
+				std::cerr << "Failed to write program binary to " << temporary << std::endl;
+				std::filesystem::remove(temporary, ec);
+				return;
+			}
+		}
+
+		std::filesystem::rename(temporary, path, ec);
+		if (ec) {
+			std::cerr << "Failed to replace program binary " << path << ": " << ec.message() << std::endl;
+			std::filesystem::remove(temporary, ec);
+			return;
+		}
+		stats.saved++;
+	}
+
+	stats_t get_stats() {
+		return stats;
+	}
+}
@@ -0,0 +1,40 @@
+#ifndef PROGRAM_CACHE_H
+#define PROGRAM_CACHE_H
+#include <cstdint>
+#include <string>
+
+// On-disk cache of linked program binaries (glGetProgramBinary)
+// Keys cover the sources, defines, driver vendor/renderer/version and the
+// binary formats the driver offers, so a driver update misses cleanly
+namespace program_cache {
+	struct stats_t {
+		unsigned hits = 0;
+		unsigned misses = 0;
+		unsigned rejected = 0;
+		unsigned saved = 0;
+	};
+
+	// Where binaries are stored, an empty path disables the cache
+	void set_directory(std::string path);
+
+	// True if there is a directory and the driver supports program binaries
+	[[nodiscard]]
+	bool enabled();
+
+	[[nodiscard]]
+	uint64_t make_key(const std::string& vertex, const std::string& fragment, const std::string& defines);
+
+	// Create a program from the cached binary for key
+	// Returns 0 if there is none or the driver rejected it, the caller then compiles from source
+	[[nodiscard]]
+	unsigned load(uint64_t key);
+
+	// Store the binary of a linked program, it must have been linked with
+	// GL_PROGRAM_BINARY_RETRIEVABLE_HINT set
+	void save(uint64_t key, unsigned program);
+
+	[[nodiscard]]
+	stats_t get_stats();
+}
+
+#endif // PROGRAM_CACHE_H
@@ -0,0 +1,344 @@
+#include "render_queue.h"
+#include "command_buffer.h"
+#include "model.h"
+#include "mesh.h"
+#include "material.h"
+#include "shader.h"
+#include "gl_state.h"
+#include "gl_extensions.h"
+#include "geometry_pool.h"
+#include "object_data.h"
+#include "warmup.h"
+#include <algorithm>
+#include "glm/gtc/matrix_inverse.hpp"
+
+namespace {
+	constexpr uint64_t ID_MASK = (1u << 12) - 1;
+	constexpr uint64_t DEPTH_MASK = (1u << 26) - 1;
+
+	void begin_pass(const render_pass pass) {
+		switch (pass) {
+		case render_pass::opaque:
+			gl_state::set_pipeline_state({});
+			gl_state::set_depth_func(GL_LESS);
+			break;
+		case render_pass::skybox:
+			gl_state::set_pipeline_state({ .depthMask = false });
+			gl_state::set_depth_func(GL_LEQUAL);
+			break;
+		}
+	}
+}
+
+uint64_t render_queue::make_key(const render_pass pass, const unsigned int shader, const unsigned int material, const unsigned int mesh, const float depth, const float farPlane) {
+	const auto normalized = std::clamp(depth / farPlane, 0.f, 1.f);
+	const auto quantized = static_cast<uint64_t>(normalized * DEPTH_MASK);
+
+	return (static_cast<uint64_t>(pass) << 62)
+		| ((shader & ID_MASK) << 50)
+		| ((material & ID_MASK) << 38)
+		| ((mesh & ID_MASK) << 26)
+		| quantized;
+}
+
+void render_queue::set_far_plane(const float farPlane) {
+	m_fFarPlane = farPlane;
+}
+
+float render_queue::get_far_plane() const {
+	return m_fFarPlane;
+}
+
+void render_queue::submit(const render_pass pass, const model& source, const glm::mat4& transform, const float depth) {
+	// Only instanced shaders read the normal matrix from here
+	const auto normal = source.get_shader()->uses_instancing() ? glm::inverseTranspose(glm::mat3(transform)) : glm::mat3(1.f);
+	submit(pass, source, transform, normal, depth);
+}
+
+void render_queue::submit(const render_pass pass, const model& source, const glm::mat4& transform, const glm::mat3& normal, const float depth) {
+	const auto& material = source.get_material();
+	const auto& program = source.get_shader();
+	push(make_key(pass, program->get_id(), material ? material->get_id() : 0, source.get_mesh()->get_id(), depth, m_fFarPlane),
+		source, transform, normal);
+}
+
+void render_queue::submit(const command_buffer& buffer) {
+	buffer.replay([this](const uint64_t key, const model& source, const glm::mat4& transform, const glm::mat3& normal) {
+		push(key, source, transform, normal);
+	});
+}
+
+void render_queue::push(const uint64_t key, const model& source, const glm::mat4& transform, const glm::mat3& normal) {
+	// Taking the slot at submission keeps it stable from frame to frame, sorting would not
+	auto object = 0u;
+	if (source.get_shader()->uses_instancing()) {
+		object = object_data::push({ transform, glm::mat3x4(normal), source.get_color() });
+	}
+
+	m_vOrder.push_back({ key, static_cast<uint32_t>(m_vItems.size()) });
+	m_vItems.push_back({ key, &source, transform, object });
+}
+
+void render_queue::cull() {
+	m_sBounds.clear();
+	for (const auto& entry : m_vOrder) {
+		const auto& item = m_vItems[entry.index];
+		if ((item.key >> 62) == static_cast<uint64_t>(render_pass::opaque)) {
+			m_sBounds.push(culling::transform(item.source->get_mesh()->get_bounds(), item.transform));
+		}
+	}
+
+	culling::cull(m_sFrustum, m_sBounds, m_vVisible);
+	m_sStats.culled = static_cast<unsigned int>(m_sBounds.size() - m_vVisible.size());
+
+	// Visible indices count opaque draws only and come back in order, walk both together
+	size_t kept = 0, opaque = 0, next = 0;
+	for (const auto& entry : m_vOrder) {
+		if ((entry.key >> 62) == static_cast<uint64_t>(render_pass::opaque)) {
+			const auto visible = next < m_vVisible.size() && m_vVisible[next] == opaque;
+			opaque++;
+			if (!visible) {
+				continue;
+			}
+			next++;
+		}
+		m_vOrder[kept++] = entry;
+	}
+	m_vOrder.resize(kept);
+}
+
+void render_queue::occlude() {
+	m_sOcclusion.begin(m_mViewProjection);
+	auto occluders = false;
+	for (const auto& entry : m_vOrder) {
+		const auto& item = m_vItems[entry.index];
+		if ((item.key >> 62) == static_cast<uint64_t>(render_pass::opaque) && item.source->get_occluder()) {
+			m_sOcclusion.add_occluder(*item.source->get_occluder(), item.transform);
+			occluders = true;
+		}
+	}
+	if (!occluders) {
+		return;
+	}
+	m_sOcclusion.rasterize();
+
+	// Occluders sit inside their model's bounds, so they never hide themselves
+	size_t kept = 0;
+	for (const auto& entry : m_vOrder) {
+		const auto& item = m_vItems[entry.index];
+		if ((item.key >> 62) == static_cast<uint64_t>(render_pass::opaque)
+			&& m_sOcclusion.is_occluded(culling::transform(item.source->get_mesh()->get_bounds(), item.transform))) {
+			continue;
+		}
+		m_vOrder[kept++] = entry;
+	}
+	m_vOrder.resize(kept);
+	m_sStats.occluded = m_sOcclusion.get_stats().occluded;
+}
+
+// LSD radix sort on the key, a byte per pass
+// Bytes that are the same in every key are skipped, which is most of them for a small scene
+void render_queue::sort() {
+	m_vScratch.resize(m_vOrder.size());
+
+	for (auto shift = 0; shift < 64; shift += 8) {
+		uint32_t counts[256]{};
+		for (const auto& entry : m_vOrder) {
+			counts[(entry.key >> shift) & 0xFF]++;
+		}
+
+		if (counts[(m_vOrder.front().key >> shift) & 0xFF] == m_vOrder.size()) {
+			continue;
+		}
+
+		uint32_t offset = 0;
+		for (auto& count : counts) {
+			const auto c = count;
+			count = offset;
+			offset += c;
+		}
+
+		for (const auto& entry : m_vOrder) {
+			m_vScratch[counts[(entry.key >> shift) & 0xFF]++] = entry;
+		}
+		m_vOrder.swap(m_vScratch);
+	}
+}
+
+void render_queue::build_buckets() {
+	m_vObjects.clear();
+	m_vCommands.clear();
+	m_vBuckets.clear();
+
+	for (uint32_t i = 0; i < m_vOrder.size(); i++) {
+		const auto& item = m_vItems[m_vOrder[i].index];
+		const auto& source = *item.source;
+
+		auto* bucket = m_vBuckets.empty() ? nullptr : &m_vBuckets.back();
+		if (bucket) {
+			const auto& previous = *m_vItems[m_vOrder[i - 1].index].source;
+			const auto samePass = (m_vItems[m_vOrder[i - 1].index].key >> 62) == (item.key >> 62);
+			if (!samePass || previous.get_shader() != source.get_shader() || previous.get_material() != source.get_material()) {
+				bucket = nullptr;
+			}
+		}
+		if (!bucket) {
+			m_vBuckets.push_back({ i, i, static_cast<uint32_t>(m_vCommands.size()), 0 });
+			bucket = &m_vBuckets.back();
+		}
+		bucket->end = i + 1;
+
+		if (!source.get_shader()->uses_instancing()) {
+			continue;
+		}
+
+		// Object ids are found through the base instance, or the attribute offset without it
+		const auto instance = static_cast<uint32_t>(m_vObjects.size());
+		m_vObjects.push_back(item.object);
+
+		const auto& range = source.get_mesh()->get_range();
+		auto* command = bucket->commandCount > 0 ? &m_vCommands.back() : nullptr;
+		const auto sameMesh = command && command->firstIndex == range.firstIndex && command->baseVertex == range.baseVertex;
+		if (sameMesh) {
+			command->instanceCount++;
+		}
+		else {
+			m_vCommands.push_back({ range.count, 1, range.firstIndex, range.baseVertex, instance });
+			bucket->commandCount++;
+		}
+	}
+
+	if (!m_vObjects.empty()) {
+		geometry_pool::upload_instances(m_vObjects);
+		object_data::upload();
+	}
+}
+
+void render_queue::draw_bucket(const bucket_t& bucket) {
+	const auto vao = geometry_pool::vertex_array();
+
+	if (bucket.commandCount == 0) {
+		for (auto i = bucket.first; i < bucket.end; i++) {
+			const auto& item = m_vItems[m_vOrder[i].index];
+			item.source->draw_transform(item.transform);
+			m_sStats.draws++;
+			m_sStats.commands++;
+			m_sStats.instances++;
+		}
+		return;
+	}
+
+	gl_state::bind_vertex_array(vao);
+
+	if (m_bMultiDrawIndirect && gl_extensions::supports_multi_draw_indirect()) {
+		// Attributes stay at instance 0, each command's base instance does the offsetting
+		geometry_pool::point_instance_attributes(0);
+		gl_state::bind_buffer(GL_DRAW_INDIRECT_BUFFER, m_sCommandRange.buffer);
+
+		const auto* offset = reinterpret_cast<const void*>(m_sCommandRange.offset + bucket.firstCommand * sizeof(draw_command_t));
+		warmup::draw(vao, [&] {
+			gl_extensions::multi_draw_elements_indirect(GL_TRIANGLES, GL_UNSIGNED_INT, offset, bucket.commandCount, 0);
+			gl_state::count_calls();
+		});
+		m_sStats.draws++;
+	}
+	else {
+		for (auto c = bucket.firstCommand; c < bucket.firstCommand + bucket.commandCount; c++) {
+			const auto& command = m_vCommands[c];
+			warmup::draw(vao, [&] {
+				geometry_pool::point_instance_attributes(command.baseInstance);
+				glDrawElementsInstancedBaseVertex(GL_TRIANGLES, command.count, GL_UNSIGNED_INT,
+					reinterpret_cast<const void*>(command.firstIndex * sizeof(unsigned)), command.instanceCount, command.baseVertex);
+				gl_state::count_calls();
+			});
+			m_sStats.draws++;
+		}
+	}
+
+	m_sStats.commands += bucket.commandCount;
+	m_sStats.instances += bucket.end - bucket.first;
+}
+
+void render_queue::flush() {
+	m_sStats = {};
+	if (m_vItems.empty()) {
+		return;
+	}
+
+	if (m_bCulling) {
+		cull();
+	}
+	if (m_bOcclusion) {
+		occlude();
+	}
+	if (m_vOrder.empty()) {
+		m_vItems.clear();
+		return;
+	}
+
+	sort();
+	build_buckets();
+
+	// Every command of the flush goes up in one write
+	if (m_bMultiDrawIndirect && gl_extensions::supports_multi_draw_indirect() && !m_vCommands.empty()) {
+		m_sCommandRange = frame_data::write(m_vCommands.data(), m_vCommands.size() * sizeof(draw_command_t), alignof(draw_command_t));
+	}
+
+	shader* lastShader = nullptr;
+	auto lastPass = -1;
+	auto lastVao = 0u;
+
+	for (const auto& bucket : m_vBuckets) {
+		const auto& first = m_vItems[m_vOrder[bucket.first].index];
+		const auto& source = *first.source;
+
+		const auto pass = static_cast<int>(first.key >> 62);
+		if (pass != lastPass) {
+			begin_pass(static_cast<render_pass>(pass));
+			lastPass = pass;
+		}
+
+		// Buckets already differ in program or material, only bind what changed
+		auto* program = source.get_shader().get();
+		if (program != lastShader) {
+			program->use();
+			lastShader = program;
+			m_sStats.programSwitches++;
+		}
+
+		source.bind_material();
+		m_sStats.materialSwitches++;
+
+		draw_bucket(bucket);
+
+		const auto vao = gl_state::current_vertex_array();
+		if (vao != lastVao) {
+			lastVao = vao;
+			m_sStats.vaoSwitches++;
+		}
+	}
+
+	// Leave the default state for anything drawn outside the queue
+	begin_pass(render_pass::opaque);
+
+	m_vItems.clear();
+	m_vOrder.clear();
+}
+
+void render_queue::set_multi_draw_indirect(const bool enabled) {
+	m_bMultiDrawIndirect = enabled;
+}
+
+void render_queue::set_frustum(const frustum_t& frustum) {
+	m_sFrustum = frustum;
+	m_bCulling = true;
+}
+
+void render_queue::set_occlusion(const glm::mat4& viewProjection) {
+	m_mViewProjection = viewProjection;
+	m_bOcclusion = true;
+}
+
+render_queue::stats_t render_queue::get_stats() const {
+	return m_sStats;
+}
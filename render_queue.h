@@ -0,0 +1,147 @@
+#ifndef RENDER_QUEUE_H
+#define RENDER_QUEUE_H
+#include <cstdint>
+#include <vector>
+#include "glm/glm.hpp"
+#include "geometry_pool.h"
+#include "frame_data.h"
+#include "culling.h"
+#include "occlusion.h"
+
+class model;
+class command_buffer;
+
+// Passes are drawn in this order
+enum class render_pass : unsigned char {
+	opaque,
+	// Drawn at the far plane with depth testing, so it only fills what nothing else covered
+	skybox
+};
+
+// Draws collected over a frame, culled against the camera frustum and the occluders among them,
+// sorted by a 64 bit key and issued in order
+// Key layout from the most significant bit:
+//   pass 2 | shader 12 | material 12 | mesh 12 | depth 26
+// so draws group by program, then material, then mesh, and go front to back inside a group
+// Runs of draws sharing all three become one instanced draw command when the shader supports it,
+// with each instance's data fetched through its object id (see object_data).
+// Commands sharing program and material are issued with one glMultiDrawElementsIndirect
+// when the context has it, otherwise one glDrawElementsInstancedBaseVertex each
+class render_queue {
+public:
+	struct item_t {
+		uint64_t key;
+		const model* source;
+		glm::mat4 transform;
+		// Slot in object_data, only for shaders that use instancing
+		uint32_t object;
+	};
+
+	// Per flush, switches count changes between consecutive draws
+	struct stats_t {
+		// Driver draw calls, and the mesh draws they contain
+		unsigned int draws = 0;
+		unsigned int commands = 0;
+		unsigned int instances = 0;
+		unsigned int programSwitches = 0;
+		unsigned int materialSwitches = 0;
+		unsigned int vaoSwitches = 0;
+		// Opaque draws outside the frustum, and hidden behind occluders
+		unsigned int culled = 0;
+		unsigned int occluded = 0;
+	};
+
+private:
+	struct sort_entry_t {
+		uint64_t key;
+		uint32_t index;
+	};
+
+	// Layout of GL's DrawElementsIndirectCommand
+	struct draw_command_t {
+		uint32_t count;
+		uint32_t instanceCount;
+		uint32_t firstIndex;
+		int32_t baseVertex;
+		uint32_t baseInstance;
+	};
+
+	// Sorted draws that share pass, program and material
+	// Instanced ones are described by commands, the rest are drawn one item at a time
+	struct bucket_t {
+		uint32_t first;
+		uint32_t end;
+		uint32_t firstCommand;
+		uint32_t commandCount;
+	};
+
+	std::vector<item_t> m_vItems;
+	std::vector<sort_entry_t> m_vOrder;
+	std::vector<sort_entry_t> m_vScratch;
+	std::vector<uint32_t> m_vObjects;
+	std::vector<draw_command_t> m_vCommands;
+	std::vector<bucket_t> m_vBuckets;
+	frame_data::range_t m_sCommandRange;
+	bool m_bMultiDrawIndirect = true;
+	frustum_t m_sFrustum;
+	bool m_bCulling = false;
+	culling::bounds_t m_sBounds;
+	std::vector<uint32_t> m_vVisible;
+	occlusion_buffer m_sOcclusion;
+	glm::mat4 m_mViewProjection{ 1.f };
+	bool m_bOcclusion = false;
+	float m_fFarPlane = 100.f;
+	stats_t m_sStats;
+
+	// Drop opaque draws whose world space bounds miss the frustum, keeping submission order
+	void cull();
+
+	// Rasterize the occluders left after frustum culling, then drop opaque draws behind them
+	void occlude();
+
+	void sort();
+
+	// Split the sorted draws into buckets, filling object ids and draw commands
+	void build_buckets();
+
+	void draw_bucket(const bucket_t& bucket);
+
+	// Append a draw whose key is already made
+	void push(uint64_t key, const model& source, const glm::mat4& transform, const glm::mat3& normal);
+
+public:
+	[[nodiscard]]
+	static uint64_t make_key(render_pass pass, unsigned int shader, unsigned int material, unsigned int mesh, float depth, float farPlane);
+
+	// Depth is quantized over [0, far plane]
+	void set_far_plane(float farPlane);
+
+	[[nodiscard]]
+	float get_far_plane() const;
+
+	// Multi draw indirect is used whenever the context supports it, unless disabled here
+	void set_multi_draw_indirect(bool enabled);
+
+	// Opaque draws are culled against this frustum from the next flush on
+	void set_frustum(const frustum_t& frustum);
+
+	// Opaque draws hidden behind occluders seen through viewProjection are skipped from the next flush on
+	void set_occlusion(const glm::mat4& viewProjection);
+
+	void submit(render_pass pass, const model& source, const glm::mat4& transform, float depth);
+
+	// With the normal matrix already at hand, like the ones a scene graph caches
+	void submit(render_pass pass, const model& source, const glm::mat4& transform, const glm::mat3& normal, float depth);
+
+	// Every draw recorded in the buffer, in recording order
+	// Sorting is stable, so buffers submitted in a fixed order always draw the same way
+	void submit(const command_buffer& buffer);
+
+	// Sort, draw and empty the queue
+	void flush();
+
+	[[nodiscard]]
+	stats_t get_stats() const;
+};
+
+#endif // RENDER_QUEUE_H
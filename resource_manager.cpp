@@ -1,6 +1,7 @@
 #include "resource_manager.h"
-#include "stb/stb_image.h"
+#include "image_decoder.h"
 #include "glad/glad.h"
+#include "gl_state.h"
 #include <vector>
 #include <fstream>
 #include "mesh.h"
@@ -8,7 +9,12 @@
 #include <iostream>
 #include <unordered_map>
 #include <tuple>
+#include <algorithm>
 #include "tuplehash.h"
+#include "program_cache.h"
+#include "file_watcher.h"
+#include "shader_preprocessor.h"
+#include "job_system.h"
 
 using namespace std;
 
@@ -16,16 +22,33 @@ unordered_map<string, shared_ptr<shader>> mp_loadedShaders;
 unordered_map<string, shared_ptr<mesh>> mp_loadedMeshes;
 unordered_map<tuple<string, bool>, unsigned int> mp_loadedTextures;
 
-std::string load_file_to_str(const std::string& path) {
-	const auto ifs = std::ifstream(path);
-
-	if (ifs) {
-		auto buffer = std::stringstream{};
-		buffer << ifs.rdbuf();
-		return buffer.str();
+// Source files a shader is built from, relative to the shader directory,
+// the feature keywords those sources declare and every file they include
+struct shader_sources_t {
+	string pathV, pathF;
+	shader_features keywords = 0;
+	vector<string> files;
+};
+
+// By shader name, and by the key of each loaded variant
+unordered_map<string, shader_sources_t> mp_shaderPaths;
+unordered_map<string, shader_sources_t> mp_shaderSources;
+unique_ptr<file_watcher> p_shaderWatcher;
+
+// Expand both stages, filling in the files they depend on
+bool preprocess_shader(const string& directory, shader_sources_t& sources, string& vertex, string& fragment) {
+	const auto v = shader_preprocessor::process(directory, sources.pathV);
+	const auto f = shader_preprocessor::process(directory, sources.pathF);
+	if (!v.ok || !f.ok) {
+		std::cerr << (v.ok ? f.error : v.error) << std::endl;
+		return false;
 	}
 
-	return "";
+	sources.files = v.files;
+	sources.files.insert(sources.files.end(), f.files.begin(), f.files.end());
+	vertex = v.source;
+	fragment = f.source;
+	return true;
 }
 
 namespace resource_manager {
@@ -39,32 +62,39 @@ namespace resource_manager {
 			return result->second;
 		}
 		
-		int width, height, channels;
+		const auto bytes = image_decoders::read_file(texture_prefix + texture);
+		return load_texture_from_memory(texture, bytes, flip_vertically);
+	}
+
+	unsigned int load_texture_from_memory(const std::string name, std::span<const unsigned char> bytes, bool flip_vertically) {
+		const auto result = mp_loadedTextures.find({ name, flip_vertically });
+		if (result != mp_loadedTextures.end()) {
+			return result->second;
+		}
 
-		stbi_set_flip_vertically_on_load(flip_vertically);
-		auto* const dat = stbi_load((texture_prefix + texture).c_str(), &width, &height, &channels, 0);
+		// Grey and grey-alpha images are expanded to RGB and RGBA, the upload only handles those two
+		image_info_t info;
+		const auto channels = image_decoders::get_info(bytes, info) && (info.channels == 2 || info.channels == 4) ? 4 : 3;
+		decoded_image_t img;
+		const auto decoded = !bytes.empty() && image_decoders::decode(bytes, img, channels, flip_vertically);
 
 		// Create the texture object, bind it, copy the data, then gen the mipmaps
 		unsigned int tex;
 		glGenTextures(1, &tex);
-		glBindTexture(GL_TEXTURE_2D, tex);
+		gl_state::bind_texture(0, GL_TEXTURE_2D, tex);
 
 		// Only do the last two if the file exists
-		if (dat) {
-			// JPG does not use alpha
-			if (texture.ends_with("jpg")) {
-				glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, width, height, 0, GL_RGB, GL_UNSIGNED_BYTE, dat);
-			}
-			else {
-				glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, dat);
-			}
+		if (decoded) {
+			// Pick the upload format from what the decoder produced rather than the extension
+			// Decoded rows are tightly packed, RGB rows are not always a multiple of 4 bytes
+			const auto format = img.info.channels == 4 ? GL_RGBA : GL_RGB;
+			glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+			glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, img.info.width, img.info.height, 0, format, GL_UNSIGNED_BYTE, img.data);
+			glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
 			glGenerateMipmap(GL_TEXTURE_2D);
 		}
 
-		// Free the texture
-		stbi_image_free(dat);
-
-		mp_loadedTextures[{ texture, flip_vertically }] = tex;
+		mp_loadedTextures[{ name, flip_vertically }] = tex;
 		return tex;
 	}
 
@@ -155,30 +185,112 @@ namespace resource_manager {
 		return (mp_loadedMeshes[completePath] = make_shared<mesh>(vertices, indices));
 	}
 
-	std::shared_ptr<shader> load_shader(const std::string name, const std::string pathV, const std::string pathF) {
-		const auto totalPathV = shader_prefix + pathV;
-		const auto totalPathF = shader_prefix + pathF;
+	// The base variant keeps the plain name
+	std::string variant_key(const std::string& name, const shader_features features) {
+		return features == 0 ? name : name + "#" + std::to_string(features);
+	}
+
+	std::shared_ptr<shader> load_shader(const std::string name, const std::string pathV, const std::string pathF, const shader_features features) {
+		// Keywords the sources do not declare would only produce duplicate programs
+		const auto known = mp_shaderPaths.find(name);
+		if (known != mp_shaderPaths.end()) {
+			const auto result = mp_loadedShaders.find(variant_key(name, features & known->second.keywords));
+			if (result != mp_loadedShaders.end()) {
+				return result->second;
+			}
+		}
+
+		shader_sources_t sources{ pathV, pathF, 0, {} };
+		std::string vertex_str, frag_str;
+		if (!preprocess_shader(shader_prefix, sources, vertex_str, frag_str)) {
+			return nullptr;
+		}
+
+		sources.keywords = shader_feature::parse_keywords(vertex_str) | shader_feature::parse_keywords(frag_str);
+		const auto keywords = sources.keywords;
+		mp_shaderPaths[name] = sources;
 
-		const auto result = mp_loadedShaders.find(name);
+		const auto variant = features & keywords;
+		const auto key = variant_key(name, variant);
+		const auto result = mp_loadedShaders.find(key);
 		if (result != mp_loadedShaders.end()) {
 			return result->second;
 		}
 
-		const auto vertex_str = load_file_to_str(totalPathV);
-		const auto frag_str = load_file_to_str(totalPathF);
+		mp_shaderSources[key] = sources;
+		return (mp_loadedShaders[key] = std::make_shared<shader>(vertex_str, frag_str, shader_feature::to_defines(variant)));
+	}
 
-		if (!vertex_str.empty() && !frag_str.empty()) {
-			return (mp_loadedShaders[name] = std::make_shared<shader>(vertex_str, frag_str));
+	std::shared_ptr<shader> load_shader_variant(const std::string name, const shader_features features) {
+		const auto known = mp_shaderPaths.find(name);
+		if (known == mp_shaderPaths.end()) {
+			// The other overload adds the shader directory
+			return load_shader(name, name + ".vert", name + ".frag", features);
 		}
 
-		return nullptr;
+		return load_shader(name, known->second.pathV, known->second.pathF, features);
 	}
 	
 	std::shared_ptr<shader> load_shader(const std::string name) {
-		const auto totalPathV = shader_prefix + name + ".vert";
-		const auto totalPathF = shader_prefix + name + ".frag";
+		return load_shader_variant(name, 0);
+	}
+
+	bool poll_shaders() {
+		auto done = true;
+		for (auto& [name, loaded] : mp_loadedShaders) {
+			done &= loaded->poll();
+		}
+		return done;
+	}
+
+	bool finish_shaders() {
+		auto ok = true;
+		for (auto& [name, loaded] : mp_loadedShaders) {
+			loaded->finish();
+			if (loaded->error) {
+				std::cerr << "Error compiling shader " << name << ": \n" << shader_preprocessor::map_log(loaded->log) << std::endl;
+				ok = false;
+			}
+		}
+		return ok;
+	}
+
+	void watch_shaders(const bool enabled) {
+		p_shaderWatcher = enabled ? make_unique<file_watcher>(shader_prefix) : nullptr;
+	}
+
+	void update_shaders() {
+		if (p_shaderWatcher) {
+			const auto changed = p_shaderWatcher->poll();
+			for (const auto& path : changed) {
+				shader_preprocessor::invalidate(path);
+			}
+
+			// Rebuild only the programs that use one of the changed files, includes too
+			for (auto& [name, sources] : mp_shaderSources) {
+				const auto uses = std::any_of(sources.files.begin(), sources.files.end(), [&](const string& path) {
+					return std::find(changed.begin(), changed.end(), path) != changed.end();
+				});
+				if (!uses) {
+					continue;
+				}
+
+				std::string vertex_str, frag_str;
+				if (!preprocess_shader(shader_prefix, sources, vertex_str, frag_str)) {
+					continue;
+				}
+
+				std::cout << "Recompiling shader " << name << std::endl;
+				mp_loadedShaders[name]->reload(vertex_str, frag_str);
+			}
+		}
 
-		return load_shader(name, totalPathV, totalPathF);
+		// Swap in whatever finished compiling, the old program is used until then
+		for (auto& [name, loaded] : mp_loadedShaders) {
+			if (loaded->poll_reload()) {
+				std::cout << "Reloaded shader " << name << std::endl;
+			}
+		}
 	}
 
 	unordered_map<tuple<string, bool>, unsigned int>& get_loaded_shaders() {
@@ -209,29 +321,46 @@ namespace resource_manager {
 		shader_prefix = path;
 	}
 
+	void set_shader_cache_directory(std::string&& path) {
+		program_cache::set_directory(std::move(path));
+	}
+
 	unsigned int load_cubemap(std::vector<std::string> faces)
 	{
 		unsigned int textureID;
 		glGenTextures(1, &textureID);
-		glBindTexture(GL_TEXTURE_CUBE_MAP, textureID);
 
-		int width, height, nrChannels;
-		for (unsigned int i = 0; i < faces.size(); i++)
-		{
-			unsigned char* data = stbi_load(faces[i].c_str(), &width, &height, &nrChannels, 0);
-			if (data)
-			{
-				glTexImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_X + i,
-					0, GL_RGB, width, height, 0, GL_RGB, GL_UNSIGNED_BYTE, data
-				);
-				stbi_image_free(data);
-			}
-			else
+		// Faces are read and decoded as jobs, the upload waits for all of them on the main thread
+		std::vector<decoded_image_t> images(faces.size());
+		std::vector<char> decoded(faces.size());
+		job_counter decoding, uploading;
+		for (size_t i = 0; i < faces.size(); i++) {
+			job_system::run([&faces, &images, &decoded, i] {
+				const auto bytes = image_decoders::read_file(faces[i]);
+				decoded[i] = !bytes.empty() && image_decoders::decode(bytes, images[i], 3);
+			}, &decoding);
+		}
+		job_system::run_on_main([&faces, &images, &decoded, textureID] {
+			gl_state::bind_texture(0, GL_TEXTURE_CUBE_MAP, textureID);
+			glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+			for (unsigned int i = 0; i < faces.size(); i++)
 			{
-				std::cout << "Cubemap tex failed to load at path: " << faces[i] << std::endl;
-				stbi_image_free(data);
+				if (decoded[i])
+				{
+					glTexImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_X + i,
+						0, GL_RGB, images[i].info.width, images[i].info.height, 0, GL_RGB, GL_UNSIGNED_BYTE, images[i].data
+					);
+				}
+				else
+				{
+					std::cout << "Cubemap tex failed to load at path: " << faces[i] << std::endl;
+				}
 			}
-		}
+			glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+		}, &uploading, &decoding);
+		job_system::wait(uploading);
+		job_system::wait(decoding);
+
 		glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
 		glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
 		glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
@@ -1,9 +1,13 @@
+#ifndef RESOURCE_MANAGER_H
+#define RESOURCE_MANAGER_H
 #include <string>
 #include <memory>
+#include <span>
 #include <vector>
 
 class mesh;
 class shader;
+using shader_features = unsigned int;
 
 namespace resource_manager {
 	// Load a texture/image from a file on the system
@@ -12,15 +16,38 @@ namespace resource_manager {
 	unsigned load_texture(const std::string path, bool flip_vertically);
 	unsigned load_texture(const std::string path);
 
+	// Same as above but decodes from bytes already in memory (eg. an mmapped archive)
+	// The name is only used as the cache key
+	unsigned load_texture_from_memory(const std::string name, std::span<const unsigned char> bytes, bool flip_vertically);
+
 	// Load a mesh from a file on the system
 	// Mainly, load vertices and indices, and pass them to the mesh constructor
 	std::shared_ptr<mesh> load_mesh(const std::string path);
 
 	// Load a vertex and fragment shader from a file on the system
 	// Returns compiled shader program
-	std::shared_ptr<shader> load_shader(std::string shaderName, std::string pathV, std::string pathF);
+	// Features select a variant, keywords the sources do not declare are ignored
+	std::shared_ptr<shader> load_shader(std::string shaderName, std::string pathV, std::string pathF, shader_features features = 0);
 	std::shared_ptr<shader> load_shader(std::string shaderName);
 
+	// Variant of a shader by name, using the sources it was first loaded from
+	// (or name.vert / name.frag). Variants are cached by their keyword bitmask
+	std::shared_ptr<shader> load_shader_variant(std::string shaderName, shader_features features);
+
+	// Shaders compile in the background once loaded
+	// Poll returns true once every loaded shader is done, without blocking where the driver allows
+	bool poll_shaders();
+
+	// Block until every loaded shader is done, false if any failed to compile or link
+	bool finish_shaders();
+
+	// Watch the shader directory for changes
+	void watch_shaders(bool enabled);
+
+	// Call once a frame, recompiles programs whose sources changed and swaps
+	// them in behind their existing shared_ptr once they have linked
+	void update_shaders();
+
 	// Set the texture/image directory
 	void set_texture_directory(std::string&& path);
 
@@ -30,6 +57,12 @@ namespace resource_manager {
 	// Set the shader directory
 	void set_shader_directory(std::string&& path);
 
-	// Load cubemap
+	// Set where linked program binaries are cached, empty disables the cache
+	void set_shader_cache_directory(std::string&& path);
+
+	// Load cubemap, faces are decoded in parallel on the job system
+	// Call from the main thread, which uploads them
 	unsigned int load_cubemap(std::vector<std::string> faces);
-};
\ No newline at end of file
+};
+
+#endif // RESOURCE_MANAGER_H
@@ -0,0 +1,128 @@
+#include "scene_graph.h"
+#include "glm/gtc/matrix_inverse.hpp"
+#include "glm/gtx/transform.hpp"
+
+void scene_graph::mark(const uint32_t node) {
+	if (!m_vNodes[node].dirty) {
+		m_vNodes[node].dirty = true;
+		m_vDirty.push_back(node);
+	}
+}
+
+void scene_graph::unlink(const uint32_t node) {
+	const auto parent = m_vNodes[node].parent;
+	if (parent == NONE) {
+		return;
+	}
+
+	auto* link = &m_vNodes[parent].firstChild;
+	while (*link != node) {
+		link = &m_vNodes[*link].nextSibling;
+	}
+	*link = m_vNodes[node].nextSibling;
+	m_vNodes[node].parent = NONE;
+	m_vNodes[node].nextSibling = NONE;
+}
+
+uint32_t scene_graph::create(const uint32_t parent) {
+	const auto node = static_cast<uint32_t>(m_vNodes.size());
+	m_vNodes.emplace_back();
+	set_parent(node, parent);
+	mark(node);
+	return node;
+}
+
+void scene_graph::set_parent(const uint32_t node, const uint32_t parent) {
+	unlink(node);
+	if (parent != NONE) {
+		m_vNodes[node].parent = parent;
+		m_vNodes[node].nextSibling = m_vNodes[parent].firstChild;
+		m_vNodes[parent].firstChild = node;
+	}
+	mark(node);
+}
+
+void scene_graph::set_position(const uint32_t node, const glm::vec3& position) {
+	m_vNodes[node].position = position;
+	mark(node);
+}
+
+void scene_graph::set_scale(const uint32_t node, const glm::vec3& scale) {
+	m_vNodes[node].scale = scale;
+	mark(node);
+}
+
+void scene_graph::set_pitch(const uint32_t node, const float pitch) {
+	m_vNodes[node].pitch = pitch;
+	mark(node);
+}
+
+void scene_graph::set_yaw(const uint32_t node, const float yaw) {
+	m_vNodes[node].yaw = yaw;
+	mark(node);
+}
+
+void scene_graph::compute(const uint32_t node) {
+	auto& n = m_vNodes[node];
+
+	// SCALE ROTATE TRANSFORM, like model::get_transform
+	const auto identity = glm::mat4(1.f);
+	const auto rotation = glm::rotate(identity, glm::radians(n.yaw), glm::vec3{ 0.f, 1.f, 0.f })
+		* glm::rotate(identity, glm::radians(n.pitch), glm::vec3{ 1.f, 0.f, 0.f });
+	const auto local = glm::translate(identity, n.position) * rotation * glm::scale(identity, n.scale);
+
+	const auto uniform = n.scale.x == n.scale.y && n.scale.y == n.scale.z;
+	if (n.parent == NONE) {
+		n.world = local;
+		n.uniformScale = uniform ? n.scale.x : 0.f;
+	}
+	else {
+		const auto& parent = m_vNodes[n.parent];
+		n.world = parent.world * local;
+		n.uniformScale = uniform ? parent.uniformScale * n.scale.x : 0.f;
+	}
+
+	// Rotation times a uniform scale s has the inverse transpose rotation / s
+	if (n.uniformScale != 0.f) {
+		n.normal = glm::mat3(n.world) / (n.uniformScale * n.uniformScale);
+	}
+	else {
+		n.normal = glm::inverseTranspose(glm::mat3(n.world));
+		m_sStats.inverses++;
+	}
+
+	n.dirty = false;
+	m_vChanged.push_back(node);
+	m_sStats.updated++;
+}
+
+void scene_graph::update() {
+	m_vChanged.clear();
+	m_sStats = {};
+
+	for (const auto queued : m_vDirty) {
+		// Already recomputed with a dirty ancestor
+		if (!m_vNodes[queued].dirty) {
+			continue;
+		}
+
+		// Start from the highest dirty ancestor so every node is computed once, after its parent
+		auto top = queued;
+		for (auto parent = m_vNodes[queued].parent; parent != NONE; parent = m_vNodes[parent].parent) {
+			if (m_vNodes[parent].dirty) {
+				top = parent;
+			}
+		}
+
+		m_vStack.push_back(top);
+		while (!m_vStack.empty()) {
+			const auto node = m_vStack.back();
+			m_vStack.pop_back();
+			compute(node);
+			for (auto child = m_vNodes[node].firstChild; child != NONE; child = m_vNodes[child].nextSibling) {
+				m_vStack.push_back(child);
+			}
+		}
+	}
+	m_vDirty.clear();
+}
@@ -0,0 +1,111 @@
+#ifndef SCENE_GRAPH_H
+#define SCENE_GRAPH_H
+#include <cstdint>
+#include <vector>
+#include "glm/glm.hpp"
+
+// Transform hierarchy with cached world and normal matrices
+//
+// Nodes hold the same scale, pitch, yaw and position as a model, relative to their parent.
+// Changing a node queues it, and update() recomputes it and everything below it, once per
+// queued subtree. A frame where nothing moved costs nothing. The nodes recomputed by the
+// last update are listed so bounds and GPU data can follow only what changed
+class scene_graph {
+public:
+	static constexpr uint32_t NONE = UINT32_MAX;
+
+	struct stats_t {
+		// World matrices recomputed, and the normal matrices among them that needed a full inverse
+		unsigned int updated = 0;
+		unsigned int inverses = 0;
+	};
+
+private:
+	struct node_t {
+		glm::vec3 position{ 0 };
+		glm::vec3 scale{ 1 };
+		float pitch = 0, yaw = 0;
+		uint32_t parent = NONE;
+		uint32_t firstChild = NONE;
+		uint32_t nextSibling = NONE;
+		bool dirty = false;
+
+		glm::mat4 world{ 1.f };
+		glm::mat3 normal{ 1.f };
+		// World scale when it is the same on every axis, 0 otherwise
+		float uniformScale = 1.f;
+	};
+
+	std::vector<node_t> m_vNodes;
+	std::vector<uint32_t> m_vDirty;
+	std::vector<uint32_t> m_vChanged;
+	std::vector<uint32_t> m_vStack;
+	stats_t m_sStats;
+
+	void mark(uint32_t node);
+	void unlink(uint32_t node);
+
+	// Recompute the node from its parent's cached world matrix
+	void compute(uint32_t node);
+
+public:
+	uint32_t create(uint32_t parent = NONE);
+
+	// Moves the node with its children under another parent, or to the root with NONE
+	// The parent must not be below the node
+	void set_parent(uint32_t node, uint32_t parent);
+
+	void set_position(uint32_t node, const glm::vec3& position);
+	void set_scale(uint32_t node, const glm::vec3& scale);
+	void set_pitch(uint32_t node, float pitch);
+	void set_yaw(uint32_t node, float yaw);
+
+	[[nodiscard]]
+	uint32_t get_parent(const uint32_t node) const {
+		return m_vNodes[node].parent;
+	}
+
+	[[nodiscard]]
+	const glm::vec3& get_position(const uint32_t node) const {
+		return m_vNodes[node].position;
+	}
+
+	// As of the last update
+	[[nodiscard]]
+	const glm::mat4& get_world(const uint32_t node) const {
+		return m_vNodes[node].world;
+	}
+
+	// Inverse transpose of the world matrix's upper 3x3, as of the last update
+	[[nodiscard]]
+	const glm::mat3& get_normal(const uint32_t node) const {
+		return m_vNodes[node].normal;
+	}
+
+	[[nodiscard]]
+	glm::vec3 get_world_position(const uint32_t node) const {
+		return glm::vec3(m_vNodes[node].world[3]);
+	}
+
+	[[nodiscard]]
+	size_t size() const {
+		return m_vNodes.size();
+	}
+
+	// Recompute every node changed since the last update, and the nodes below them
+	void update();
+
+	// Nodes the last update recomputed, parents before their children
+	[[nodiscard]]
+	const std::vector<uint32_t>& get_changed() const {
+		return m_vChanged;
+	}
+
+	// For the last update
+	[[nodiscard]]
+	stats_t get_stats() const {
+		return m_sStats;
+	}
+};
+
+#endif // SCENE_GRAPH_H
@@ -4,16 +4,22 @@
 
 #include <glad/glad.h>
 #include "shader.h"
+#include "gl_state.h"
+#include "gl_extensions.h"
+#include "program_cache.h"
+#include "object_data.h"
+#include "shader_preprocessor.h"
 
 #include <iostream>
 #include <fstream>
 #include <sstream>
+#include <cstring>
+#include <algorithm>
 #include "glm/glm/gtc/type_ptr.hpp"
 
-int compileShader(GLuint shader, char *log) {
+int checkShader(GLuint shader, char *log) {
     int status;
 
-    glCompileShader(shader);
     glGetShaderiv(shader, GL_COMPILE_STATUS, &status);
     if (status == 0) {
         glGetShaderInfoLog(shader, 512, nullptr, log);
@@ -24,68 +30,490 @@ int compileShader(GLuint shader, char *log) {
     return 1;
 }
 
-shader::shader(const std::string &vertex, const std::string& fragment) {
-    const auto vertex_shader = glCreateShader(GL_VERTEX_SHADER);
-    const auto fragment_shader = glCreateShader(GL_FRAGMENT_SHADER);
+namespace {
+    // Defines have to come after #version, which must be the first thing in the source
+    std::string inject_defines(const std::string& source, const std::string& defines) {
+        if (defines.empty()) {
+            return source;
+        }
+
+        const auto version = source.find("#version");
+        const auto lineEnd = version == std::string::npos ? std::string::npos : source.find('\n', version);
+        if (lineEnd == std::string::npos) {
+            return defines + source;
+        }
+
+        // Count lines up to the injection point so compile errors still point at the file
+        const auto nextLine = std::count(source.begin(), source.begin() + lineEnd + 1, '\n') + 1;
+        return source.substr(0, lineEnd + 1) + defines + "#line " + std::to_string(nextLine) + "\n" + source.substr(lineEnd + 1);
+    }
+}
+
+namespace shader_feature {
+    shader_features parse_keywords(const std::string& source) {
+        shader_features features = 0;
+
+        std::istringstream stream{ source };
+        std::string line;
+        while (std::getline(stream, line)) {
+            std::istringstream words{ line };
+            std::string pragma, keywords;
+            if (!(words >> pragma >> keywords) || pragma != "#pragma" || keywords != "keywords") {
+                continue;
+            }
+
+            std::string keyword;
+            while (words >> keyword) {
+                for (unsigned int i = 0; i < count; i++) {
+                    if (keyword == names[i]) {
+                        features |= 1u << i;
+                    }
+                }
+            }
+        }
+
+        return features;
+    }
+
+    std::string to_defines(const shader_features features) {
+        std::string defines;
+        for (unsigned int i = 0; i < count; i++) {
+            if (features & (1u << i)) {
+                defines += "#define ";
+                defines += names[i];
+                defines += "\n";
+            }
+        }
+        return defines;
+    }
+}
+
+shader::build_t shader::submit(const std::string& vertexSource, const std::string& fragmentSource, const std::string& defines) {
+    build_t build;
+    const auto vertex = inject_defines(vertexSource, defines);
+    const auto fragment = inject_defines(fragmentSource, defines);
+
+    // Try the binary cache before paying for a compile and link
+    build.useCache = program_cache::enabled();
+    build.cacheKey = build.useCache ? program_cache::make_key(vertex, fragment, defines) : 0;
+    if (build.useCache) {
+        build.program = program_cache::load(build.cacheKey);
+        if (build.program != 0) {
+            build.fromCache = true;
+            return build;
+        }
+    }
+
+    // Submit the compile and link without asking for any status, so the
+    // driver can work on it while we do something else
+    build.vertexShader = glCreateShader(GL_VERTEX_SHADER);
+    build.fragmentShader = glCreateShader(GL_FRAGMENT_SHADER);
 
     const auto vertex_source = vertex.c_str();
     const auto frag_source = fragment.c_str();
 
-    glShaderSource(vertex_shader, 1, &vertex_source, nullptr);
-    glShaderSource(fragment_shader, 1, &frag_source, nullptr);
+    glShaderSource(build.vertexShader, 1, &vertex_source, nullptr);
+    glShaderSource(build.fragmentShader, 1, &frag_source, nullptr);
+    glCompileShader(build.vertexShader);
+    glCompileShader(build.fragmentShader);
+
+    build.program = glCreateProgram();
+    if (build.useCache) {
+        gl_extensions::program_parameteri(build.program, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+    }
+    glAttachShader(build.program, build.vertexShader);
+    glAttachShader(build.program, build.fragmentShader);
+    glLinkProgram(build.program);
+
+    return build;
+}
+
+bool shader::build_ready(const build_t& build) {
+    // Without KHR_parallel_shader_compile there is no way to ask without blocking
+    if (build.fromCache || !gl_extensions::supports_parallel_shader_compile()) {
+        return true;
+    }
+
+    int complete = 0;
+    glGetProgramiv(build.program, GL_COMPLETION_STATUS_KHR, &complete);
+    return complete != 0;
+}
+
+bool shader::complete(build_t& build) {
+    if (build.fromCache) {
+        return true;
+    }
+
+    // Any of these queries block until the driver is done with the program
+    auto ok = true;
+    if (!checkShader(build.vertexShader, log)) {
+        std::cerr << "Error compiling vertex shader\n" << shader_preprocessor::map_log(log) << std::endl;
+        ok = false;
+    }
+    else if (!checkShader(build.fragmentShader, log)) {
+        std::cerr << "Error compiling fragment shader\n" << shader_preprocessor::map_log(log) << std::endl;
+        ok = false;
+    }
+
+    glDeleteShader(build.vertexShader);
+    glDeleteShader(build.fragmentShader);
+    build.vertexShader = build.fragmentShader = 0;
+
+    if (ok) {
+        int linked;
+        glGetProgramiv(build.program, GL_LINK_STATUS, &linked);
+        if (linked == 0) {
+            glGetProgramInfoLog(build.program, 512, nullptr, log);
+            std::cerr << "Error linking shader program\n" << shader_preprocessor::map_log(log) << std::endl;
+
+            ok = false;
+        }
+    }
+
+    if (ok && build.useCache) {
+        program_cache::save(build.cacheKey, build.program);
+    }
 
+    return ok;
+}
+
+shader::shader(const std::string &vertex, const std::string& fragment, const std::string& defines) : m_sDefines(defines) {
+    static unsigned int nextId = 1;
+    m_uId = nextId++;
     log = new char[512];
 
-    if (!compileShader(vertex_shader, log)) {
-        std::cerr << "Error compiling vertex shader\n" << log << std::endl;
+    m_sBuild = submit(vertex, fragment, m_sDefines);
+    m_uProgram = m_sBuild.program;
+}
 
-        glDeleteShader(vertex_shader);
+bool shader::is_ready() const {
+    return m_eStatus != status::compiling || build_ready(m_sBuild);
+}
 
-        error = true;
-        return;
+bool shader::poll() {
+    if (m_eStatus == status::compiling && is_ready()) {
+        finish();
     }
 
-    if (!compileShader(fragment_shader, log)) {
-        std::cerr << "Error compiling fragment shader\n" << log << std::endl;
+    return m_eStatus != status::compiling;
+}
 
-        glDeleteShader(vertex_shader);
-        glDeleteShader(fragment_shader);
+void shader::finish() {
+    if (m_eStatus != status::compiling) {
+        return;
+    }
 
+    if (!complete(m_sBuild)) {
         error = true;
+        m_eStatus = status::failed;
         return;
     }
 
-    m_uProgram = glCreateProgram();
-    glAttachShader(m_uProgram, vertex_shader);
-    glAttachShader(m_uProgram, fragment_shader);
-    glLinkProgram(m_uProgram);
+    m_bFromBinaryCache = m_sBuild.fromCache;
+    reflect_uniforms(false);
+    apply_uniform_blocks();
+    m_eStatus = status::ready;
+    apply_object_data();
+}
+
+void shader::reload(const std::string& vertex, const std::string& fragment) {
+    // A newer edit replaces a reload that is still compiling
+    if (m_bReloading) {
+        glDeleteShader(m_sReload.vertexShader);
+        glDeleteShader(m_sReload.fragmentShader);
+        glDeleteProgram(m_sReload.program);
+    }
 
-    glDeleteShader(vertex_shader);
-    glDeleteShader(fragment_shader);
+    m_sReload = submit(vertex, fragment, m_sDefines);
+    m_bReloading = true;
+}
+
+bool shader::poll_reload() {
+    if (!m_bReloading || !build_ready(m_sReload)) {
+        return false;
+    }
+
+    m_bReloading = false;
+
+    // Keep running the old program if the new one does not build
+    if (!complete(m_sReload)) {
+        glDeleteProgram(m_sReload.program);
+        return false;
+    }
+
+    const auto old = m_uProgram;
+    m_uProgram = m_sReload.program;
+    gl_state::forget_program(old);
+    glDeleteProgram(old);
+
+    error = false;
+    m_eStatus = status::ready;
+    m_bFromBinaryCache = m_sReload.fromCache;
+    reflect_uniforms(true);
+    apply_uniform_blocks();
+    apply_object_data();
+    return true;
+}
+
+void shader::bind_uniform_block(const char* name, const unsigned int binding) {
+    bind_uniform_block(name, binding, {}, 0);
+}
+
+void shader::bind_uniform_block(const char* name, const unsigned int binding, std::span<const block_member_t> members, const size_t size) {
+    const auto found = std::find_if(m_vUniformBlocks.begin(), m_vUniformBlocks.end(), [&](const uniform_block_t& block) {
+        return block.name == name;
+    });
+    if (found != m_vUniformBlocks.end()) {
+        *found = { name, binding, members, size };
+    }
+    else {
+        m_vUniformBlocks.push_back({ name, binding, members, size });
+    }
+
+    if (m_eStatus == status::ready) {
+        apply_uniform_blocks();
+    }
+}
+
+void shader::apply_uniform_blocks() {
+    for (const auto& block : m_vUniformBlocks) {
+        const auto index = glGetUniformBlockIndex(m_uProgram, block.name.c_str());
+        if (index == GL_INVALID_INDEX) {
+            continue;
+        }
+
+        glUniformBlockBinding(m_uProgram, index, block.binding);
+        if (!block.members.empty()) {
+            block_layout::validate(m_uProgram, block.name.c_str(), block.members, block.size);
+        }
+    }
+}
+
+namespace {
+    shader::uniform_stats_t uniformStats{};
+
+    uniform_kind kind_from_gl(const GLenum type) {
+        switch (type) {
+        case GL_FLOAT: return uniform_kind::float1;
+        case GL_INT:
+        case GL_BOOL:
+        case GL_SAMPLER_1D:
+        case GL_SAMPLER_2D:
+        case GL_SAMPLER_3D:
+        case GL_SAMPLER_CUBE:
+        case GL_SAMPLER_2D_SHADOW:
+        case GL_SAMPLER_2D_ARRAY:
+        case GL_SAMPLER_BUFFER:
+        case GL_INT_SAMPLER_BUFFER:
+        case GL_UNSIGNED_INT_SAMPLER_BUFFER:
+            return uniform_kind::int1;
+        case GL_FLOAT_VEC3: return uniform_kind::vec3;
+        case GL_FLOAT_VEC4: return uniform_kind::vec4;
+        case GL_FLOAT_MAT3: return uniform_kind::mat3;
+        case GL_FLOAT_MAT4: return uniform_kind::mat4;
+        default: return uniform_kind::unknown;
+        }
+    }
+}
+
+void shader::reflect_uniforms(const bool preserve) {
+    // Instanced shaders fetch their per object data with an object id instead
+    m_bInstanced = glGetAttribLocation(m_uProgram, "objectId") >= 0;
+
+    int count = 0, maxLength = 0;
+    glGetProgramiv(m_uProgram, GL_ACTIVE_UNIFORMS, &count);
+    glGetProgramiv(m_uProgram, GL_ACTIVE_UNIFORM_MAX_LENGTH, &maxLength);
+
+    // When replacing a program, existing entries keep their index so handles
+    // stay valid. Uniforms that went away are left with no location
+    if (preserve) {
+        for (auto& uniform : m_vUniforms) {
+            uniform.location = -1;
+        }
+    }
+    else {
+        m_vUniforms.clear();
+        m_vUniformNames.clear();
+        m_vUniforms.reserve(count);
+        m_vUniformNames.reserve(count);
+    }
+
+    std::string name(maxLength, '\0');
+    for (auto i = 0; i < count; i++) {
+        GLsizei length = 0;
+        GLint size = 0;
+        GLenum type = 0;
+        glGetActiveUniform(m_uProgram, i, maxLength, &length, &size, &type, name.data());
+
+        // Arrays are reported as "name[0]", we address them by their base name
+        auto uniformName = name.substr(0, length);
+        if (uniformName.ends_with("[0]")) {
+            uniformName.resize(uniformName.size() - 3);
+        }
+
+        // Members of uniform blocks have no location and are not set through here
+        const auto location = glGetUniformLocation(m_uProgram, uniformName.c_str());
+        if (location < 0) {
+            continue;
+        }
+
+        const auto existing = std::find(m_vUniformNames.begin(), m_vUniformNames.end(), uniformName);
+        if (existing != m_vUniformNames.end()) {
+            auto& uniform = m_vUniforms[existing - m_vUniformNames.begin()];
+            uniform.location = location;
+
+            // The type may have changed in the new source, drop the value if so
+            // Handles resolved for the old type stop writing to it, see update_cache
+            if (uniform.kind != kind_from_gl(type)) {
+                std::cerr << "Uniform " << uniformName << " changed type on reload, handles of the old type are ignored" << std::endl;
+                uniform.kind = kind_from_gl(type);
+                uniform.cached = false;
+                uniform.mismatched = false;
+            }
+            continue;
+        }
+
+        uniform_t uniform;
+        uniform.location = location;
+        uniform.kind = kind_from_gl(type);
+        m_vUniforms.push_back(uniform);
+        m_vUniformNames.push_back(std::move(uniformName));
+    }
+
+    if (preserve) {
+        // A fresh program starts with every uniform zeroed, restore what we had set
+        for (auto& uniform : m_vUniforms) {
+            if (uniform.location >= 0 && uniform.cached) {
+                upload(uniform);
+            }
+            else {
+                uniform.cached = false;
+            }
+        }
+    }
+}
+
+void shader::apply_object_data() {
+    if (m_bInstanced) {
+        set(get_uniform<int>("objectData"), static_cast<int>(object_data::TEXTURE_UNIT));
+    }
+}
+
+void shader::upload(const uniform_t& uniform) {
+    use();
+    switch (uniform.kind) {
+    case uniform_kind::float1: glUniform1f(uniform.location, uniform.value[0]); break;
+    case uniform_kind::int1: glUniform1i(uniform.location, *reinterpret_cast<const int*>(uniform.value)); break;
+    case uniform_kind::vec3: glUniform3fv(uniform.location, 1, uniform.value); break;
+    case uniform_kind::vec4: glUniform4fv(uniform.location, 1, uniform.value); break;
+    case uniform_kind::mat3: glUniformMatrix3fv(uniform.location, 1, GL_FALSE, uniform.value); break;
+    case uniform_kind::mat4: glUniformMatrix4fv(uniform.location, 1, GL_FALSE, uniform.value); break;
+    default: break;
+    }
+}
+
+int shader::resolve_uniform(const char* name, const uniform_kind kind) {
+    // The table only exists once the program has linked
+    finish();
+
+    for (size_t i = 0; i < m_vUniformNames.size(); i++) {
+        if (m_vUniformNames[i] != name) {
+            continue;
+        }
+
+        // Name based setters resolve every call, warn once like update_cache does
+        if (m_vUniforms[i].kind != kind) {
+            if (!m_vUniforms[i].mismatched) {
+                std::cerr << "Uniform " << name << " set with a mismatched type" << std::endl;
+                m_vUniforms[i].mismatched = true;
+            }
+            return -1;
+        }
+
+        return static_cast<int>(i);
+    }
+
+    // Inactive uniforms are optimized out by the driver, setting them is a no-op
+    return -1;
+}
+
+bool shader::update_cache(const int index, const uniform_kind kind, const void* value, const size_t size) {
+    auto& uniform = m_vUniforms[index];
+
+    // A reload can change the type behind a handle, the old glUniform* call would be an error
+    if (uniform.kind != kind) {
+        if (!uniform.mismatched) {
+            std::cerr << "Uniform " << m_vUniformNames[index] << " set with a mismatched type" << std::endl;
+            uniform.mismatched = true;
+        }
+        return false;
+    }
+
+    if (uniform.cached && std::memcmp(uniform.value, value, size) == 0) {
+        uniformStats.skipped++;
+        return false;
+    }
+
+    std::memcpy(uniform.value, value, size);
+    uniform.cached = true;
+    uniformStats.uploads++;
+
+    // glUniform* writes to whichever program is bound, gl_state drops this if it already is
+    use();
+    gl_state::count_calls();
+    return true;
+}
+
+void shader::set(const uniform_handle<float> handle, const float v) {
+    if (handle.valid() && update_cache(handle.index, uniform_kind_of<float>::value, &v, sizeof(v))) {
+        glUniform1f(m_vUniforms[handle.index].location, v);
+    }
+}
+
+void shader::set(const uniform_handle<int> handle, const int v) {
+    if (handle.valid() && update_cache(handle.index, uniform_kind_of<int>::value, &v, sizeof(v))) {
+        glUniform1i(m_vUniforms[handle.index].location, v);
+    }
+}
+
+void shader::set(const uniform_handle<glm::vec3> handle, const glm::vec3& v) {
+    if (handle.valid() && update_cache(handle.index, uniform_kind_of<glm::vec3>::value, glm::value_ptr(v), sizeof(v))) {
+        glUniform3fv(m_vUniforms[handle.index].location, 1, glm::value_ptr(v));
+    }
+}
+
+void shader::set(const uniform_handle<glm::vec4> handle, const glm::vec4& v) {
+    if (handle.valid() && update_cache(handle.index, uniform_kind_of<glm::vec4>::value, glm::value_ptr(v), sizeof(v))) {
+        glUniform4fv(m_vUniforms[handle.index].location, 1, glm::value_ptr(v));
+    }
+}
+
+void shader::set(const uniform_handle<glm::mat3> handle, const glm::mat3& v) {
+    if (handle.valid() && update_cache(handle.index, uniform_kind_of<glm::mat3>::value, glm::value_ptr(v), sizeof(v))) {
+        glUniformMatrix3fv(m_vUniforms[handle.index].location, 1, GL_FALSE, glm::value_ptr(v));
+    }
+}
+
+void shader::set(const uniform_handle<glm::mat4> handle, const glm::mat4& v) {
+    if (handle.valid() && update_cache(handle.index, uniform_kind_of<glm::mat4>::value, glm::value_ptr(v), sizeof(v))) {
+        glUniformMatrix4fv(m_vUniforms[handle.index].location, 1, GL_FALSE, glm::value_ptr(v));
+    }
 }
 
 void shader::setFloat(const char *name, const float &v) {
-    const auto location = glGetUniformLocation(m_uProgram, name);
-    glUseProgram(m_uProgram);
-    glUniform1f(location, v);
+    set(get_uniform<float>(name), v);
 }
 
 void shader::setInt(const char *name, const int &v) {
-    const auto location = glGetUniformLocation(m_uProgram, name);
-    glUseProgram(m_uProgram);
-    glUniform1i(location, v);
+    set(get_uniform<int>(name), v);
 }
 
 void shader::setMatrix(const char* name, const glm::mat4& v) {
-    const auto location = glGetUniformLocation(m_uProgram, name);
-    glUseProgram(m_uProgram);
-    glUniformMatrix4fv(location, 1, GL_FALSE, glm::value_ptr(v)); 
+    set(get_uniform<glm::mat4>(name), v);
 }
 
 void shader::setVec3(const char* name, const glm::vec3&& v) {
-    const auto location = glGetUniformLocation(m_uProgram, name);
-    glUseProgram(m_uProgram);
-    glUniform3f(location, v.x, v.y, v.z);
+    set(get_uniform<glm::vec3>(name), v);
 }
 
 void shader::setVec3(const char* name, const float x, const float y, const float z) {
@@ -93,9 +521,22 @@ void shader::setVec3(const char* name, const float x, const float y, const float
 }
 
 void shader::use() {
-    glUseProgram(m_uProgram);
+    finish();
+    gl_state::use_program(m_uProgram);
 }
 
 const unsigned int shader::getProgram() const {
     return m_uProgram;
 }
+
+bool shader::from_binary_cache() const {
+    return m_bFromBinaryCache;
+}
+
+shader::uniform_stats_t shader::get_uniform_stats() {
+    return uniformStats;
+}
+
+void shader::reset_uniform_stats() {
+    uniformStats = {};
+}
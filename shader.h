@@ -6,27 +6,243 @@
 #define LEARNGL_SHADER_H
 
 #include <string>
+#include <vector>
+#include <span>
 #include "glm/glm/matrix.hpp"
+#include "block_layout.h"
 
-inline struct shader_data {
+// Mirrors the std140 shader_data block in shaders/shader_data.glsl
+struct alignas(16) shader_data_t {
     glm::mat4 view;
     glm::mat4 projection;
     glm::vec3 cameraPosition;
-} shader_data;
+};
+
+template <> struct block_members<shader_data_t> {
+    static constexpr block_member_t value[] = {
+        BLOCK_MEMBER(shader_data_t, view),
+        BLOCK_MEMBER(shader_data_t, projection),
+        BLOCK_MEMBER(shader_data_t, cameraPosition),
+    };
+};
+static_assert(block_layout::matches<shader_data_t>(block_packing::std140), "shader_data_t does not match the shader_data block");
+
+inline shader_data_t shader_data;
+
+// Mirrors the std140 light_data block in shaders/light_data.glsl
+struct alignas(16) light_data_t {
+    glm::vec3 lightPos;
+    alignas(16) glm::vec3 lightColor;
+};
+
+template <> struct block_members<light_data_t> {
+    static constexpr block_member_t value[] = {
+        BLOCK_MEMBER(light_data_t, lightPos),
+        BLOCK_MEMBER(light_data_t, lightColor),
+    };
+};
+static_assert(block_layout::matches<light_data_t>(block_packing::std140), "light_data_t does not match the light_data block");
+
+// What kind of value a uniform holds, samplers are set like ints
+enum class uniform_kind : unsigned char {
+    unknown,
+    float1,
+    int1,
+    vec3,
+    vec4,
+    mat3,
+    mat4
+};
+
+// Feature keywords a shader can be specialized on, combined into a bitmask
+// Shaders list the ones they support with "#pragma keywords TEXTURED ..." and
+// each requested keyword becomes a #define in that variant
+using shader_features = unsigned int;
+
+namespace shader_feature {
+    constexpr shader_features textured = 1u << 0;
+    constexpr shader_features reflection = 1u << 1;
+    constexpr shader_features normal_map = 1u << 2;
+    constexpr unsigned int count = 3;
+
+    // Names as they appear in GLSL, indexed by bit
+    inline constexpr const char* names[count] = { "TEXTURED", "REFLECTION", "NORMAL_MAP" };
+
+    // Keywords declared by "#pragma keywords" lines in a source
+    shader_features parse_keywords(const std::string& source);
+
+    // One #define line per set bit
+    std::string to_defines(shader_features features);
+}
+
+template <typename T> struct uniform_kind_of;
+template <> struct uniform_kind_of<float> { static constexpr auto value = uniform_kind::float1; };
+template <> struct uniform_kind_of<int> { static constexpr auto value = uniform_kind::int1; };
+template <> struct uniform_kind_of<glm::vec3> { static constexpr auto value = uniform_kind::vec3; };
+template <> struct uniform_kind_of<glm::vec4> { static constexpr auto value = uniform_kind::vec4; };
+template <> struct uniform_kind_of<glm::mat3> { static constexpr auto value = uniform_kind::mat3; };
+template <> struct uniform_kind_of<glm::mat4> { static constexpr auto value = uniform_kind::mat4; };
+
+// Index into a shader's uniform table, resolved once up front
+// Invalid handles (inactive or mistyped uniforms) are silently ignored when set, and so are
+// handles whose uniform changed type in a hot reload, after a warning
+template <typename T>
+struct uniform_handle {
+    int index = -1;
+
+    [[nodiscard]]
+    bool valid() const {
+        return index >= 0;
+    }
+};
 
 class shader {
 public:
     bool error = false;
     char *log = nullptr;
 
+    // Driver calls made by and avoided by uniform writes, across all shaders
+    struct uniform_stats_t {
+        unsigned long long uploads = 0;
+        unsigned long long skipped = 0;
+    };
+
 private:
-    unsigned int m_uProgram;
+    // One entry per active uniform, filled from glGetActiveUniform after linking
+    struct uniform_t {
+        int location = -1;
+        uniform_kind kind = uniform_kind::unknown;
+        bool cached = false;
+        // Set with another type since the last reload, by handle or name, warned about once
+        bool mismatched = false;
+        // Last value uploaded, big enough for a mat4
+        float value[16]{};
+    };
+
+    enum class status : unsigned char {
+        compiling,
+        ready,
+        failed
+    };
+
+    // A program somewhere between being submitted and being usable
+    struct build_t {
+        unsigned int program = 0;
+        unsigned int vertexShader = 0;
+        unsigned int fragmentShader = 0;
+        unsigned long long cacheKey = 0;
+        bool useCache = false;
+        bool fromCache = false;
+    };
+
+    unsigned int m_uProgram = 0;
+    // Small and stable across reloads, used in render queue sort keys
+    unsigned int m_uId = 0;
+    status m_eStatus = status::compiling;
+    bool m_bFromBinaryCache = false;
+    bool m_bReloading = false;
+    bool m_bInstanced = false;
+    build_t m_sBuild;
+    build_t m_sReload;
+    std::vector<uniform_t> m_vUniforms;
+    std::vector<std::string> m_vUniformNames;
+
+    // Uniform block bindings, reapplied whenever the program is replaced
+    // Blocks with a known C++ layout are validated against the reflected one
+    struct uniform_block_t {
+        std::string name;
+        unsigned int binding = 0;
+        std::span<const block_member_t> members;
+        size_t size = 0;
+    };
+
+    std::vector<uniform_block_t> m_vUniformBlocks;
+
+    // Injected after #version in both stages
+    std::string m_sDefines;
+
+    static build_t submit(const std::string& vertex, const std::string& fragment, const std::string& defines);
+
+    [[nodiscard]]
+    static bool build_ready(const build_t& build);
+
+    // Checks compile and link status, fills log and returns false on errors
+    bool complete(build_t& build);
+
+    // Keeps existing handle indices valid when preserve is set
+    void reflect_uniforms(bool preserve);
+
+    void apply_uniform_blocks();
+
+    // Point the objectData sampler of instanced shaders at the object data texture
+    void apply_object_data();
+
+    // Re-upload a cached value, used after swapping programs
+    void upload(const uniform_t& uniform);
+
+    [[nodiscard]]
+    int resolve_uniform(const char* name, uniform_kind kind);
+
+    // Returns true if the value differs from the cache and must be uploaded
+    // False without uploading when the uniform is no longer of the handle's kind
+    bool update_cache(int index, uniform_kind kind, const void* value, size_t size);
 
 public:
-    shader(const std::string& vertex, const std::string& fragment);
+    // Submits the compile and link, nothing waits on the driver until the
+    // program is polled, finished or first used
+    shader(const std::string& vertex, const std::string& fragment, const std::string& defines = "");
+
+    // Non-blocking when KHR_parallel_shader_compile is available
+    [[nodiscard]]
+    bool is_ready() const;
+
+    // Finish the program if the driver is done with it, true once it is ready or failed
+    bool poll();
+
+    // Block until the program is linked, then check errors and reflect uniforms
+    // error and log are only meaningful after this
+    void finish();
+
+    // Compile replacement sources in the background, with the same defines
+    // The current program stays in use until the new one has linked
+    void reload(const std::string& vertex, const std::string& fragment);
+
+    // Swap in a finished reload, true if the program was replaced
+    // Handles, uniform values and block bindings carry over to the new program
+    bool poll_reload();
+
+    // Bind a uniform block to a binding point, remembered across reloads
+    void bind_uniform_block(const char* name, unsigned int binding);
+
+    // Same, and checks the linked block against T's layout every time the program links
+    template <typename T>
+    void bind_uniform_block(const char* name, unsigned int binding) {
+        bind_uniform_block(name, binding, block_members<T>::value, sizeof(T));
+    }
+
+    void bind_uniform_block(const char* name, unsigned int binding, std::span<const block_member_t> members, size_t size);
 
     void use();
 
+    template <typename T>
+    [[nodiscard]]
+    uniform_handle<T> get_uniform(const char* name) {
+        return { resolve_uniform(name, uniform_kind_of<T>::value) };
+    }
+
+    void set(uniform_handle<float> handle, float v);
+
+    void set(uniform_handle<int> handle, int v);
+
+    void set(uniform_handle<glm::vec3> handle, const glm::vec3& v);
+
+    void set(uniform_handle<glm::vec4> handle, const glm::vec4& v);
+
+    void set(uniform_handle<glm::mat3> handle, const glm::mat3& v);
+
+    void set(uniform_handle<glm::mat4> handle, const glm::mat4& v);
+
+    // Name based setters, these look the name up in the reflected table
     void setFloat(const char *name, const float &v);
 
     void setInt(const char *name, const int &v);
@@ -38,6 +254,25 @@ public:
     void setVec3(const char* name, const float x, const float y, const float z);
 
     const unsigned int getProgram() const;
+
+    // Does the vertex shader fetch its per object data by an instanced object id (object_data)
+    [[nodiscard]]
+    bool uses_instancing() const {
+        return m_bInstanced;
+    }
+
+    [[nodiscard]]
+    unsigned int get_id() const {
+        return m_uId;
+    }
+
+    // Was the program created from the on-disk binary cache rather than compiled
+    [[nodiscard]]
+    bool from_binary_cache() const;
+
+    static uniform_stats_t get_uniform_stats();
+
+    static void reset_uniform_stats();
 };
 
 
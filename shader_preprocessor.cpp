@@ -0,0 +1,203 @@
+#include "shader_preprocessor.h"
+#include "hash.h"
+#include <fstream>
+#include <regex>
+#include <sstream>
+#include <unordered_map>
+#include <unordered_set>
+
+namespace {
+	struct file_t {
+		std::string text;
+		uint64_t hash = 0;
+		bool loaded = false;
+	};
+
+	struct memo_t {
+		uint64_t hash = 0;
+		std::vector<std::string> files;
+		shader_preprocessor::result_t result;
+	};
+
+	// Keyed by directory + path
+	std::unordered_map<std::string, file_t> files;
+
+	// Source string numbers, never reused so logs stay readable across reloads
+	// 0 is what the driver uses for anything before the first #line
+	std::unordered_map<std::string, int> fileIds;
+	std::vector<std::string> fileNames{ "" };
+
+	// Last expansion of each root file
+	std::unordered_map<std::string, memo_t> memos;
+
+	int id_for(const std::string& path) {
+		const auto found = fileIds.find(path);
+		if (found != fileIds.end()) {
+			return found->second;
+		}
+
+		const auto id = static_cast<int>(fileNames.size());
+		fileIds[path] = id;
+		fileNames.push_back(path);
+		return id;
+	}
+
+	const file_t* read(const std::string& directory, const std::string& path) {
+		auto& file = files[directory + path];
+		if (!file.loaded) {
+			auto ifs = std::ifstream(directory + path);
+			if (!ifs) {
+				return nullptr;
+			}
+
+			auto buffer = std::stringstream{};
+			buffer << ifs.rdbuf();
+			file.text = buffer.str();
+			file.hash = fnv1a(file.text);
+			file.loaded = true;
+		}
+
+		return &file;
+	}
+
+	// Pulls the file name out of #include "name" or #include <name>
+	bool parse_include(const std::string& line, std::string& name) {
+		const auto start = line.find_first_not_of(" \t");
+		if (start == std::string::npos || line.compare(start, 8, "#include") != 0) {
+			return false;
+		}
+
+		const auto open = line.find_first_of("\"<", start + 8);
+		if (open == std::string::npos) {
+			return false;
+		}
+
+		const auto close = line.find(line[open] == '"' ? '"' : '>', open + 1);
+		if (close == std::string::npos) {
+			return false;
+		}
+
+		name = line.substr(open + 1, close - open - 1);
+		return true;
+	}
+
+	bool expand(const std::string& directory, const std::string& path, std::string& out,
+		std::unordered_set<std::string>& included, shader_preprocessor::result_t& result) {
+		if (!included.insert(path).second) {
+			return true;
+		}
+
+		const auto* file = read(directory, path);
+		if (!file) {
+			result.error = "Could not open " + directory + path;
+			return false;
+		}
+
+		result.files.push_back(path);
+		const auto id = id_for(path);
+		const auto isRoot = result.files.size() == 1;
+
+		// Anything other than the root starts numbering from its first line
+		if (!isRoot) {
+			out += "#line 1 " + std::to_string(id) + "\n";
+		}
+
+		std::istringstream stream{ file->text };
+		std::string line;
+		auto lineNumber = 0;
+		while (std::getline(stream, line)) {
+			lineNumber++;
+
+			std::string include;
+			if (parse_include(line, include)) {
+				if (!expand(directory, include, out, included, result)) {
+					return false;
+				}
+
+				// Back in this file on the line after the include
+				out += "#line " + std::to_string(lineNumber + 1) + " " + std::to_string(id) + "\n";
+				continue;
+			}
+
+			out += line;
+			out += "\n";
+
+			// #version must stay first, the root gets its source number right after it
+			if (isRoot && line.find("#version") != std::string::npos && line.find("#version") == line.find_first_not_of(" \t")) {
+				out += "#line " + std::to_string(lineNumber + 1) + " " + std::to_string(id) + "\n";
+			}
+		}
+
+		return true;
+	}
+
+	// Combined hash of every file the last expansion used, rereading any that were invalidated
+	bool current_hash(const std::string& directory, const std::vector<std::string>& deps, uint64_t& hash) {
+		hash = fnv1a_basis;
+		for (const auto& dep : deps) {
+			const auto* file = read(directory, dep);
+			if (!file) {
+				return false;
+			}
+
+			const auto h = file->hash;
+			hash = fnv1a({ reinterpret_cast<const char*>(&h), sizeof(h) }, hash);
+		}
+		return true;
+	}
+}
+
+namespace shader_preprocessor {
+	result_t process(const std::string& directory, const std::string& path) {
+		auto& memo = memos[directory + path];
+
+		uint64_t hash;
+		if (!memo.files.empty() && current_hash(directory, memo.files, hash) && hash == memo.hash) {
+			return memo.result;
+		}
+
+		result_t result;
+		std::unordered_set<std::string> included;
+		result.ok = expand(directory, path, result.source, included, result);
+		if (!result.ok) {
+			return result;
+		}
+
+		memo.files = result.files;
+		current_hash(directory, memo.files, memo.hash);
+		memo.result = result;
+		return result;
+	}
+
+	void invalidate(const std::string& path) {
+		for (auto& [key, file] : files) {
+			// Whole path components only, "data.glsl" is not "shader_data.glsl"
+			const auto at = key.size() - path.size();
+			if (key.ends_with(path) && (at == 0 || key[at - 1] == '/' || key[at - 1] == '\\')) {
+				file.loaded = false;
+			}
+		}
+	}
+
+	std::string map_log(const std::string& log) {
+		// Mesa "0:12(5):", NVIDIA "0(12) :", AMD/Intel "ERROR: 0:12:"
+		static const std::regex location{ R"(^((?:ERROR|WARNING): )?(\d+)([:(]\d+))" };
+
+		std::string mapped;
+		std::istringstream stream{ log };
+		std::string line;
+		while (std::getline(stream, line)) {
+			std::smatch match;
+			if (std::regex_search(line, match, location)) {
+				const auto id = std::stoul(match[2].str());
+				if (id > 0 && id < fileNames.size()) {
+					line = match[1].str() + fileNames[id] + match[3].str() + match.suffix().str();
+				}
+			}
+
+			mapped += line;
+			mapped += "\n";
+		}
+		return mapped;
+	}
+}
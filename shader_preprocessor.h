@@ -0,0 +1,31 @@
+#ifndef SHADER_PREPROCESSOR_H
+#define SHADER_PREPROCESSOR_H
+#include <string>
+#include <vector>
+
+// Expands #include "file" in GLSL sources, resolved relative to the shader directory
+// Every file is included at most once per expansion, so shared headers need no guards
+// Each file gets a process wide source string number that is emitted with #line,
+// map_log turns those back into file names in compile logs
+namespace shader_preprocessor {
+	struct result_t {
+		bool ok = false;
+		std::string source;
+		std::string error;
+
+		// Root first, then every file it pulled in, relative to the shader directory
+		std::vector<std::string> files;
+	};
+
+	// Files are read once and expanded sources are memoized by the content hash of
+	// every file involved, so headers shared by many programs are only processed once
+	result_t process(const std::string& directory, const std::string& path);
+
+	// Forget a file that changed on disk, the next expansion that uses it rereads it
+	void invalidate(const std::string& path);
+
+	// Replace source string numbers in a driver log with file names
+	std::string map_log(const std::string& log);
+}
+
+#endif // SHADER_PREPROCESSOR_H
@@ -0,0 +1,6 @@
+// Per frame light data, written by RenderLight
+layout (std140) uniform light_data
+{
+    uniform vec3 lightPos;
+    uniform vec3 lightColor;
+};
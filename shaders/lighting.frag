@@ -1,36 +1,37 @@
 #version 330 core
+#pragma keywords TEXTURED REFLECTION NORMAL_MAP
 
 in vec2 bUV;
 in vec3 bNormal;
 in vec3 FragPos;
+in vec3 bColor;
 
 out vec4 FragColor;
 
-uniform vec3 objectColor;
-uniform vec3 lightColor;
-uniform vec3 lightPos;
-
-uniform int textured;
+#ifdef TEXTURED
 uniform sampler2D tex1;
-uniform sampler2D tex2;
+#endif
+
+#ifdef NORMAL_MAP
+uniform sampler2D normalMap;
+#endif
 
+#ifdef REFLECTION
 // Skybox sampler for reflection
 uniform samplerCube skybox;
+uniform float reflectivity;
+#endif
 
 vec3 norm;
 vec3 lightDir;
 
-layout (std140) uniform shader_data
-{ 
-    uniform mat4 view;
-    uniform mat4 projection;
-    uniform vec3 cameraPosition;
-};
+#include "shader_data.glsl"
+#include "light_data.glsl"
 
 vec3 computeAmbient() {
     float ambientStrength = 0.1;
     vec3 ambient = ambientStrength * lightColor;
-    return ambient * objectColor;
+    return ambient * bColor;
 }
 
 vec3 computeDiffuse() {
@@ -47,19 +48,45 @@ vec3 computeSpecular() {
     return specular;
 }
 
+#ifdef NORMAL_MAP
+// Meshes carry no tangents, so build the tangent frame from screen space derivatives
+vec3 perturbNormal(vec3 N) {
+    vec3 dp1 = dFdx(FragPos);
+    vec3 dp2 = dFdy(FragPos);
+    vec2 duv1 = dFdx(bUV);
+    vec2 duv2 = dFdy(bUV);
+
+    vec3 dp2perp = cross(dp2, N);
+    vec3 dp1perp = cross(N, dp1);
+    vec3 T = dp2perp * duv1.x + dp1perp * duv2.x;
+    vec3 B = dp2perp * duv1.y + dp1perp * duv2.y;
+    float invmax = inversesqrt(max(dot(T, T), dot(B, B)));
+
+    vec3 mapped = texture(normalMap, bUV).xyz * 2.0 - 1.0;
+    return normalize(mat3(T * invmax, B * invmax, N) * mapped);
+}
+#endif
+
 void main() {
-    vec3 baseColor = objectColor;
-    if (textured != 0 && false) {
-        baseColor = vec3(texture(tex1, bUV));
-    }
+    vec3 baseColor = bColor;
+#ifdef TEXTURED
+    baseColor = vec3(texture(tex1, bUV));
+#endif
     norm = normalize(bNormal);
+#ifdef NORMAL_MAP
+    norm = perturbNormal(norm);
+#endif
     lightDir = normalize(lightPos - FragPos);
     vec3 ambient = computeAmbient();
     vec3 diffuse = computeDiffuse();
     vec3 specular = computeSpecular();
     vec3 result = (ambient + diffuse + specular) * baseColor;
 
+#ifdef REFLECTION
     vec3 I = normalize(FragPos - cameraPosition);
-    vec3 R = reflect(I, normalize(bNormal));
-    FragColor = (vec4(texture(skybox, R).rgb, 1.0) * vec4(.05)) + vec4(result, 1.0);
+    vec3 R = reflect(I, norm);
+    FragColor = (vec4(texture(skybox, R).rgb, 1.0) * vec4(reflectivity)) + vec4(result, 1.0);
+#else
+    FragColor = vec4(result, 1.0);
+#endif
 }
\ No newline at end of file
@@ -6,24 +6,22 @@ layout (location = 2) in vec3 aNormal;
 layout (location = 3) in int aTextured;
 layout (location = 4) in int aNormalized;
 
+// Per instance, indexes the object data
+layout (location = 5) in uint objectId;
+
 out vec2 bUV;
 out vec3 bNormal;
 out vec3 FragPos;
+out vec3 bColor;
 
-uniform mat4 model;
-uniform mat4 normalModel;
-
-layout (std140) uniform shader_data
-{ 
-    uniform mat4 view;
-    uniform mat4 projection;
-    uniform vec3 cameraPosition;
-};
+#include "shader_data.glsl"
+#include "object_data.glsl"
 
 void main() {
     //gl_Position = projection * view * model * vec4(aPos.xyz, 1.0);
-    FragPos = vec3(model * vec4(aPos, 1.0));
-    bNormal = mat3(normalModel) * aNormal;
+    FragPos = vec3(objectModel(objectId) * vec4(aPos, 1.0));
+    bNormal = objectNormalModel(objectId) * aNormal;
+    bColor = objectColor(objectId).rgb;
     gl_Position = projection * view * vec4(FragPos, 1.0);
 
     // Unused
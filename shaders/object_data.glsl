@@ -0,0 +1,19 @@
+// Per object data written by object_data::push, see object_data_t
+// 8 texels per object: model matrix, normal matrix columns padded to vec4, color
+uniform samplerBuffer objectData;
+
+mat4 objectModel(uint id) {
+    int base = int(id) * 8;
+    return mat4(texelFetch(objectData, base), texelFetch(objectData, base + 1),
+                texelFetch(objectData, base + 2), texelFetch(objectData, base + 3));
+}
+
+mat3 objectNormalModel(uint id) {
+    int base = int(id) * 8 + 4;
+    return mat3(texelFetch(objectData, base).xyz, texelFetch(objectData, base + 1).xyz,
+                texelFetch(objectData, base + 2).xyz);
+}
+
+vec4 objectColor(uint id) {
+    return texelFetch(objectData, int(id) * 8 + 7);
+}
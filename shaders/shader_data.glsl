@@ -0,0 +1,7 @@
+// Per frame camera data, written by update_matrix_ubo
+layout (std140) uniform shader_data
+{ 
+    uniform mat4 view;
+    uniform mat4 projection;
+    uniform vec3 cameraPosition;
+};
@@ -14,5 +14,6 @@ uniform mat4 view;
 void main()
 {
     TexCoords = aPos;
-    gl_Position = projection * view * vec4(aPos, 1.0);
+    // w for z puts it on the far plane, it is drawn last with GL_LEQUAL
+    gl_Position = (projection * view * vec4(aPos, 1.0)).xyww;
 } 
\ No newline at end of file
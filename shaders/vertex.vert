@@ -8,11 +8,7 @@ layout (location = 4) in float aC;
 
 uniform mat4 model;
 
-layout (std140) uniform shader_data
-{ 
-    uniform mat4 view;
-    uniform mat4 projection;
-};
+#include "shader_data.glsl"
 
 out vec3 bColor;
 out vec2 bUV;
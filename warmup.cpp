@@ -0,0 +1,145 @@
+#include "warmup.h"
+#include "shader.h"
+#include "mesh.h"
+#include "glad/glad.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+namespace {
+	// Anything above this on first use is a hitch worth reporting
+	constexpr double SLOW_MS = 1.0;
+
+	struct combination_t {
+		std::shared_ptr<shader> program;
+		std::shared_ptr<mesh> geometry;
+		gl_state::pipeline_state_t pipeline;
+		std::string label;
+	};
+
+	struct seen_t {
+		std::string label;
+		bool warmed = false;
+		bool used = false;
+	};
+
+	std::vector<combination_t> pending;
+	std::unordered_set<unsigned long long> pendingKeys;
+
+	// Every combination that was warmed up or drawn, by key
+	std::unordered_map<unsigned long long, seen_t> seen;
+
+	unsigned long long key_for(const unsigned program, const unsigned vao, const gl_state::pipeline_state_t& pipeline) {
+		const auto bits = (pipeline.depthTest ? 1u : 0u) | (pipeline.depthMask ? 2u : 0u)
+			| (pipeline.cullFace ? 4u : 0u) | (pipeline.blend ? 8u : 0u);
+		return (static_cast<unsigned long long>(program) << 36) | (static_cast<unsigned long long>(vao) << 4) | bits;
+	}
+
+	double elapsed_ms(const std::chrono::steady_clock::time_point start) {
+		return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+	}
+}
+
+namespace warmup {
+	void add(const std::shared_ptr<shader>& program, const std::shared_ptr<mesh>& mesh,
+		const gl_state::pipeline_state_t& pipeline, const std::string& label) {
+		if (!program || !mesh) {
+			return;
+		}
+
+		// Meshes share the geometry pool's VAO, so this is usually one entry per program and state
+		const auto key = key_for(program->getProgram(), mesh->get_vertex_array(), pipeline);
+		if (seen.contains(key) || !pendingKeys.insert(key).second) {
+			return;
+		}
+
+		pending.push_back({ program, mesh, pipeline, label });
+	}
+
+	void run() {
+		if (pending.empty()) {
+			return;
+		}
+
+		const auto known = gl_state::pipeline_state_known();
+		const auto previous = gl_state::current_pipeline_state();
+		const auto scissored = gl_state::current_scissor_test();
+		gl_state::set_scissor_test(true);
+		gl_state::set_scissor(0, 0, 1, 1);
+
+		const auto start = std::chrono::steady_clock::now();
+		auto slow = 0;
+		for (auto& combination : pending) {
+			combination.program->use();
+			if (combination.program->error) {
+				continue;
+			}
+
+			const auto program = combination.program->getProgram();
+			const auto vao = combination.geometry->get_vertex_array();
+			auto& entry = seen[key_for(program, vao, combination.pipeline)];
+			if (entry.warmed) {
+				continue;
+			}
+
+			// Finish each draw so the time lands on the combination that caused it
+			const auto drawStart = std::chrono::steady_clock::now();
+			gl_state::set_pipeline_state(combination.pipeline);
+			gl_state::bind_vertex_array(vao);
+			const auto& range = combination.geometry->get_range();
+			const auto* first = reinterpret_cast<const void*>(range.firstIndex * sizeof(unsigned));
+			const auto count = std::min(3u, range.count);
+			if (combination.program->uses_instancing()) {
+				glDrawElementsInstancedBaseVertex(GL_TRIANGLES, count, GL_UNSIGNED_INT, first, 1, range.baseVertex);
+			}
+			else {
+				glDrawElementsBaseVertex(GL_TRIANGLES, count, GL_UNSIGNED_INT, first, range.baseVertex);
+			}
+			glFinish();
+			const auto ms = elapsed_ms(drawStart);
+
+			entry.label = combination.label;
+			entry.warmed = true;
+			if (ms > SLOW_MS) {
+				printf("Warm-up: %s took %.2f ms\n", combination.label.c_str(), ms);
+				slow++;
+			}
+		}
+
+		// A state nobody knew is left as the warm-up set it, gl_state knows it now
+		gl_state::set_scissor_test(scissored);
+		if (known) {
+			gl_state::set_pipeline_state(previous);
+		}
+
+		printf("Warm-up: %zu combinations in %.2f ms, %d slow\n", pending.size(), elapsed_ms(start), slow);
+		pending.clear();
+		pendingKeys.clear();
+	}
+
+	void draw(mesh& mesh) {
+		draw(mesh.get_vertex_array(), [&] { mesh.Draw(); });
+	}
+
+	bool begin_first_use(const unsigned int vao) {
+		return !seen[key_for(gl_state::current_program(), vao, gl_state::current_pipeline_state())].used;
+	}
+
+	void end_first_use(const unsigned int vao, const std::chrono::steady_clock::duration elapsed) {
+		const auto program = gl_state::current_program();
+		auto& entry = seen[key_for(program, vao, gl_state::current_pipeline_state())];
+		entry.used = true;
+		if (entry.label.empty()) {
+			entry.label = "program " + std::to_string(program) + " with vertex array " + std::to_string(vao);
+		}
+
+		const auto ms = std::chrono::duration<double, std::milli>(elapsed).count();
+		if (ms > SLOW_MS) {
+			printf("First use of %s took %.2f ms%s\n", entry.label.c_str(), ms,
+				entry.warmed ? " despite the warm-up" : ", it was not warmed up");
+		}
+	}
+}
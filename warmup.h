@@ -0,0 +1,54 @@
+#ifndef WARMUP_H
+#define WARMUP_H
+#include <chrono>
+#include <memory>
+#include <string>
+#include "gl_state.h"
+
+class shader;
+class mesh;
+
+// Drivers often finish compiling a program on the first draw that uses it with a given
+// vertex layout and fixed function state, which shows up as a spike the first time
+// something appears on screen. Every combination registered here gets a tiny draw at
+// startup so that cost is paid before the first frame instead
+namespace warmup {
+	// Remember a combination to warm up, duplicates are ignored
+	void add(const std::shared_ptr<shader>& program, const std::shared_ptr<mesh>& mesh,
+		const gl_state::pipeline_state_t& pipeline, const std::string& label);
+
+	// Draw every combination added since the last run
+	// Draws go to a single scissored pixel of the back buffer, which the first frame clears,
+	// so they hit the same framebuffer format and sample count as real draws
+	void run();
+
+	// Issue a draw with the current program and state on a vertex array
+	// The first real use of each combination is timed and logged when it is slow,
+	// warmed up or not, so combinations the warm-up misses are easy to spot
+	template <typename F>
+	void draw(unsigned int vao, F&& issue);
+
+	// Same for a plain mesh draw
+	void draw(mesh& mesh);
+
+	// Used by draw, true when the current combination has not been drawn before
+	[[nodiscard]]
+	bool begin_first_use(unsigned int vao);
+
+	void end_first_use(unsigned int vao, std::chrono::steady_clock::duration elapsed);
+}
+
+template <typename F>
+void warmup::draw(const unsigned int vao, F&& issue) {
+	if (!begin_first_use(vao)) {
+		issue();
+		return;
+	}
+
+	// Only the CPU side is timed, deferred compiles happen inside the draw call
+	const auto start = std::chrono::steady_clock::now();
+	issue();
+	end_first_use(vao, std::chrono::steady_clock::now() - start);
+}
+
+#endif // WARMUP_H
@@ -1,5 +1,7 @@
 #include <glad/glad.h>
 #include <glfw/glfw3.h>
+#include "gl_state.h"
+#include "gl_extensions.h"
 
 struct window_config_t {
 	unsigned glContextMajor, glContextMinor;
@@ -43,6 +45,7 @@ GLFWwindow* init_window(window_config_t config) {
 
 		return nullptr;
 	}
+	gl_extensions::load(GLADloadproc(glfwGetProcAddress));
 
 	// Set our viewport.  Match the window dimensions as we aren't doing anything outside of the viewport
 	glViewport(0, 0, config.width, config.height);
@@ -52,12 +55,12 @@ GLFWwindow* init_window(window_config_t config) {
 	glfwSetInputMode(window, GLFW_CURSOR, GLFW_CURSOR_DISABLED);
 
 	// Z Test
-	glEnable(GL_DEPTH_TEST);
+	gl_state::set_depth_test(true);
 
 	// Face culling, clockwise triangles are front
-	glEnable(GL_CULL_FACE);
-	glCullFace(GL_FRONT);
-	glFrontFace(GL_CW);
+	gl_state::set_cull_face(true);
+	gl_state::set_cull_mode(GL_FRONT);
+	gl_state::set_front_face(GL_CW);
 
 	// Enable MSAA
 	if (config.msaa) {